@@ -1,2 +1,2 @@
 TEMPLATE = subdirs
-SUBDIRS = qtgpxlib tests gpxgui 
+SUBDIRS = qtgpxlib tests gpxgui skistats gpxrender
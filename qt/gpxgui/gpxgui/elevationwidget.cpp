@@ -17,63 +17,175 @@
 #include "elevationwidget.h"
 #include "utils.h"
 
-ElevationWidget::ElevationWidget(QWidget *parent) : GpxTab(parent), _gpx(0) {
+#include <QtConcurrentRun>
+
+#include <cmath>
+
+ElevationWidget::ElevationWidget(QWidget *parent) : GpxTab(parent), _gpx(0), renderPending(false),
+                                                    renderDiscard(false) {
+    connect(&renderWatcher, SIGNAL(finished()),
+            this, SLOT(renderFinished()));
 }
 
 ElevationWidget::~ElevationWidget() {
+    renderWatcher.waitForFinished();
 }
 
 void ElevationWidget::setGpx(GpxFile *gpx) {
     this->_gpx = gpx;
-    update(rect());
+    if (gpx == 0) {
+        // Whatever is being rendered belongs to the old file
+        renderDiscard = renderWatcher.isRunning();
+        renderPending = false;
+        pyramids.clear();
+        cache = QImage();
+        update();
+        return;
+    }
+    // The pyramids and last image are kept, so the partial copies shown
+    // while a file loads only extend the pyramids and redraw once
+    updatePyramids();
+    startRender();
 }
 
-void ElevationWidget::paintEvent(QPaintEvent *event) {
+void ElevationWidget::updatePyramids() {
     if (_gpx == 0) return;
 
+    // Segments are matched by position.  Unchanged ones cost nothing,
+    // ones that only grew are extended, and anything else is rebuilt.
+    int segs = _gpx->segmentCount();
+    while (pyramids.size() > segs) {
+        pyramids.removeLast();
+    }
+    while (pyramids.size() < segs) {
+        pyramids.push_back(GpxMinMaxPyramid());
+    }
+    for (int i=0; i<segs; ++i) {
+        pyramids[i].update(_gpx->at(i).elevationColumn());
+    }
+}
+
+void ElevationWidget::paintEvent(QPaintEvent *event) {
+    if (cache.isNull()) return;
+
     QPainter p(this);
-    int nPts = _gpx->pointCount();
-    double minX;
-    double minY;
-    double minEle;
-    double maxX;
-    double maxY;
-    double maxEle;
-    int xBorder = width()*0.05;
-    int yBorder = height()*0.05;
-    p.setWindow(-xBorder, -yBorder, width()+xBorder, height()+yBorder);
-    _gpx->boundUTM(minX, minY, minEle, maxX, maxY, maxEle);
+    if (cache.size() == size()) {
+        p.drawImage(event->rect(), cache, event->rect());
+    } else {
+        // Stretch the old picture until the new one is ready
+        p.setRenderHint(QPainter::SmoothPixmapTransform);
+        p.drawImage(rect(), cache);
+    }
+}
 
-    double de = maxEle - minEle;
-    double cx = 0.0;
-    double dx = double(width())/double(nPts);
-    double ocx;
+void ElevationWidget::resizeEvent(QResizeEvent *event) {
+    startRender();
+}
 
-    while (colors.size() < _gpx->segmentCount()) {
+void ElevationWidget::startRender() {
+    if (_gpx == 0 || width() <= 0 || height() <= 0) return;
+
+    if (renderWatcher.isRunning()) {
+        renderPending = true;
+        return;
+    }
+
+    while (colors.size() < pyramids.size()) {
         colors.push_back(randColor());
     }
-    for (int i=0; i<_gpx->segmentCount(); ++i) {
-        ocx = cx;
+
+    // The pyramids share their data, so the copies made for the other
+    // thread are cheap
+    renderWatcher.setFuture(QtConcurrent::run(renderProfile, pyramids, colors, size()));
+}
+
+void ElevationWidget::renderFinished() {
+    if (renderDiscard) {
+        renderDiscard = false;
+        renderPending = false;
+        startRender();
+        return;
+    }
+
+    cache = renderWatcher.result();
+    if (renderPending) {
+        renderPending = false;
+        startRender();
+    }
+    update();
+}
+
+QImage ElevationWidget::renderProfile(QList<GpxMinMaxPyramid> pyramids,
+                                      QList<QColor> colors, QSize size) {
+    int nPts = 0;
+    for (int i=0; i<pyramids.size(); ++i) {
+        nPts += pyramids[i].size();
+    }
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(0);
+    if (nPts == 0) return image;
+
+    int width = size.width();
+    int height = size.height();
+
+    QPainter p(&image);
+    int xBorder = width*0.05;
+    int yBorder = height*0.05;
+    p.setWindow(-xBorder, -yBorder, width+xBorder, height+yBorder);
+
+    double minEle = 0.0;
+    double maxEle = 0.0;
+    bool first = true;
+    for (int i=0; i<pyramids.size(); ++i) {
+        if (pyramids[i].size() == 0) continue;
+        double lo, hi;
+        pyramids[i].minMax(0, pyramids[i].size(), lo, hi);
+        if (first || lo < minEle) minEle = lo;
+        if (first || hi > maxEle) maxEle = hi;
+        first = false;
+    }
+
+    double de = maxEle - minEle;
+    double cx = 0.0;
+    double dx = double(width)/double(nPts);
+
+    for (int i=0; i<pyramids.size(); ++i) {
+        const GpxMinMaxPyramid &pyramid = pyramids[i];
+        int n = pyramid.size();
+        double ocx = cx;
+        double segWidth = n*dx;
+
         QPainterPath ep;
-        ep.moveTo(cx,height());
-        GpxTrackSegment cs = _gpx->track(i);
-
-        for (int j=0; j<cs.pointCount(); ++j) {
-            GpxPoint tmp = cs[j];
-            double ele = height()-height()*(tmp.elevation()-minEle)/de;
-        
-            ep.lineTo(cx, ele);
-            cx += dx;
+        ep.moveTo(cx,height);
+
+        // One vertex per point while they're at least half a pixel
+        // apart, otherwise one per pixel column at the column's highest
+        // point, so peaks stay visible at any width
+        int columns = int(std::ceil(segWidth));
+        if (n <= 2*columns) {
+            const double *ele = pyramid.values();
+            for (int j=0; j<n; ++j) {
+                ep.lineTo(cx, height-height*(ele[j]-minEle)/de);
+                cx += dx;
+            }
+        } else {
+            for (int c=0; c<columns; ++c) {
+                int from = int(qint64(n) * c / columns);
+                int to = int(qint64(n) * (c+1) / columns);
+                double lo, hi;
+                pyramid.minMax(from, to-from, lo, hi);
+                ep.lineTo(ocx + segWidth*(c+0.5)/columns, height-height*(hi-minEle)/de);
+            }
+            cx = ocx + segWidth;
         }
-        ep.lineTo(cx, height());
-        ep.lineTo(ocx,height());
+        ep.lineTo(cx, height);
+        ep.lineTo(ocx,height);
         p.fillPath(ep, colors[i]);
     }
-}
-
-void ElevationWidget::resizeEvent(QResizeEvent *event) {
+    return image;
 }
 
 void ElevationWidget::gpxChanged() {
-    update();
+    updatePyramids();
+    startRender();
 }
@@ -16,8 +16,11 @@
 
 #include <QtGui>
 #include <QWidget>
+#include <QImage>
+#include <QFutureWatcher>
 
 #include "gpxtab.h"
+#include "gpxpyramid.h"
 
 class ElevationWidget : public GpxTab {
     Q_OBJECT;
@@ -33,7 +36,36 @@ protected:
     void paintEvent(QPaintEvent *event);
     void resizeEvent(QResizeEvent *event);
 
+private slots:
+    void renderFinished();
+
 private:
+    // Bring the pyramids up to date with the file's segments
+    void updatePyramids();
+
+    // Redraw the cached profile at the current size in the background
+    void startRender();
+
+    // Draw the profile into a new image.  Only uses its arguments, so it
+    // can run on any thread.
+    static QImage renderProfile(QList<GpxMinMaxPyramid> pyramids,
+                                QList<QColor> colors, QSize size);
+
     GpxFile *_gpx;
     QList<QColor> colors;
+
+    // Elevation extremes of each segment, so a repaint costs about one
+    // lookup per pixel column instead of one per point
+    QList<GpxMinMaxPyramid> pyramids;
+
+    // The last finished render.  Painted as is, or scaled while a render
+    // at the new size is running.
+    QImage cache;
+    QFutureWatcher<QImage> renderWatcher;
+
+    // Something changed while a render was running
+    bool renderPending;
+
+    // The file was closed while a render was running
+    bool renderDiscard;
 };
@@ -20,8 +20,12 @@
 #include "gpxgui.h"
 #include "gpxtreewidget.h"
 #include "gpxfile.h"
+#include "gpxwriter.h"
+#include "gpxbinary.h"
+#include "gpxloader.h"
 
 #include "elevationwidget.h"
+#include "mapwidget.h"
 
 void GpxGui::readSettings() {
 }
@@ -40,14 +44,27 @@ GpxGui::GpxGui(QWidget *parent) : QMainWindow(parent), gpx(0) {
     gpxTree = new GpxTreeWidget;
     visTabs = new QTabWidget;
     eleW = new ElevationWidget;
+    mapW = new MapWidget;
     visTabs->insertTab(0, eleW, tr("Elevation Profile"));
+    visTabs->insertTab(1, mapW, tr("Map"));
 
     split->addWidget(gpxTree);
     split->addWidget(visTabs);
     connect(gpxTree, SIGNAL(gpxChanged()),
             eleW, SLOT(gpxChanged()));
-    // split->addWidget(new QLabel("Visualization widget goes here..."));
+    connect(gpxTree, SIGNAL(gpxChanged()),
+            mapW, SLOT(gpxChanged()));
+    connect(gpxTree, SIGNAL(gpxAboutToChange(const QString &)),
+            this, SLOT(recordEdit(const QString &)));
     setCentralWidget(split);
+
+    loader = new GpxLoader(this);
+    connect(loader, SIGNAL(progressChanged(int)),
+            this, SLOT(loadProgress(int)));
+    connect(loader, SIGNAL(partialReady()),
+            this, SLOT(partialLoaded()));
+    connect(loader, SIGNAL(finished(bool)),
+            this, SLOT(loadFinished(bool)));
 }
 
 GpxGui::~GpxGui() {
@@ -89,9 +106,22 @@ void GpxGui::setupFileActions() {
     fillInAction(&closeAction, tr("Close"), tr("Close current GPX file."),
                  SLOT(closeFile()), QIcon(":/images/close.png"));
 
+    fillInAction(&cancelLoadAction, tr("Cancel Loading"), tr("Stop loading the GPX file."),
+                 SLOT(cancelLoad()), QIcon(":/images/close.png"));
+
     fillInAction(&exitAction, tr("E&xit"), tr("Exit GpxGui"), SLOT(close()));
 }
 
+void GpxGui::setupEditActions() {
+    fillInAction(&undoAction, tr("&Undo"), tr("Undo the last change to the tracks."),
+                 SLOT(undo()));
+    undoAction->setShortcut(QKeySequence::Undo);
+
+    fillInAction(&redoAction, tr("&Redo"), tr("Redo the last change undone."),
+                 SLOT(redo()));
+    redoAction->setShortcut(QKeySequence::Redo);
+}
+
 void GpxGui::setupHelpActions() {
     fillInAction(&aboutAction, tr("&About"), tr("About GpxGui"),
                  SLOT(about()), QIcon(":/images/globe.png"));
@@ -100,6 +130,7 @@ void GpxGui::setupHelpActions() {
 
 void GpxGui::setupActions() {
     setupFileActions();
+    setupEditActions();
     setupHelpActions();
 
     aboutAction->setDisabled(false);
@@ -112,6 +143,7 @@ void GpxGui::setupToolBar() {
     tb->addAction(openAction);
     tb->addAction(saveAsAction);
     tb->addAction(closeAction);
+    tb->addAction(cancelLoadAction);
     addToolBar(tb);
 }
 
@@ -121,9 +153,14 @@ void GpxGui::setupMenuBar() {
     fileMenu->addAction(saveAction);
     fileMenu->addAction(saveAsAction);
     fileMenu->addAction(closeAction);
+    fileMenu->addAction(cancelLoadAction);
     fileMenu->addSeparator();
     fileMenu->addAction(exitAction);
 
+    QMenu *editMenu = menuBar()->addMenu(tr("&Edit"));
+    editMenu->addAction(undoAction);
+    editMenu->addAction(redoAction);
+
     menuBar()->addSeparator();
   
     QMenu *helpMenu = menuBar()->addMenu(tr("&Help"));
@@ -145,8 +182,14 @@ void GpxGui::setupStatusBar() {
     curFileNameLbl->setText("File Name");
     curFileNameLbl->setAlignment(Qt::AlignHCenter);
   
+    loadProgressBar = new QProgressBar;
+    loadProgressBar->setRange(0, 100);
+    loadProgressBar->setMaximumWidth(fontMetrics().maxWidth()*12);
+    loadProgressBar->hide();
+
     statusBar()->addWidget(curDistanceLbl);
     statusBar()->addWidget(curFileNameLbl);
+    statusBar()->addPermanentWidget(loadProgressBar);
 }
 void GpxGui::notYetImplemented() {
     QMessageBox::critical(this, tr("Not Yet Implemented"),
@@ -164,22 +207,122 @@ void GpxGui::openFile() {
     QString newFileName = QFileDialog::getOpenFileName(this,
                                                        tr("Choose a file to open"),
                                                        openDir,
-                                                       tr("GPX Files (*.gpx)"));
+                                                       tr("GPX Files (*.gpx *.gpxb)"));
     if (newFileName == tr("")) {
         // Cancelled
         return;
     }
 
-    if (gpx) delete gpx;
-
-    gpx = new GpxFile(newFileName, true);
+    // Whatever was open goes away now, and partial copies of the new
+    // file are shown until it's read
+    disableActionsOnClose();
+    showGpx(0);
     curFileName = newFileName;
+    curFileNameLbl->setText(curFileName);
+    curDistanceLbl->setText(tr("0 meters"));
+
+    gpxTree->setEnabled(false);
+    loadProgressBar->setValue(0);
+    loadProgressBar->show();
+    cancelLoadAction->setDisabled(false);
+    statusBar()->showMessage(tr("Loading %1...").arg(newFileName));
 
-    ((GpxTab*)visTabs->currentWidget())->setGpx(gpx);
+    loader->start(newFileName);
+}
 
+void GpxGui::cancelLoad() {
+    loader->cancel();
+}
+
+void GpxGui::loadProgress(int percent) {
+    loadProgressBar->setValue(percent);
+}
+
+void GpxGui::partialLoaded() {
+    GpxFile *partial = loader->takePartial();
+    if (partial == 0 || loader->isCancelled()) {
+        delete partial;
+        return;
+    }
+    showGpx(partial);
+    curDistanceLbl->setText(tr("%1 meters").arg(gpx->length()));
+}
+
+void GpxGui::loadFinished(bool ok) {
+    GpxFile *newGpx = loader->takeFile();
+    if (newGpx == 0) return;
+
+    loadProgressBar->hide();
+    cancelLoadAction->setDisabled(true);
+    gpxTree->setEnabled(true);
+    statusBar()->clearMessage();
+
+    // A cancelled load is dropped even if it finished before it saw the
+    // cancel, since closeFile() has already moved on
+    if (!ok || loader->isCancelled()) {
+        QString what = newGpx->errorString();
+        delete newGpx;
+        showGpx(0);
+        curFileName = tr("");
+        curFileNameLbl->setText(curFileName);
+        if (loader->isCancelled()) {
+            statusBar()->showMessage(tr("Loading cancelled"), 3000);
+        } else {
+            openFileError(what);
+        }
+        return;
+    }
+
+    showGpx(newGpx);
     enableActionsOnOpen();
+    updateUI();
+}
+
+void GpxGui::showGpx(GpxFile *newGpx) {
+    // The views drop their references to the old file before it's deleted
+    gpxTree->setGpxFile(newGpx);
+    for (int i=0; i<visTabs->count(); ++i) {
+        ((GpxTab*)visTabs->widget(i))->setGpx(newGpx);
+    }
+    if (gpx) delete gpx;
+    gpx = newGpx;
+
+    // The history belongs to the file it was recorded on
+    history.clear();
+    updateEditActions();
+}
+
+void GpxGui::recordEdit(const QString &what) {
+    if (gpx == 0) return;
+    history.record(*gpx, what);
+    updateEditActions();
+}
+
+void GpxGui::undo() {
+    if (gpx == 0 || !history.undo(*gpx)) return;
+    gpxEdited();
+}
 
+void GpxGui::redo() {
+    if (gpx == 0 || !history.redo(*gpx)) return;
+    gpxEdited();
+}
+
+void GpxGui::gpxEdited() {
+    // Segments may have come back, so the tree is rebuilt rather than
+    // just recomputed
     gpxTree->setGpxFile(gpx);
+    eleW->gpxChanged();
+    mapW->gpxChanged();
+    updateUI();
+    updateEditActions();
+}
+
+void GpxGui::updateEditActions() {
+    undoAction->setEnabled(history.canUndo());
+    redoAction->setEnabled(history.canRedo());
+    undoAction->setText(history.canUndo() ? tr("&Undo %1").arg(history.undoText()) : tr("&Undo"));
+    redoAction->setText(history.canRedo() ? tr("&Redo %1").arg(history.redoText()) : tr("&Redo"));
 }
 
 void GpxGui::updateUI() {
@@ -210,6 +353,9 @@ void GpxGui::closeFile() {
     if (!canContinue()) {
         return;
     }
+    // Closing while a file is loading stops the load
+    loader->cancel();
+
     disableActionsOnClose();
     setWindowTitle(titleBarPrefix);
 
@@ -217,10 +363,7 @@ void GpxGui::closeFile() {
     curFileNameLbl->setText(curFileName);
     curDistanceLbl->setText(tr("0 meters"));
 
-    if (gpx) delete gpx;
-    gpx = 0;
-    gpxTree->setGpxFile(gpx);
-    ((GpxTab*)visTabs->currentWidget())->setGpx(gpx);
+    showGpx(0);
 }
 
 void GpxGui::about() {
@@ -233,14 +376,7 @@ void GpxGui::about() {
 void GpxGui::saveFile() {
   if (gpx==0) return;
 
-  QString strValue;
-  gpx->toXml(strValue);
-
-  QFile file( curFileName );
-  if (file.open(QIODevice::WriteOnly)) {
-    QTextStream out(&file);
-    out << strValue;
-  }
+  writeFile(curFileName);
 }
 
 void GpxGui::saveAsFile() {
@@ -248,18 +384,40 @@ void GpxGui::saveAsFile() {
   QString newFileName = QFileDialog::getSaveFileName(this,
 						     tr("Choose a file to save to"),
 						     openDir,
-						     tr("GPX Files (*.gpx)"));
+						     tr("GPX Files (*.gpx);;"
+							"Binary Track Files (*.gpxb)"));
   if (newFileName == tr("")) return;
   curFileName = newFileName;
-    
 
-  QString strValue;
-  gpx->toXml(strValue);
+  writeFile(newFileName);
+  updateUI();
+}
 
-  QFile file( newFileName );
-  if (file.open(QIODevice::WriteOnly)) {
-    QTextStream out(&file);
-    out << strValue;
+void GpxGui::writeFile(QString fname) {
+  QFile file( fname );
+  if (!file.open(QIODevice::WriteOnly)) {
+    saveFileError(file.errorString());
+    return;
   }
-  updateUI();
+
+  // The extension picks the format
+  if (fname.endsWith(".gpxb", Qt::CaseInsensitive)) {
+    GpxBinaryWriter writer(&file);
+    if (!writer.write(*gpx)) {
+      saveFileError(writer.errorString());
+    }
+    return;
+  }
+
+  GpxWriter writer(&file);
+  if (!writer.write(*gpx)) {
+    saveFileError(writer.errorString());
+  }
+}
+
+void GpxGui::saveFileError(QString what) {
+    QMessageBox::critical(this, tr("Failed"),
+                          tr("Couldn't save the GPX file:\n%1").arg(what),
+                          QMessageBox::Ok, QMessageBox::NoButton,
+                          QMessageBox::NoButton);
 }
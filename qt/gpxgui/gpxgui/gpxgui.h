@@ -19,17 +19,22 @@
 
 #include <QMainWindow>
 
+#include "gpxedithistory.h"
+
 class QToolBar;
 class QMenu;
 class QAction;
 class QLabel;
 class QSplitter;
+class QProgressBar;
 
 
 class GpxTreeWidget;
 class QSvgWidget;
 class GpxFile;
 class ElevationWidget;
+class MapWidget;
+class GpxLoader;
 
 class GpxGui : public QMainWindow {
     Q_OBJECT;
@@ -46,8 +51,19 @@ public slots:
     void saveFile();
     void saveAsFile();
     void closeFile();
+    void cancelLoad();
+    void undo();
+    void redo();
     void about();
 
+private slots:
+    void loadProgress(int percent);
+    void partialLoaded();
+    void loadFinished(bool ok);
+
+    // Remember the file before the tree widget changes it
+    void recordEdit(const QString &what);
+
 private:
     void readSettings();
     void setupActions();
@@ -70,6 +86,10 @@ private:
 
     void openFileError(QString what);
 
+    // Stream gpx to fname
+    void writeFile(QString fname);
+    void saveFileError(QString what);
+
     void disableActionsOnClose();
     void enableActionsOnOpen();
     void notYetImplemented();
@@ -80,17 +100,30 @@ private:
 
     void updateUI();
 
+    // Show gpx in the tree and tabs, replacing the current file
+    void showGpx(GpxFile *newGpx);
+
+    // Redraw everything after the file was changed in place
+    void gpxEdited();
+
+    // Enable and name the undo and redo actions from the history
+    void updateEditActions();
+
     QString openDir;
     QString curFileName;
     QString titleBarPrefix;
   
     QLabel *curDistanceLbl;
     QLabel *curFileNameLbl;
+    QProgressBar *loadProgressBar;
   
     QAction *openAction;
     QAction *saveAction;
     QAction *saveAsAction;
     QAction *closeAction;
+    QAction *cancelLoadAction;
+    QAction *undoAction;
+    QAction *redoAction;
     QAction *exitAction;
     QAction *aboutAction;
     QAction *configAction;
@@ -99,10 +132,17 @@ private:
 
     GpxFile *gpx;
 
+    // Undo and redo for changes made in the tree widget
+    GpxEditHistory history;
+
+    // Reads files on another thread
+    GpxLoader *loader;
+
     GpxTreeWidget *gpxTree;
 
     QTabWidget *visTabs;
     ElevationWidget *eleW;
+    MapWidget *mapW;
 };
 
 #endif
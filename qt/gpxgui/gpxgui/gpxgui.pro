@@ -10,10 +10,12 @@ LIBS += -lGeographic -lqtgpxlib
 QMAKE_LFLAGS += -L../qtgpxlib
 
 # Input
-HEADERS += gpxgui.h gpxtreewidget.h unitconversion.h gpxtab.h elevationwidget.h utils.h
+HEADERS += gpxgui.h gpxtreewidget.h unitconversion.h gpxtab.h elevationwidget.h utils.h \
+           gpxloader.h mapwidget.h
 
 SOURCES += main.cpp \
-           gpxgui.cpp gpxtreewidget.cpp unitconversion.cpp gpxtab.cpp elevationwidget.cpp utils.cpp
+           gpxgui.cpp gpxtreewidget.cpp unitconversion.cpp gpxtab.cpp elevationwidget.cpp utils.cpp \
+           gpxloader.cpp mapwidget.cpp
 
 RESOURCES += gpxgui.qrc
 
@@ -0,0 +1,118 @@
+// gpxloader.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gpxloader.h"
+
+#include <QtConcurrentRun>
+#include <QMutexLocker>
+
+GpxLoader::GpxLoader(QObject *parent) : QObject(parent), file(0), partial(0) {
+    connect(&watcher, SIGNAL(finished()),
+            this, SLOT(loadFinished()));
+}
+
+GpxLoader::~GpxLoader() {
+    cancel();
+    watcher.waitForFinished();
+    delete file;
+    delete partial;
+}
+
+void GpxLoader::start(QString name) {
+    cancel();
+    watcher.waitForFinished();
+
+    delete file;
+    delete takePartial();
+
+    reset();
+    fname = name;
+    file = new GpxFile;
+    sincePartial.start();
+    watcher.setFuture(QtConcurrent::run(loadFile, file, fname, this));
+}
+
+bool GpxLoader::isRunning() const {
+    return watcher.isRunning();
+}
+
+bool GpxLoader::loadFile(GpxFile *gpx, QString fname, GpxLoader *loader) {
+    if (!gpx->load(fname, true, GpxFile::MappedReader, loader)) {
+        return false;
+    }
+    // Fill in the statistics here rather than on the GUI thread
+    gpx->length();
+    gpx->maxSpeed();
+    return true;
+}
+
+void GpxLoader::progress(qint64 done, qint64 total, GpxFile &gpx) {
+    if (total > 0) {
+        emit progressChanged(int(done*100/total));
+    }
+    if (sincePartial.elapsed() < PartialInterval) return;
+    sincePartial.restart();
+
+    // Copies share their points with the reader's segments, so this only
+    // costs a copy of the segment being read once the reader adds to it
+    GpxFile *copy = new GpxFile;
+    copy->setTime(gpx.time());
+    for (int i=0; i<gpx.segmentCount(); ++i) {
+        if (gpx.at(i).pointCount() > 0) {
+            copy->addTrack(gpx.at(i));
+        }
+    }
+
+    QMutexLocker lock(&partialLock);
+    delete partial;
+    partial = copy;
+    lock.unlock();
+
+    emit partialReady();
+}
+
+void GpxLoader::loadFinished() {
+    // Left over from a load that was replaced by another
+    if (watcher.isRunning()) return;
+
+    bool ok = watcher.result();
+    delete takePartial();
+    emit finished(ok);
+}
+
+GpxFile *GpxLoader::takeFile() {
+    if (isRunning()) return 0;
+    GpxFile *rv = file;
+    file = 0;
+    return rv;
+}
+
+GpxFile *GpxLoader::takePartial() {
+    QMutexLocker lock(&partialLock);
+    GpxFile *rv = partial;
+    partial = 0;
+    return rv;
+}
+
+QString GpxLoader::fileName() const {
+    return fname;
+}
+
+QString GpxLoader::errorString() const {
+    if (file == 0 || isRunning()) return QString();
+    return file->errorString();
+}
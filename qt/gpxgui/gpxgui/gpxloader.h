@@ -0,0 +1,86 @@
+// gpxloader.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef GPX_LOADER_H
+#define GPX_LOADER_H
+
+#include <QObject>
+#include <QString>
+#include <QMutex>
+#include <QTime>
+#include <QFutureWatcher>
+
+#include "gpxfile.h"
+
+// Loads a GpxFile on the global thread pool so the GUI stays responsive.
+// Progress, and every so often a copy of what's been read so far, are
+// passed back to the GUI thread through signals.
+class GpxLoader : public QObject, public GpxLoadProgress {
+    Q_OBJECT;
+public:
+    GpxLoader(QObject *parent = 0);
+
+    // Cancels any load in progress and waits for it
+    ~GpxLoader();
+
+    // Start loading fname, cancelling the previous load if there is one
+    void start(QString fname);
+    bool isRunning() const;
+
+    // The loaded file, once finished() has been emitted.
+    // The caller owns it.
+    GpxFile *takeFile();
+
+    // The newest partial copy, or 0 if there isn't a new one.
+    // The caller owns it.
+    GpxFile *takePartial();
+
+    QString fileName() const;
+    QString errorString() const;
+
+signals:
+    void progressChanged(int percent);
+    void partialReady();
+    // ok can be true after cancel() if the load was already done, so
+    // check isCancelled() as well
+    void finished(bool ok);
+
+protected:
+    // Called on the loading thread
+    void progress(qint64 done, qint64 total, GpxFile &gpx);
+
+private slots:
+    void loadFinished();
+
+private:
+    // Milliseconds between partial copies
+    enum { PartialInterval = 1000 };
+
+    static bool loadFile(GpxFile *gpx, QString fname, GpxLoader *loader);
+
+    QString fname;
+    GpxFile *file;
+    QFutureWatcher<bool> watcher;
+
+    // Only used on the loading thread
+    QTime sincePartial;
+
+    QMutex partialLock;
+    GpxFile *partial;
+};
+
+#endif
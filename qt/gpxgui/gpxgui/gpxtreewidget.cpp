@@ -21,6 +21,7 @@
 
 #include "gpxfile.h"
 #include "gpxtracksegment.h"
+#include "gpxwriter.h"
 
 #include "unitconversion.h"
 
@@ -125,6 +126,7 @@ void GpxTreeWidget::mergeTracks() {
         toMerge.push_back(tracks[i]->text(1));
         delete tracks[i];
     }
+    emit gpxAboutToChange(tr("Merge Tracks"));
     _gpx->mergeTracksByName(toMerge);
     recompute();
     emit gpxChanged();
@@ -143,6 +145,7 @@ void GpxTreeWidget::removeTracks() {
         toRemove.push_back(tracks[i]->text(1));
         delete tracks[i];
     }
+    emit gpxAboutToChange(tr("Remove Tracks"));
     _gpx->removeTracksByName(toRemove);
     recompute();
     emit gpxChanged();
@@ -162,16 +165,24 @@ void GpxTreeWidget::splitTrack() {
                                                        tr("GPX Files (*.gpx)"));
     if (newFileName == tr("")) return;
     GpxTrackSegment s = _gpx->segmentByName(selectedItems()[0]->text(1));
-    GpxFile *newGpx = new GpxFile(s);
-    QString strValue;
-    newGpx->toXml(strValue);
+    GpxFile newGpx(s);
 
     QFile file( newFileName );
-    if (file.open(QIODevice::WriteOnly)) {
-        QTextStream out(&file);
-        out << strValue;
+    if (!file.open(QIODevice::WriteOnly)) {
+        saveFileError(newFileName, file.errorString());
+        return;
     }
-    delete newGpx;
+    GpxWriter writer(&file);
+    if (!writer.write(newGpx)) {
+        saveFileError(newFileName, writer.errorString());
+    }
+}
+
+void GpxTreeWidget::saveFileError(QString fname, QString what) {
+    QMessageBox::critical(this, tr("Failed"),
+                          tr("Couldn't save the track to %1:\n%2").arg(fname).arg(what),
+                          QMessageBox::Ok, QMessageBox::NoButton,
+                          QMessageBox::NoButton);
 }
 
 void GpxTreeWidget::recompute() {
@@ -188,7 +199,7 @@ void GpxTreeWidget::recompute() {
         for (int i=0; i<_gpx->segmentCount(); ++i) {
             track = itemBelow(track);
             if (track == 0) return;
-            GpxTrackSegment cur = (*_gpx)[i];
+            GpxTrackSegment &cur = (*_gpx)[i];
             track->setText(0, tr("Track %1").arg(cur.number()));
 
             track->setText(1, tr("%1").arg(cur.name()));
@@ -39,6 +39,8 @@ public slots:
     void splitTrack();
 
        signals:
+    // Emitted before the file is changed, with a description of the change
+    void gpxAboutToChange(const QString &what);
     void gpxChanged();
 
 protected:
@@ -55,6 +57,7 @@ private:
 
     void buildTree();
     void recompute();
+    void saveFileError(QString fname, QString what);
 
     QTreeWidgetItem *root;
     QTreeWidgetItem *children;
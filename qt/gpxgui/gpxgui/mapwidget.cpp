@@ -0,0 +1,322 @@
+// mapwidget.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "mapwidget.h"
+#include "utils.h"
+
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
+
+#include <cmath>
+
+namespace {
+
+const double Pi = 3.14159265358979323846;
+
+// Pen width in pixels
+const double LineWidth = 2.0;
+
+quint64 tileKey(int zoom, int tx, int ty) {
+    return (quint64(zoom) << 56) | (quint64(quint32(tx) & 0xfffffff) << 28) |
+        quint64(quint32(ty) & 0xfffffff);
+}
+
+}
+
+struct MapWidget::Tile {
+    const QList<GpxQuadtree> *trees;
+    const QList<QColor> *colors;
+    double originX, originY, scale;
+    int tx, ty;
+    QImage image;
+};
+
+MapWidget::MapWidget(QWidget *parent) : GpxTab(parent), _gpx(0), cosLat(0.0), buildPending(false),
+                                        buildDiscard(false), originX(0.0), originY(0.0),
+                                        baseScale(1.0), zoom(0), viewX(0.0), viewY(0.0),
+                                        moved(false), dragging(false), tiles(MaxCachedTiles) {
+    connect(&buildWatcher, SIGNAL(finished()),
+            this, SLOT(buildFinished()));
+}
+
+MapWidget::~MapWidget() {
+    buildWatcher.waitForFinished();
+}
+
+void MapWidget::setGpx(GpxFile *gpx) {
+    this->_gpx = gpx;
+    if (gpx == 0) {
+        // Whatever is being built belongs to the old file
+        buildDiscard = buildWatcher.isRunning();
+        buildPending = false;
+        trees.clear();
+        columns.clear();
+        tiles.clear();
+        cosLat = 0.0;
+        moved = false;
+        update();
+        return;
+    }
+    // The trees are kept, so the partial copies shown while a file
+    // loads only rebuild the segments that changed
+    startBuild();
+}
+
+void MapWidget::gpxChanged() {
+    startBuild();
+}
+
+void MapWidget::startBuild() {
+    if (_gpx == 0) return;
+
+    if (buildWatcher.isRunning()) {
+        buildPending = true;
+        return;
+    }
+
+    QList<GpxTrackSegment> segments;
+    QList<QVector<double> > newColumns;
+    QVector<bool> keep;
+    for (int i=0; i<_gpx->segmentCount(); ++i) {
+        const GpxTrackSegment &seg = _gpx->at(i);
+        if (cosLat == 0.0 && seg.pointCount() > 0) {
+            cosLat = std::max(std::cos(seg.latitudes()[0] * Pi / 180), 0.01);
+        }
+        segments.push_back(seg);
+        newColumns.push_back(seg.elevationColumn());
+        keep.push_back(i < columns.size() && columns[i].constData() == seg.elevations() &&
+                       columns[i].size() == seg.pointCount());
+    }
+    columns = newColumns;
+    while (colors.size() < segments.size()) {
+        colors.push_back(randColor());
+    }
+
+    // Segments and trees share their data, so the copies made for the
+    // other thread are cheap
+    buildWatcher.setFuture(QtConcurrent::run(buildTrees, segments, trees, keep, cosLat));
+}
+
+QList<GpxQuadtree> MapWidget::buildTrees(QList<GpxTrackSegment> segments,
+                                         QList<GpxQuadtree> trees, QVector<bool> keep,
+                                         double cosLat) {
+    while (trees.size() > segments.size()) {
+        trees.removeLast();
+    }
+    for (int i=0; i<segments.size(); ++i) {
+        const GpxTrackSegment &seg = segments[i];
+        int n = seg.pointCount();
+        if (i < trees.size() && keep[i]) continue;
+
+        QVector<double> x(n);
+        const double *lon = seg.longitudes();
+        for (int j=0; j<n; ++j) {
+            x[j] = lon[j] * cosLat;
+        }
+        GpxQuadtree tree;
+        tree.build(x.constData(), seg.latitudes(), n);
+        if (i < trees.size()) {
+            trees[i] = tree;
+        } else {
+            trees.push_back(tree);
+        }
+    }
+    return trees;
+}
+
+void MapWidget::buildFinished() {
+    if (buildDiscard) {
+        buildDiscard = false;
+        buildPending = false;
+        startBuild();
+        return;
+    }
+
+    trees = buildWatcher.result();
+    tiles.clear();
+    if (!moved) {
+        fitView();
+    }
+    if (buildPending) {
+        buildPending = false;
+        startBuild();
+    }
+    update();
+}
+
+void MapWidget::fitView() {
+    bool first = true;
+    double minX = 0.0, minY = 0.0, maxX = 0.0, maxY = 0.0;
+    for (int i=0; i<trees.size(); ++i) {
+        if (trees[i].isEmpty()) continue;
+        double x0, y0, x1, y1;
+        trees[i].bounds(x0, y0, x1, y1);
+        if (first || x0 < minX) minX = x0;
+        if (first || y0 < minY) minY = y0;
+        if (first || x1 > maxX) maxX = x1;
+        if (first || y1 > maxY) maxY = y1;
+        first = false;
+    }
+    if (first || width() <= 0 || height() <= 0) return;
+
+    // A 5% border, and a track that's a single point is shown as if it
+    // were about a metre across
+    double w = std::max(maxX-minX, 1e-5);
+    double h = std::max(maxY-minY, 1e-5);
+    baseScale = std::min(0.9*width()/w, 0.9*height()/h);
+    originX = minX;
+    originY = maxY;
+    zoom = 0;
+    viewX = std::floor(((maxX-minX)*baseScale - width()) / 2);
+    viewY = std::floor(((maxY-minY)*baseScale - height()) / 2);
+    tiles.clear();
+}
+
+double MapWidget::scale() const {
+    return std::ldexp(baseScale, zoom);
+}
+
+void MapWidget::zoomBy(int steps, const QPoint &pos) {
+    int newZoom = qBound(int(MinZoom), zoom+steps, int(MaxZoom));
+    if (newZoom == zoom) return;
+
+    double f = std::ldexp(1.0, newZoom-zoom);
+    viewX = std::floor((viewX + pos.x()) * f - pos.x() + 0.5);
+    viewY = std::floor((viewY + pos.y()) * f - pos.y() + 0.5);
+    zoom = newZoom;
+    moved = true;
+    update();
+}
+
+void MapWidget::paintEvent(QPaintEvent *event) {
+    if (trees.isEmpty()) return;
+
+    QRect area = event->rect();
+    int tx0 = int(std::floor((viewX + area.left()) / TileSize));
+    int tx1 = int(std::floor((viewX + area.right()) / TileSize));
+    int ty0 = int(std::floor((viewY + area.top()) / TileSize));
+    int ty1 = int(std::floor((viewY + area.bottom()) / TileSize));
+
+    QPainter p(this);
+    QVector<Tile> missing;
+    for (int ty=ty0; ty<=ty1; ++ty) {
+        for (int tx=tx0; tx<=tx1; ++tx) {
+            QImage *image = tiles.object(tileKey(zoom-MinZoom, tx, ty));
+            if (image) {
+                p.drawImage(QPointF(tx*TileSize - viewX, ty*TileSize - viewY), *image);
+                continue;
+            }
+            Tile tile;
+            tile.trees = &trees;
+            tile.colors = &colors;
+            tile.originX = originX;
+            tile.originY = originY;
+            tile.scale = scale();
+            tile.tx = tx;
+            tile.ty = ty;
+            missing.push_back(tile);
+        }
+    }
+
+    // Usually just the row or column panned into view
+    QtConcurrent::blockingMap(missing, renderTile);
+    for (int i=0; i<missing.size(); ++i) {
+        const Tile &tile = missing[i];
+        p.drawImage(QPointF(tile.tx*TileSize - viewX, tile.ty*TileSize - viewY), tile.image);
+        tiles.insert(tileKey(zoom-MinZoom, tile.tx, tile.ty), new QImage(tile.image));
+    }
+}
+
+void MapWidget::renderTile(Tile &tile) {
+    tile.image = QImage(TileSize, TileSize, QImage::Format_ARGB32_Premultiplied);
+    tile.image.fill(0);
+
+    // The tile's corner in projected degrees, and enough around it for
+    // lines just outside to show their edge
+    double left = tile.originX + tile.tx*TileSize / tile.scale;
+    double top = tile.originY - tile.ty*TileSize / tile.scale;
+    double margin = LineWidth / tile.scale;
+    double minX = left - margin;
+    double maxX = left + TileSize / tile.scale + margin;
+    double minY = top - TileSize / tile.scale - margin;
+    double maxY = top + margin;
+
+    QPainter p(&tile.image);
+    p.setRenderHint(QPainter::Antialiasing);
+
+    QVector<int> points, runs;
+    QPolygonF line;
+    for (int i=0; i<tile.trees->size(); ++i) {
+        const GpxQuadtree &tree = (*tile.trees)[i];
+        tree.query(minX, minY, maxX, maxY, 0.5 / tile.scale, points, runs);
+        if (points.isEmpty()) continue;
+
+        p.setPen(QPen((*tile.colors)[i], LineWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+        const double *x = tree.x();
+        const double *y = tree.y();
+        for (int r=0; r+1<runs.size(); ++r) {
+            line.clear();
+            for (int j=runs[r]; j<runs[r+1]; ++j) {
+                line << QPointF((x[points[j]] - left) * tile.scale,
+                                (top - y[points[j]]) * tile.scale);
+            }
+            if (line.size() == 1) {
+                p.drawPoint(line[0]);
+            } else {
+                p.drawPolyline(line);
+            }
+        }
+    }
+}
+
+void MapWidget::resizeEvent(QResizeEvent *event) {
+    if (!moved) {
+        fitView();
+    }
+}
+
+void MapWidget::mousePressEvent(QMouseEvent *event) {
+    if (event->button() == Qt::LeftButton) {
+        dragging = true;
+        lastPos = event->pos();
+    }
+}
+
+void MapWidget::mouseMoveEvent(QMouseEvent *event) {
+    if (!dragging) return;
+
+    QPoint delta = event->pos() - lastPos;
+    lastPos = event->pos();
+    viewX -= delta.x();
+    viewY -= delta.y();
+    moved = true;
+    update();
+}
+
+void MapWidget::mouseReleaseEvent(QMouseEvent *event) {
+    if (event->button() == Qt::LeftButton) {
+        dragging = false;
+    }
+}
+
+void MapWidget::wheelEvent(QWheelEvent *event) {
+    // One level per notch of a normal wheel
+    int steps = event->delta() / 120;
+    if (steps != 0) {
+        zoomBy(steps, event->pos());
+    }
+}
@@ -0,0 +1,123 @@
+// mapwidget.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <QtGui>
+#include <QWidget>
+#include <QImage>
+#include <QCache>
+#include <QFutureWatcher>
+
+#include "gpxtab.h"
+#include "gpxquadtree.h"
+
+// Plan view of the tracks, panned by dragging and zoomed by the wheel.
+//
+// Longitude is scaled by the cosine of the track's latitude so shapes
+// look right near the track.  The view is drawn in square tiles at whole
+// zoom levels, each twice the scale of the last, and tiles are kept
+// between frames, so panning only draws the tiles coming into view.
+// Tiles are drawn from a GpxQuadtree per segment, which only hands over
+// the points near the tile at about a pixel's detail.
+class MapWidget : public GpxTab {
+    Q_OBJECT;
+public:
+    MapWidget(QWidget *parent = 0);
+    ~MapWidget();
+    void setGpx(GpxFile *gpx);
+
+public slots:
+    void gpxChanged();
+
+protected:
+    void paintEvent(QPaintEvent *event);
+    void resizeEvent(QResizeEvent *event);
+    void mousePressEvent(QMouseEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
+    void wheelEvent(QWheelEvent *event);
+
+private slots:
+    void buildFinished();
+
+private:
+    enum { TileSize = 256 };
+
+    // Tiles kept between frames, about 64MB
+    enum { MaxCachedTiles = 256 };
+
+    enum { MinZoom = -4, MaxZoom = 20 };
+
+    struct Tile;
+    static void renderTile(Tile &tile);
+
+    // Bring the quadtrees up to date with the file's segments in the
+    // background
+    void startBuild();
+
+    // Segments are matched by position, and ones marked in keep are
+    // unchanged and keep their tree.  Only uses its arguments, so it can
+    // run on any thread.
+    static QList<GpxQuadtree> buildTrees(QList<GpxTrackSegment> segments,
+                                         QList<GpxQuadtree> trees, QVector<bool> keep,
+                                         double cosLat);
+
+    // Show every track, until the user pans or zooms
+    void fitView();
+
+    // Pixels per projected degree at the current zoom
+    double scale() const;
+
+    // Zoom by steps levels keeping the point under pos still
+    void zoomBy(int steps, const QPoint &pos);
+
+    GpxFile *_gpx;
+    QList<QColor> colors;
+
+    // Scales longitude in the projection, or 0 until there are points
+    double cosLat;
+
+    QList<GpxQuadtree> trees;
+
+    // Elevations of each segment as of the last build.  Holding them
+    // keeps them shared, so a segment whose points have changed since
+    // has a different column.
+    QList<QVector<double> > columns;
+    QFutureWatcher<QList<GpxQuadtree> > buildWatcher;
+
+    // Something changed while a build was running
+    bool buildPending;
+
+    // The file was closed while a build was running
+    bool buildDiscard;
+
+    // The projected point at pixel 0, 0 of every zoom level's tiles,
+    // and the scale at zoom 0
+    double originX, originY, baseScale;
+
+    // Zoom level, and where the widget's top left corner is in its
+    // pixels
+    int zoom;
+    double viewX, viewY;
+
+    // The user has moved the view, so it's no longer refitted
+    bool moved;
+    bool dragging;
+    QPoint lastPos;
+
+    // Finished tiles by zoom and position
+    QCache<quint64, QImage> tiles;
+};
@@ -0,0 +1,13 @@
+TEMPLATE = app
+TARGET = gpxrender
+CONFIG += console
+CONFIG -= app_bundle
+QT += xml
+
+INCLUDEPATH += . ../qtgpxlib
+
+LIBS += -lGeographic -lqtgpxlib
+
+QMAKE_LFLAGS += -L../qtgpxlib
+
+SOURCES += main.cpp
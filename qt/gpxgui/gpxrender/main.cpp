@@ -0,0 +1,143 @@
+// main.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+
+// Draws a set of GPX files into one PNG overview, coloured by speed,
+// elevation or time.  Files are read in parallel and drawn on every
+// core, without needing a display.  A directory stands for every track
+// file under it.
+
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QImage>
+#include <QMap>
+#include <QStringList>
+#include <QVector>
+
+#include <cstdio>
+
+#include "gpxbatchloader.h"
+#include "gpxrenderer.h"
+
+namespace {
+
+void usage() {
+    fprintf(stderr, "Usage: gpxrender [-s WIDTHxHEIGHT] [-c speed|elevation|time] [-w pixels] output.png file-or-directory...\n"
+                    "  -s  image size, 2048x2048 by default\n"
+                    "  -c  what the colour shows, speed by default\n"
+                    "  -w  line width, 2 by default\n");
+}
+
+}
+
+int main(int argc, char **argv) {
+    QCoreApplication app(argc, argv);
+
+    int width = 2048, height = 2048;
+    GpxRenderer::ColorBy colorBy = GpxRenderer::SpeedColor;
+    double lineWidth = 2.0;
+    QString output;
+    QStringList files;
+
+    QStringList args = app.arguments();
+    for (int i=1; i<args.size(); ++i) {
+        if ((args[i] == "-s" || args[i] == "-c" || args[i] == "-w") && i+1 < args.size()) {
+            QString opt = args[i];
+            QString value = args[++i];
+            bool ok = true;
+            if (opt == "-s") {
+                QStringList size = value.split('x');
+                ok = size.size() == 2;
+                if (ok) {
+                    bool wok = false, hok = false;
+                    width = size[0].toInt(&wok);
+                    height = size[1].toInt(&hok);
+                    ok = wok && hok && width > 0 && height > 0;
+                }
+            } else if (opt == "-c") {
+                if (value == "speed") {
+                    colorBy = GpxRenderer::SpeedColor;
+                } else if (value == "elevation") {
+                    colorBy = GpxRenderer::ElevationColor;
+                } else if (value == "time") {
+                    colorBy = GpxRenderer::TimeColor;
+                } else {
+                    ok = false;
+                }
+            } else {
+                lineWidth = value.toDouble(&ok);
+                ok = ok && lineWidth > 0.0;
+            }
+            if (!ok) {
+                usage();
+                return 1;
+            }
+        } else if (args[i].startsWith("-")) {
+            usage();
+            return 1;
+        } else if (output.isEmpty()) {
+            output = args[i];
+        } else if (QFileInfo(args[i]).isDir()) {
+            files += GpxBatchLoader::findFiles(args[i]);
+        } else {
+            files << args[i];
+        }
+    }
+    if (files.isEmpty()) {
+        usage();
+        return 1;
+    }
+
+    GpxRenderer renderer(colorBy);
+    renderer.setLineWidth(lineWidth);
+
+    // Files are added in the order given, so overlapping tracks are
+    // drawn the same way every run.  Ones that finish early wait until
+    // the files before them are in, and each is dropped once its points
+    // have been copied.
+    int failed = 0;
+    QMap<int, GpxFile> waiting;
+    QVector<bool> finished(files.size(), false);
+    int nextFile = 0;
+    GpxBatchLoader loader(files);
+    GpxBatchResult result;
+    while (loader.next(result)) {
+        finished[result.index] = true;
+        if (result.ok) {
+            waiting.insert(result.index, result.gpx);
+        } else {
+            fprintf(stderr, "%s: %s\n", result.fileName.toLocal8Bit().constData(),
+                    result.error.toLocal8Bit().constData());
+            ++failed;
+        }
+        result.gpx = GpxFile();
+
+        for (; nextFile < files.size() && finished[nextFile]; ++nextFile) {
+            if (waiting.contains(nextFile)) {
+                renderer.addFile(waiting[nextFile]);
+                waiting.remove(nextFile);
+            }
+        }
+    }
+
+    QImage image = renderer.render(width, height);
+    if (!image.save(output, "PNG")) {
+        fprintf(stderr, "Can't write %s\n", output.toLocal8Bit().constData());
+        return 1;
+    }
+    return failed > 0 ? 2 : 0;
+}
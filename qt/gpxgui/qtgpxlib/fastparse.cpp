@@ -0,0 +1,410 @@
+// fastparse.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "fastparse.h"
+
+#include <QByteArray>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+// Powers of ten that are exactly representable as doubles
+const double exactPowers[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+template <typename C>
+inline bool isSpace(C c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+template <typename C>
+inline bool isDigit(C c) {
+    return c >= '0' && c <= '9';
+}
+
+template <typename C>
+void trim(const C *&begin, const C *&end) {
+    while (begin < end && isSpace(*begin)) ++begin;
+    while (end > begin && isSpace(*(end-1))) --end;
+}
+
+// Slow path for numbers the fast path can't convert exactly
+template <typename C>
+bool slowParseDouble(const C *begin, const C *end, double &value) {
+    QByteArray buf;
+    buf.reserve(end-begin);
+    for (const C *p = begin; p < end; ++p) {
+        if (*p > 127) return false;
+        buf.append(char(*p));
+    }
+    bool ok = false;
+    double v = buf.toDouble(&ok);
+    if (ok) value = v;
+    return ok;
+}
+
+template <typename C>
+bool parseDoubleT(const C *begin, const C *end, double &value) {
+    trim(begin, end);
+
+    const C *p = begin;
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        ++p;
+    }
+
+    // Accumulate up to 19 significant digits in an integer
+    quint64 mant = 0;
+    int sigDigits = 0;
+    int exp10 = 0;
+    bool anyDigits = false;
+
+    for (; p < end && isDigit(*p); ++p) {
+        anyDigits = true;
+        if (sigDigits < 19) {
+            mant = mant*10 + (*p - '0');
+            if (mant) ++sigDigits;
+        } else {
+            ++sigDigits;
+            ++exp10;
+        }
+    }
+    if (p < end && *p == '.') {
+        ++p;
+        for (; p < end && isDigit(*p); ++p) {
+            anyDigits = true;
+            if (sigDigits < 19) {
+                mant = mant*10 + (*p - '0');
+                if (mant) ++sigDigits;
+                --exp10;
+            } else {
+                ++sigDigits;
+            }
+        }
+    }
+    if (!anyDigits) return false;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool eneg = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            eneg = (*p == '-');
+            ++p;
+        }
+        if (p == end || !isDigit(*p)) return false;
+        int e = 0;
+        for (; p < end && isDigit(*p); ++p) {
+            if (e < 10000) e = e*10 + (*p - '0');
+        }
+        exp10 += eneg ? -e : e;
+    }
+    if (p != end) return false;
+
+    // Both mant and 10^|exp10| are exact doubles here, so a single
+    // correctly rounded multiply or divide gives the correct result.
+    if (sigDigits <= 15 && exp10 >= -22 && exp10 <= 22) {
+        double v = double(mant);
+        if (exp10 < 0) {
+            v /= exactPowers[-exp10];
+        } else {
+            v *= exactPowers[exp10];
+        }
+        value = neg ? -v : v;
+        return true;
+    }
+    return slowParseDouble(begin, end, value);
+}
+
+template <typename C>
+bool parseIntT(const C *begin, const C *end, int &value) {
+    trim(begin, end);
+
+    const C *p = begin;
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        ++p;
+    }
+    if (p == end) return false;
+
+    qint64 v = 0;
+    for (; p < end; ++p) {
+        if (!isDigit(*p)) return false;
+        v = v*10 + (*p - '0');
+        if (v > Q_INT64_C(2147483648)) return false;
+    }
+    if (neg) v = -v;
+    if (v > 2147483647) return false;
+    value = int(v);
+    return true;
+}
+
+// Read n decimal digits, or return -1
+template <typename C>
+inline int readDigits(const C *p, int n) {
+    int v = 0;
+    for (int i=0; i<n; ++i) {
+        if (!isDigit(p[i])) return -1;
+        v = v*10 + (p[i] - '0');
+    }
+    return v;
+}
+
+// Days since 1970-01-01 in the proleptic Gregorian calendar
+qint64 daysFromCivil(qint64 y, int m, int d) {
+    y -= m <= 2;
+    qint64 era = (y >= 0 ? y : y-399) / 400;
+    qint64 yoe = y - era * 400;
+    qint64 doy = (153*(m + (m > 2 ? -3 : 9)) + 2)/5 + d-1;
+    qint64 doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+void civilFromDays(qint64 z, qint64 &y, int &m, int &d) {
+    z += 719468;
+    qint64 era = (z >= 0 ? z : z - 146096) / 146097;
+    qint64 doe = z - era * 146097;
+    qint64 yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+    qint64 doy = doe - (365*yoe + yoe/4 - yoe/100);
+    qint64 mp = (5*doy + 2)/153;
+    d = int(doy - (153*mp+2)/5 + 1);
+    m = int(mp < 10 ? mp+3 : mp-9);
+    y = yoe + era * 400 + (m <= 2);
+}
+
+int daysInMonth(qint64 y, int m) {
+    static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if (m == 2 && (y % 4 == 0) && (y % 100 != 0 || y % 400 == 0)) return 29;
+    return days[m-1];
+}
+
+template <typename C>
+bool parseIsoTimeT(const C *begin, const C *end, qint64 &msecs) {
+    trim(begin, end);
+    if (end-begin < 19) return false;
+
+    const C *p = begin;
+    if (p[4] != '-' || p[7] != '-' || (p[10] != 'T' && p[10] != 't' && p[10] != ' ') ||
+        p[13] != ':' || p[16] != ':') {
+        return false;
+    }
+
+    int year = readDigits(p, 4);
+    int mon = readDigits(p+5, 2);
+    int day = readDigits(p+8, 2);
+    int hour = readDigits(p+11, 2);
+    int min = readDigits(p+14, 2);
+    int sec = readDigits(p+17, 2);
+
+    if (year < 0 || mon < 1 || mon > 12 || day < 1 || day > daysInMonth(year, mon) ||
+        hour < 0 || hour > 23 || min < 0 || min > 59 || sec < 0 || sec > 59) {
+        return false;
+    }
+    p += 19;
+
+    int ms = 0;
+    if (p < end && (*p == '.' || *p == ',')) {
+        ++p;
+        if (p == end || !isDigit(*p)) return false;
+        for (int scale = 100; p < end && isDigit(*p); ++p, scale /= 10) {
+            ms += (*p - '0') * scale;
+        }
+    }
+
+    int offset = 0;
+    if (p < end && (*p == 'Z' || *p == 'z')) {
+        ++p;
+    } else if (p < end && (*p == '+' || *p == '-')) {
+        int sign = (*p == '-') ? -1 : 1;
+        ++p;
+        if (end-p < 2) return false;
+        int oh = readDigits(p, 2);
+        p += 2;
+        if (p < end && *p == ':') ++p;
+        int om = 0;
+        if (p < end) {
+            if (end-p < 2) return false;
+            om = readDigits(p, 2);
+            p += 2;
+        }
+        if (oh < 0 || om < 0) return false;
+        offset = sign * (oh*3600 + om*60);
+    }
+    if (p != end) return false;
+
+    qint64 secs = daysFromCivil(year, mon, day)*86400 + hour*3600 + min*60 + sec - offset;
+    msecs = secs*1000 + ms;
+    return true;
+}
+
+}
+
+bool parseDouble(const char *begin, const char *end, double &value) {
+    return parseDoubleT(begin, end, value);
+}
+bool parseDouble(const ushort *begin, const ushort *end, double &value) {
+    return parseDoubleT(begin, end, value);
+}
+
+bool parseInt(const char *begin, const char *end, int &value) {
+    return parseIntT(begin, end, value);
+}
+bool parseInt(const ushort *begin, const ushort *end, int &value) {
+    return parseIntT(begin, end, value);
+}
+
+bool parseIsoTime(const char *begin, const char *end, qint64 &msecs) {
+    return parseIsoTimeT(begin, end, msecs);
+}
+bool parseIsoTime(const ushort *begin, const ushort *end, qint64 &msecs) {
+    return parseIsoTimeT(begin, end, msecs);
+}
+
+int formatIsoTime(qint64 msecs, char *buf) {
+    // Floor division so times before 1970 come out right
+    qint64 secs = msecs / 1000;
+    int ms = int(msecs % 1000);
+    if (ms < 0) {
+        ms += 1000;
+        --secs;
+    }
+    qint64 days = secs / 86400;
+    int sod = int(secs % 86400);
+    if (sod < 0) {
+        sod += 86400;
+        --days;
+    }
+
+    qint64 year;
+    int mon, day;
+    civilFromDays(days, year, mon, day);
+
+    int fields[] = { int(year), mon, day, sod/3600, (sod/60)%60, sod%60 };
+    const int widths[] = { 4, 2, 2, 2, 2, 2 };
+    const char seps[] = { '-', '-', 'T', ':', ':', 0 };
+
+    char *p = buf;
+    if (year < 0 || year > 9999) {
+        // Outside what the fixed format can hold; clamp to stay valid
+        fields[0] = year < 0 ? 0 : 9999;
+    }
+    for (int i=0; i<6; ++i) {
+        for (int w=widths[i]-1; w>=0; --w) {
+            p[w] = char('0' + fields[i]%10);
+            fields[i] /= 10;
+        }
+        p += widths[i];
+        if (seps[i]) *p++ = seps[i];
+    }
+    if (ms) {
+        *p++ = '.';
+        *p++ = char('0' + ms/100);
+        *p++ = char('0' + (ms/10)%10);
+        *p++ = char('0' + ms%10);
+    }
+    *p++ = 'Z';
+    return p - buf;
+}
+
+namespace {
+
+// 2^53, above which doubles can't hold every integer
+const double maxExactInt = 9007199254740992.0;
+
+// Write the digits of v with a point before the last decimals of them
+int formatScaled(bool neg, quint64 v, int decimals, char *buf) {
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = char('0' + v%10);
+        v /= 10;
+    } while (v);
+
+    // At least one digit before the point
+    while (n <= decimals) {
+        digits[n++] = '0';
+    }
+
+    char *p = buf;
+    if (neg) *p++ = '-';
+    for (int i=n-1; i>=0; --i) {
+        *p++ = digits[i];
+        if (i == decimals && i > 0) *p++ = '.';
+    }
+    return p - buf;
+}
+
+// Shortest %g output that round trips, for values the fast path can't handle
+int formatExponent(double value, char *buf) {
+    char tmp[40];
+    int len = 0;
+    for (int prec=1; prec<=17; ++prec) {
+        len = std::snprintf(tmp, sizeof(tmp), "%.*g", prec, value);
+        if (std::strtod(tmp, 0) == value) break;
+    }
+    for (int i=0; i<len; ++i) {
+        buf[i] = tmp[i];
+    }
+    return len;
+}
+
+}
+
+int formatDouble(double value, char *buf) {
+    double a = std::fabs(value);
+    if (!(a < maxExactInt)) {
+        return formatExponent(value, buf);
+    }
+
+    // The first number of decimals where rounding gives back value.
+    // r and 10^k are both exact, so r / 10^k is the correctly rounded
+    // value of the decimal string, which is what a parser returns.
+    for (int k=0; k<=17; ++k) {
+        double scaled = a * exactPowers[k];
+        if (scaled >= maxExactInt) break;
+
+        double r = std::floor(scaled + 0.5);
+        if (r / exactPowers[k] == a) {
+            return formatScaled(value < 0 && r != 0, quint64(r), k, buf);
+        }
+    }
+    return formatExponent(value, buf);
+}
+
+int formatFixed(double value, int decimals, char *buf) {
+    if (decimals < 0) decimals = 0;
+    if (decimals > 17) decimals = 17;
+
+    double a = std::fabs(value);
+    double scaled = a * exactPowers[decimals];
+    if (!(scaled < maxExactInt)) {
+        // Not every digit fits in the integer path
+        if (!(a < 1e15)) {
+            return formatExponent(value, buf);
+        }
+        return std::snprintf(buf, 40, "%.*f", decimals, value);
+    }
+
+    quint64 r = quint64(std::floor(scaled + 0.5));
+    return formatScaled(value < 0 && r != 0, r, decimals, buf);
+}
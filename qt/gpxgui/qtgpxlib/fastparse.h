@@ -0,0 +1,63 @@
+// fastparse.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef GPX_FAST_PARSE_H
+#define GPX_FAST_PARSE_H
+
+#include <QtGlobal>
+
+// Number parsing straight from character ranges, without building a
+// QString or QByteArray first.  Leading and trailing whitespace is
+// skipped.  Each function returns false if [begin, end) is not a
+// valid number, leaving value untouched.
+//
+// Decimal numbers with at most 15 significant digits (everything a
+// GPS writes) are converted exactly with a single multiply or divide.
+// Longer ones fall back to QByteArray::toDouble.
+
+bool parseDouble(const char *begin, const char *end, double &value);
+bool parseDouble(const ushort *begin, const ushort *end, double &value);
+
+bool parseInt(const char *begin, const char *end, int &value);
+bool parseInt(const ushort *begin, const ushort *end, int &value);
+
+// Fixed format ISO 8601 timestamps: YYYY-MM-DDThh:mm:ss[.fff][Z|+hh:mm]
+// Times without a zone are taken to be UTC.  msecs is set to
+// milliseconds since 1970-01-01T00:00:00Z; digits past milliseconds
+// are truncated.
+bool parseIsoTime(const char *begin, const char *end, qint64 &msecs);
+bool parseIsoTime(const ushort *begin, const ushort *end, qint64 &msecs);
+
+// Write msecs as YYYY-MM-DDThh:mm:ss[.fff]Z into buf, which must
+// hold at least 32 characters.  Returns the number of characters
+// written; buf is not NUL terminated.
+int formatIsoTime(qint64 msecs, char *buf);
+
+// Write value into buf as the shortest plain decimal that reads back
+// as exactly the same double, so 39.38 comes out as "39.38".  buf must
+// hold at least 40 characters.  Returns the number of characters
+// written; buf is not guaranteed to be NUL terminated.  Values too
+// large or too small for a plain decimal (never a coordinate or
+// elevation) are written in exponent form.
+int formatDouble(double value, char *buf);
+
+// Write value with exactly decimals digits after the point, 0 to 17,
+// with the same buffer rules as formatDouble.  value is scaled and
+// rounded in floating point, so when the digits reach the limit of
+// double precision the last one may differ from printf's.
+int formatFixed(double value, int decimals, char *buf);
+
+#endif
@@ -0,0 +1,132 @@
+// gpxbatchloader.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gpxbatchloader.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QThread>
+
+GpxBatchLoader::GpxBatchLoader(const QStringList &files, GpxFile::Reader reader)
+    : files(files), reader(reader), purgeEmpty(true),
+      threads(QThread::idealThreadCount()), nextFile(0), cancelled(0),
+      started(false), running(0), finished(0) {
+}
+
+GpxBatchLoader::~GpxBatchLoader() {
+    cancel();
+    pool.waitForDone();
+}
+
+QStringList GpxBatchLoader::findFiles(const QString &dir, bool recursive) {
+    QStringList filters;
+    filters << "*.gpx" << "*.GPX" << "*.gpxb";
+
+    QDirIterator it(dir, filters, QDir::Files | QDir::Readable,
+                    recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags);
+    QStringList found;
+    while (it.hasNext()) {
+        found << it.next();
+    }
+    found.sort();
+    return found;
+}
+
+void GpxBatchLoader::setPurgeEmpty(bool purge) {
+    purgeEmpty = purge;
+}
+
+void GpxBatchLoader::setThreadCount(int n) {
+    threads = qMax(n, 1);
+}
+
+void GpxBatchLoader::start() {
+    QMutexLocker lock(&mutex);
+    if (started) return;
+    started = true;
+
+    // No point starting threads that would find nothing to do
+    int workers = qMin(threads, files.size());
+    pool.setMaxThreadCount(qMax(workers, 1));
+    running = workers;
+    for (int i=0; i<workers; ++i) {
+        pool.start(new Worker(this));
+    }
+}
+
+void GpxBatchLoader::cancel() {
+    cancelled.fetchAndStoreOrdered(1);
+}
+
+void GpxBatchLoader::work() {
+    while (!cancelled) {
+        int i = nextFile.fetchAndAddRelaxed(1);
+        if (i >= files.size()) break;
+
+        GpxBatchResult result;
+        result.index = i;
+        result.fileName = files[i];
+        result.ok = result.gpx.load(files[i], purgeEmpty, reader);
+        if (!result.ok) {
+            result.error = result.gpx.errorString();
+        }
+
+        QMutexLocker lock(&mutex);
+        results.enqueue(result);
+        ++finished;
+        ready.wakeOne();
+    }
+
+    QMutexLocker lock(&mutex);
+    --running;
+    ready.wakeAll();
+}
+
+bool GpxBatchLoader::next(GpxBatchResult &result) {
+    start();
+
+    QMutexLocker lock(&mutex);
+    while (results.isEmpty() && running > 0) {
+        ready.wait(&mutex);
+    }
+    if (results.isEmpty()) return false;
+
+    result = results.dequeue();
+    return true;
+}
+
+bool GpxBatchLoader::tryNext(GpxBatchResult &result) {
+    QMutexLocker lock(&mutex);
+    if (results.isEmpty()) return false;
+
+    result = results.dequeue();
+    return true;
+}
+
+bool GpxBatchLoader::atEnd() {
+    QMutexLocker lock(&mutex);
+    return started && running == 0 && results.isEmpty();
+}
+
+int GpxBatchLoader::fileCount() const {
+    return files.size();
+}
+
+int GpxBatchLoader::finishedCount() {
+    QMutexLocker lock(&mutex);
+    return finished;
+}
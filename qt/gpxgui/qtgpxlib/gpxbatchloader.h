@@ -0,0 +1,115 @@
+// gpxbatchloader.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef GPX_BATCH_LOADER_H
+#define GPX_BATCH_LOADER_H
+
+#include "gpxfile.h"
+
+#include <QString>
+#include <QStringList>
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QThreadPool>
+#include <QRunnable>
+
+// One file loaded by GpxBatchLoader
+struct GpxBatchResult {
+    // Position of the file in the loader's list
+    int index;
+    QString fileName;
+    GpxFile gpx;
+
+    // False if the file couldn't be read, with the reason in error
+    bool ok;
+    QString error;
+};
+
+// Loads a list of files on a pool of threads.
+// Each worker takes the next unclaimed file from a shared counter, so
+// threads that draw small files simply take more of them and nobody sits
+// idle behind one large file.  Every file is read into its own GpxFile
+// with its own parser, so workers share nothing but the counter and the
+// result queue.  Results are returned in the order they finish.
+class GpxBatchLoader {
+public:
+    GpxBatchLoader(const QStringList &files, GpxFile::Reader reader = GpxFile::MappedReader);
+
+    // Cancels and waits for the workers to stop
+    ~GpxBatchLoader();
+
+    // GPX and binary track files under dir, sorted by name
+    static QStringList findFiles(const QString &dir, bool recursive = true);
+
+    // Both take effect at the next start()
+    void setPurgeEmpty(bool purge);
+    // QThread::idealThreadCount() by default
+    void setThreadCount(int threads);
+
+    void start();
+
+    // Stop handing out files.  Files already being read still finish
+    // and are returned.
+    void cancel();
+
+    // Wait for the next finished file, starting the workers if needed.
+    // Returns false once every file has been returned.
+    bool next(GpxBatchResult &result);
+
+    // Like next(), but returns false straight away if nothing is ready
+    bool tryNext(GpxBatchResult &result);
+
+    // True once every file has been returned
+    bool atEnd();
+
+    int fileCount() const;
+    int finishedCount();
+
+private:
+    class Worker : public QRunnable {
+    public:
+        Worker(GpxBatchLoader *loader) : loader(loader) { }
+        void run() { loader->work(); }
+    private:
+        GpxBatchLoader *loader;
+    };
+
+    void work();
+
+    QStringList files;
+    GpxFile::Reader reader;
+    bool purgeEmpty;
+    int threads;
+
+    QThreadPool pool;
+
+    // Index of the next file to hand out
+    QAtomicInt nextFile;
+    QAtomicInt cancelled;
+
+    // Guards everything below
+    QMutex mutex;
+    QWaitCondition ready;
+    QQueue<GpxBatchResult> results;
+    bool started;
+    int running;
+    int finished;
+};
+
+#endif
@@ -0,0 +1,625 @@
+// gpxbinary.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "gpxbinary.h"
+#include "gpxfile.h"
+#include "gpxtracksegment.h"
+
+#include <QFile>
+#include <QIODevice>
+#include <QVector>
+#include <QtEndian>
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const int HeaderSize = 32;
+const int RecordSize = 32;
+const quint16 FormatVersion = 1;
+
+// Decimals byte marking a column of raw doubles
+const uchar RawColumn = 0xff;
+
+// Most decimals tried before storing a column raw
+const int MaxDecimals = 12;
+
+// 2^53, above which doubles can't hold every integer
+const double maxExactInt = 9007199254740992.0;
+
+const double powersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12
+};
+
+quint16 readU16(const char *p) {
+    return qFromLittleEndian<quint16>(reinterpret_cast<const uchar*>(p));
+}
+quint32 readU32(const char *p) {
+    return qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(p));
+}
+quint64 readU64(const char *p) {
+    return qFromLittleEndian<quint64>(reinterpret_cast<const uchar*>(p));
+}
+
+quint64 zigzag(qint64 v) {
+    return (quint64(v) << 1) ^ quint64(v >> 63);
+}
+qint64 unzigzag(quint64 v) {
+    return qint64(v >> 1) ^ -qint64(v & 1);
+}
+
+bool readVarint(const char *&p, const char *end, quint64 &v) {
+    v = 0;
+    for (int shift=0; shift<64 && p < end; shift += 7) {
+        uchar b = uchar(*p++);
+        v |= quint64(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// value * 10^decimals rounded to an integer
+qint64 scaled(double value, int decimals) {
+    double r = std::floor(std::fabs(value) * powersOfTen[decimals] + 0.5);
+    return value < 0 ? -qint64(r) : qint64(r);
+}
+
+bool survivesScaling(double value, int decimals) {
+    double r = std::floor(std::fabs(value) * powersOfTen[decimals] + 0.5);
+    return r < maxExactInt && r / powersOfTen[decimals] == std::fabs(value);
+}
+
+// Fewest decimals that store every value exactly, or -1 if there aren't any
+int fixedDecimals(const double *values, int n, int maxDecimals) {
+    int decimals = 0;
+    for (int i=0; i<n; ++i) {
+        while (!survivesScaling(values[i], decimals)) {
+            if (++decimals > maxDecimals) return -1;
+        }
+    }
+    return decimals;
+}
+
+qint64 alignTo8(qint64 pos) {
+    return (pos + 7) & ~qint64(7);
+}
+
+// Check the header, returning the layout and segment count
+bool readHeader(const char *begin, const char *end, quint16 &layout,
+                quint32 &segments, qint64 &time, QString &error) {
+    if (end - begin < HeaderSize || std::memcmp(begin, "GPXB", 4) != 0) {
+        error = "Not a binary track file";
+        return false;
+    }
+    quint16 version = readU16(begin+4);
+    if (version != FormatVersion) {
+        error = QString("Unsupported binary track file version %1").arg(version);
+        return false;
+    }
+    layout = readU16(begin+6);
+    if (layout != GpxBinaryWriter::PackedLayout && layout != GpxBinaryWriter::ColumnarLayout) {
+        error = QString("Unknown binary track file layout %1").arg(layout);
+        return false;
+    }
+    segments = readU32(begin+8);
+    time = qint64(readU64(begin+16));
+    return true;
+}
+
+// Check a columnar segment record fits in the file
+bool checkRecord(const char *begin, qint64 size, int seg) {
+    const char *rec = begin + HeaderSize + qint64(seg)*RecordSize;
+    quint64 offset = readU64(rec);
+    quint64 count = readU32(rec+8);
+    quint64 nameOffset = readU32(rec+16);
+    quint64 nameLength = readU32(rec+20);
+
+    return offset % 8 == 0 && offset <= quint64(size) && count*32 <= quint64(size) - offset &&
+        nameOffset <= quint64(size) && nameLength <= quint64(size) - nameOffset;
+}
+
+bool checkRecords(const char *begin, qint64 size, quint32 segments, QString &error) {
+    if (qint64(segments) > (size - HeaderSize) / RecordSize) {
+        error = "Truncated binary track file";
+        return false;
+    }
+    for (quint32 i=0; i<segments; ++i) {
+        if (!checkRecord(begin, size, i)) {
+            error = QString("Bad segment record %1").arg(i);
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+GpxBinaryWriter::GpxBinaryWriter(QIODevice *dev, Layout lay) : device(dev), layout(lay),
+                                                              used(0), written(0), failed(false) {
+}
+
+GpxBinaryWriter::~GpxBinaryWriter() {
+    flush();
+}
+
+QString GpxBinaryWriter::errorString() const {
+    return error;
+}
+
+bool GpxBinaryWriter::write(const GpxFile &gpx) {
+    // Read only through at(), so saving leaves the file's caches alone
+    int segments = gpx.segmentCount();
+    quint64 points = 0;
+    for (int i=0; i<segments; ++i) {
+        points += gpx.at(i).pointCount();
+    }
+    qint64 time = gpx.time().isValid() ? gpx.time().toMSecsSinceEpoch() : GpxPoint::NoTime;
+
+    put("GPXB", 4);
+    putU16(FormatVersion);
+    putU16(layout);
+    putU32(segments);
+    putU32(0);
+    putU64(quint64(time));
+    putU64(points);
+
+    if (layout == PackedLayout) {
+        for (int i=0; i<segments; ++i) {
+            writePacked(gpx.at(i));
+        }
+        return flush();
+    }
+
+    // Lay out the names, then the point data
+    QVector<QByteArray> names(segments);
+    QVector<qint64> nameOffsets(segments);
+    qint64 pos = HeaderSize + qint64(segments)*RecordSize;
+    for (int i=0; i<segments; ++i) {
+        names[i] = gpx.at(i).name().toUtf8();
+        nameOffsets[i] = pos;
+        pos += names[i].size();
+    }
+    pos = alignTo8(pos);
+
+    for (int i=0; i<segments; ++i) {
+        const GpxTrackSegment &seg = gpx.at(i);
+        putU64(pos);
+        putU32(seg.pointCount());
+        putU32(quint32(seg.number()));
+        putU32(quint32(nameOffsets[i]));
+        putU32(names[i].size());
+        putU64(0);
+        pos += qint64(seg.pointCount())*32;
+    }
+    for (int i=0; i<segments; ++i) {
+        put(names[i].constData(), names[i].size());
+    }
+    putPadding(alignTo8(written + used));
+
+    for (int i=0; i<segments; ++i) {
+        const GpxTrackSegment &seg = gpx.at(i);
+        int n = seg.pointCount();
+        const char *columns[] = {
+            reinterpret_cast<const char*>(seg.latitudes()),
+            reinterpret_cast<const char*>(seg.longitudes()),
+            reinterpret_cast<const char*>(seg.elevations()),
+            reinterpret_cast<const char*>(seg.timestamps())
+        };
+        for (int c=0; c<4; ++c) {
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+            put(columns[c], n*8);
+#else
+            for (int j=0; j<n; ++j) {
+                quint64 bits;
+                std::memcpy(&bits, columns[c] + j*8, 8);
+                putU64(bits);
+            }
+#endif
+        }
+    }
+    return flush();
+}
+
+void GpxBinaryWriter::writePacked(const GpxTrackSegment &seg) {
+    QByteArray name = seg.name().toUtf8();
+    putVarint(name.size());
+    put(name.constData(), name.size());
+    putVarint(zigzag(seg.number()));
+
+    int n = seg.pointCount();
+    putVarint(n);
+
+    writeColumn(seg.latitudes(), n, MaxDecimals);
+    writeColumn(seg.longitudes(), n, MaxDecimals);
+    writeColumn(seg.elevations(), n, MaxDecimals);
+
+    const qint64 *times = seg.timestamps();
+    quint64 prev = 0;
+    for (int i=0; i<n; ++i) {
+        putVarint(zigzag(qint64(quint64(times[i]) - prev)));
+        prev = quint64(times[i]);
+    }
+}
+
+void GpxBinaryWriter::writeColumn(const double *values, int n, int maxDecimals) {
+    int decimals = fixedDecimals(values, n, maxDecimals);
+    if (decimals < 0) {
+        char raw = char(RawColumn);
+        put(&raw, 1);
+        for (int i=0; i<n; ++i) {
+            quint64 bits;
+            std::memcpy(&bits, &values[i], 8);
+            putU64(bits);
+        }
+        return;
+    }
+
+    char d = char(decimals);
+    put(&d, 1);
+    qint64 prev = 0;
+    for (int i=0; i<n; ++i) {
+        qint64 v = scaled(values[i], decimals);
+        putVarint(zigzag(v - prev));
+        prev = v;
+    }
+}
+
+void GpxBinaryWriter::put(const char *data, int len) {
+    while (len > 0) {
+        if (used == BufferSize) {
+            flush();
+        }
+        int n = qMin(len, int(BufferSize) - used);
+        std::memcpy(buf + used, data, n);
+        used += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void GpxBinaryWriter::putU16(quint16 v) {
+    uchar b[2];
+    qToLittleEndian(v, b);
+    put(reinterpret_cast<const char*>(b), 2);
+}
+void GpxBinaryWriter::putU32(quint32 v) {
+    uchar b[4];
+    qToLittleEndian(v, b);
+    put(reinterpret_cast<const char*>(b), 4);
+}
+void GpxBinaryWriter::putU64(quint64 v) {
+    uchar b[8];
+    qToLittleEndian(v, b);
+    put(reinterpret_cast<const char*>(b), 8);
+}
+
+void GpxBinaryWriter::putVarint(quint64 v) {
+    char b[10];
+    int n = 0;
+    while (v >= 0x80) {
+        b[n++] = char((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    b[n++] = char(v);
+    put(b, n);
+}
+
+void GpxBinaryWriter::putPadding(qint64 pos) {
+    static const char zeros[8] = { 0 };
+    put(zeros, int(pos - written - used));
+}
+
+bool GpxBinaryWriter::flush() {
+    if (used > 0 && !failed) {
+        if (device->write(buf, used) != used) {
+            failed = true;
+            error = device->errorString();
+        }
+    }
+    written += used;
+    used = 0;
+    return !failed;
+}
+
+GpxBinaryReader::GpxBinaryReader(GpxFile &file) : gpx(file), progress(0) {
+}
+
+QString GpxBinaryReader::errorString() const {
+    return error;
+}
+
+void GpxBinaryReader::setProgress(GpxLoadProgress *p) {
+    progress = p;
+}
+
+bool GpxBinaryReader::isBinary(QFile &file) {
+    if (!file.isOpen() && !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    return file.peek(4) == "GPXB";
+}
+
+bool GpxBinaryReader::parse(QFile &file) {
+    if (!file.isOpen() && !file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    qint64 size = file.size();
+    uchar *data = file.map(0, size);
+    if (data) {
+        const char *begin = reinterpret_cast<const char*>(data);
+        bool rv = parse(begin, begin+size);
+        file.unmap(data);
+        return rv;
+    }
+
+    QByteArray bytes = file.readAll();
+    return parse(bytes.constData(), bytes.constData()+bytes.size());
+}
+
+bool GpxBinaryReader::parse(const char *begin, const char *end) {
+    quint16 layout;
+    quint32 segments;
+    qint64 time;
+    if (!readHeader(begin, end, layout, segments, time, error)) {
+        return false;
+    }
+    if (time != GpxPoint::NoTime) {
+        gpx.setTime(GpxPoint::toDateTime(time));
+    }
+
+    if (layout == GpxBinaryWriter::PackedLayout) {
+        return parsePacked(begin, end, segments);
+    }
+    return parseColumnar(begin, end, segments);
+}
+
+// Decode one double column written by GpxBinaryWriter::writeColumn
+static bool readColumn(const char *&p, const char *end, double *values, int n) {
+    if (p >= end) return false;
+    uchar decimals = uchar(*p++);
+
+    if (decimals == RawColumn) {
+        if (end - p < qint64(n)*8) return false;
+        for (int i=0; i<n; ++i, p += 8) {
+            quint64 bits = readU64(p);
+            std::memcpy(&values[i], &bits, 8);
+        }
+        return true;
+    }
+    if (decimals > MaxDecimals) return false;
+
+    double scale = powersOfTen[decimals];
+    qint64 v = 0;
+    for (int i=0; i<n; ++i) {
+        quint64 delta;
+        if (!readVarint(p, end, delta)) return false;
+        v += unzigzag(delta);
+        values[i] = double(v) / scale;
+    }
+    return true;
+}
+
+bool GpxBinaryReader::parsePacked(const char *begin, const char *end, quint32 segments) {
+    const char *p = begin + HeaderSize;
+    for (quint32 s=0; s<segments; ++s) {
+        if (!parsePackedSegment(p, end)) {
+            error = QString("Truncated binary track file, in segment %1").arg(s);
+            return false;
+        }
+        if (progress && !progress->report(p-begin, end-begin, gpx)) {
+            error = "Cancelled";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GpxBinaryReader::parsePackedSegment(const char *&p, const char *end) {
+    quint64 nameLength, number, count;
+    if (!readVarint(p, end, nameLength) || nameLength > quint64(end - p)) return false;
+    QString name = QString::fromUtf8(p, int(nameLength));
+    p += nameLength;
+
+    // Every value takes at least a byte, which bounds the count
+    if (!readVarint(p, end, number) || !readVarint(p, end, count) ||
+        count > quint64(end - p)) return false;
+    int n = int(count);
+
+    lat.resize(n);
+    lon.resize(n);
+    ele.resize(n);
+    times.resize(n);
+    if (!readColumn(p, end, lat.data(), n) ||
+        !readColumn(p, end, lon.data(), n) ||
+        !readColumn(p, end, ele.data(), n)) return false;
+
+    quint64 t = 0;
+    for (int i=0; i<n; ++i) {
+        quint64 delta;
+        if (!readVarint(p, end, delta)) return false;
+        t += quint64(unzigzag(delta));
+        times[i] = qint64(t);
+    }
+
+    GpxTrackSegment seg;
+    seg.setName(name);
+    seg.setNumber(int(unzigzag(number)));
+    seg.appendPoints(lat.constData(), lon.constData(), ele.constData(), times.constData(), n);
+    gpx.addTrack(seg);
+    return true;
+}
+
+bool GpxBinaryReader::parseColumnar(const char *begin, const char *end, quint32 segments) {
+    if (!checkRecords(begin, end - begin, segments, error)) {
+        return false;
+    }
+
+    for (quint32 s=0; s<segments; ++s) {
+        const char *rec = begin + HeaderSize + qint64(s)*RecordSize;
+        const char *data = begin + readU64(rec);
+        int n = readU32(rec+8);
+
+        GpxTrackSegment seg;
+        seg.setName(QString::fromUtf8(begin + readU32(rec+16), readU32(rec+20)));
+        seg.setNumber(qint32(readU32(rec+12)));
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        // The columns are already in memory order
+        seg.appendPoints(reinterpret_cast<const double*>(data),
+                         reinterpret_cast<const double*>(data + qint64(n)*8),
+                         reinterpret_cast<const double*>(data + qint64(n)*16),
+                         reinterpret_cast<const qint64*>(data + qint64(n)*24), n);
+#else
+        lat.resize(n);
+        lon.resize(n);
+        ele.resize(n);
+        times.resize(n);
+        double *columns[] = { lat.data(), lon.data(), ele.data() };
+        for (int c=0; c<3; ++c) {
+            for (int i=0; i<n; ++i) {
+                quint64 bits = readU64(data + (qint64(c)*n + i)*8);
+                std::memcpy(&columns[c][i], &bits, 8);
+            }
+        }
+        for (int i=0; i<n; ++i) {
+            times[i] = qint64(readU64(data + (qint64(3)*n + i)*8));
+        }
+        seg.appendPoints(lat.constData(), lon.constData(), ele.constData(), times.constData(), n);
+#endif
+        gpx.addTrack(seg);
+
+        if (progress && !progress->report(data + qint64(n)*32 - begin, end-begin, gpx)) {
+            error = "Cancelled";
+            return false;
+        }
+    }
+    return true;
+}
+
+GpxBinaryView::GpxBinaryView() : file(0), data(0), size(0), segments(0) {
+}
+
+GpxBinaryView::~GpxBinaryView() {
+    close();
+}
+
+bool GpxBinaryView::open(const QString &fname) {
+    close();
+
+    file = new QFile(fname);
+    if (!file->open(QIODevice::ReadOnly)) {
+        error = file->errorString();
+        close();
+        return false;
+    }
+
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    error = "Columnar track files can only be used in place on little-endian machines";
+    close();
+    return false;
+#endif
+
+    size = file->size();
+    data = file->map(0, size);
+    if (!data) {
+        error = QString("%1 can't be mapped").arg(fname);
+        close();
+        return false;
+    }
+
+    const char *begin = reinterpret_cast<const char*>(data);
+    quint16 layout;
+    quint32 count;
+    qint64 time;
+    if (!readHeader(begin, begin+size, layout, count, time, error)) {
+        close();
+        return false;
+    }
+    if (layout != GpxBinaryWriter::ColumnarLayout) {
+        error = "Only columnar track files can be used in place";
+        close();
+        return false;
+    }
+    if (!checkRecords(begin, size, count, error)) {
+        close();
+        return false;
+    }
+    segments = int(count);
+    error = QString();
+    return true;
+}
+
+void GpxBinaryView::close() {
+    if (file) {
+        if (data) file->unmap(const_cast<uchar*>(data));
+        delete file;
+    }
+    file = 0;
+    data = 0;
+    size = 0;
+    segments = 0;
+}
+
+QString GpxBinaryView::errorString() const {
+    return error;
+}
+
+qint64 GpxBinaryView::time() const {
+    return qint64(readU64(reinterpret_cast<const char*>(data) + 16));
+}
+
+int GpxBinaryView::segmentCount() const {
+    return segments;
+}
+
+const char *GpxBinaryView::record(int seg) const {
+    return reinterpret_cast<const char*>(data) + HeaderSize + qint64(seg)*RecordSize;
+}
+
+QString GpxBinaryView::name(int seg) const {
+    const char *rec = record(seg);
+    return QString::fromUtf8(reinterpret_cast<const char*>(data) + readU32(rec+16), readU32(rec+20));
+}
+
+int GpxBinaryView::number(int seg) const {
+    return qint32(readU32(record(seg)+12));
+}
+
+int GpxBinaryView::pointCount(int seg) const {
+    return readU32(record(seg)+8);
+}
+
+// Start of column col (latitude, longitude, elevation, time) of seg
+const char *GpxBinaryView::column(int seg, int col) const {
+    const char *rec = record(seg);
+    return reinterpret_cast<const char*>(data) + readU64(rec) + qint64(col)*pointCount(seg)*8;
+}
+
+const double *GpxBinaryView::latitudes(int seg) const {
+    return reinterpret_cast<const double*>(column(seg, 0));
+}
+const double *GpxBinaryView::longitudes(int seg) const {
+    return reinterpret_cast<const double*>(column(seg, 1));
+}
+const double *GpxBinaryView::elevations(int seg) const {
+    return reinterpret_cast<const double*>(column(seg, 2));
+}
+const qint64 *GpxBinaryView::timestamps(int seg) const {
+    return reinterpret_cast<const qint64*>(column(seg, 3));
+}
@@ -0,0 +1,170 @@
+// gpxbinary.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef GPX_BINARY_H
+#define GPX_BINARY_H
+
+#include <QString>
+#include <QVector>
+
+class GpxFile;
+class GpxLoadProgress;
+class GpxTrackSegment;
+class QFile;
+class QIODevice;
+
+// Binary track files (.gpxb)
+//
+// Every file starts with a 32 byte header, all integers little-endian:
+//   0  "GPXB"
+//   4  u16 format version, currently 1
+//   6  u16 layout, a GpxBinaryWriter::Layout
+//   8  u32 segment count
+//  12  u32 reserved, 0
+//  16  i64 file time in ms since the epoch, GpxPoint::NoTime if unset
+//  24  u64 total point count
+//
+// Packed layout, one record per segment:
+//   varint name length, UTF-8 name, zigzag varint number,
+//   varint point count, then the latitude, longitude, elevation and
+//   time columns in turn.  Each double column starts with a byte
+//   holding the number of decimals its values were stored with,
+//   followed by the zigzag varint deltas of the values scaled to
+//   integers, or 0xff followed by raw doubles if some value wouldn't
+//   survive that.  The time column is zigzag varint deltas.
+//
+// Columnar layout, for mapping and using without any decoding:
+//   32 bytes per segment: u64 offset of its point data, u32 point
+//   count, i32 number, u32 name offset, u32 name length, 8 reserved.
+//   Names follow, then each segment's latitude, longitude and
+//   elevation doubles and time int64s as plain arrays, each starting
+//   on an 8 byte boundary.
+class GpxBinaryWriter {
+public:
+    enum Layout {
+        // Smallest files, decoded on load
+        PackedLayout,
+        // About twice the size of packed, but can be mapped and used
+        // in place, see GpxBinaryView
+        ColumnarLayout
+    };
+
+    GpxBinaryWriter(QIODevice *device, Layout layout = PackedLayout);
+    ~GpxBinaryWriter();
+
+    // Returns false if the device failed
+    bool write(const GpxFile &gpx);
+
+    QString errorString() const;
+
+private:
+    enum { BufferSize = 64*1024 };
+
+    void writePacked(const GpxTrackSegment &seg);
+    void writeColumn(const double *values, int n, int maxDecimals);
+
+    void put(const char *data, int len);
+    void putU16(quint16 v);
+    void putU32(quint32 v);
+    void putU64(quint64 v);
+    void putVarint(quint64 v);
+    void putPadding(qint64 pos);
+    bool flush();
+
+    QIODevice *device;
+    Layout layout;
+
+    char buf[BufferSize];
+    int used;
+    qint64 written;
+
+    bool failed;
+    QString error;
+};
+
+// Loads either layout into a GpxFile.
+// Like GpxMappedReader, the file is mapped if possible.
+class GpxBinaryReader {
+public:
+    GpxBinaryReader(GpxFile &file);
+
+    // True if the file starts with the binary magic number.
+    // Opens the file if it isn't already.
+    static bool isBinary(QFile &file);
+
+    bool parse(QFile &file);
+    bool parse(const char *begin, const char *end);
+
+    QString errorString() const;
+
+    // Report progress to, and stop when cancelled by, progress.
+    // Reports are made between segments.
+    void setProgress(GpxLoadProgress *progress);
+
+private:
+    bool parsePacked(const char *begin, const char *end, quint32 segments);
+    bool parsePackedSegment(const char *&p, const char *end);
+    bool parseColumnar(const char *begin, const char *end, quint32 segments);
+
+    GpxFile &gpx;
+    GpxLoadProgress *progress;
+    QString error;
+
+    // Decoded columns, reused from segment to segment
+    QVector<double> lat, lon, ele;
+    QVector<qint64> times;
+};
+
+// Read only view of a columnar file, used straight from the mapping.
+// The arrays are valid until the view is closed or destroyed.
+class GpxBinaryView {
+public:
+    GpxBinaryView();
+    ~GpxBinaryView();
+
+    bool open(const QString &fname);
+    void close();
+
+    QString errorString() const;
+
+    qint64 time() const;
+
+    int segmentCount() const;
+    QString name(int seg) const;
+    int number(int seg) const;
+    int pointCount(int seg) const;
+
+    const double *latitudes(int seg) const;
+    const double *longitudes(int seg) const;
+    const double *elevations(int seg) const;
+    const qint64 *timestamps(int seg) const;
+
+private:
+    GpxBinaryView(const GpxBinaryView &);
+    GpxBinaryView &operator=(const GpxBinaryView &);
+
+    const char *record(int seg) const;
+    const char *column(int seg, int col) const;
+
+    QFile *file;
+    const uchar *data;
+    qint64 size;
+    int segments;
+
+    QString error;
+};
+
+#endif
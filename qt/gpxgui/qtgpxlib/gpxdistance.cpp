@@ -0,0 +1,358 @@
+// gpxdistance.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gpxdistance.h"
+#include "gpxkernels.h"
+#include "gpxpoint.h"
+#include "gpxutm.h"
+
+#include <GeographicLib/Geodesic.hpp>
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GPX_DISTANCE_X86
+#include <immintrin.h>
+#endif
+
+// The spherical steps are
+//
+//   h = sin^2(dlat/2) + cos(lat1) cos(lat2) sin^2(dlon/2)
+//   d = 2 R asin(sqrt(h))
+//
+// Latitudes and half differences are all within [-pi/2, pi/2], where
+// Taylor series to x^20 give sin and cos to within a few ulps with no
+// range reduction, and the asin series to x^17 is as good below 0.125
+// (steps up to about 1600 km).  Longer steps use std::asin.  The vector
+// versions do the same operations in the same order as the scalar one,
+// and longitude differences are wrapped with the same rounding trick
+// in all of them, so every version gives the same bits.
+
+namespace {
+
+GpxDistanceModel currentModel = UtmDistance;
+
+const double AsinLimit = 0.125;
+
+// 1.5 * 2^52.  (x + Magic) - Magic rounds x to the nearest integer.
+const double Magic = 6755399441055744.0;
+
+// Steps measured per pass over the scratch buffer
+const int BlockSize = 256;
+
+inline double sinPoly(double x) {
+    double x2 = x*x;
+    return x*(1 + x2*(-1.0/6 + x2*(1.0/120 + x2*(-1.0/5040 + x2*(1.0/362880 + x2*(-1.0/39916800
+           + x2*(1.0/6227020800.0 + x2*(-1.0/1307674368000.0 + x2*(1.0/355687428096000.0
+           + x2*(-1.0/121645100408832000.0))))))))));
+}
+
+inline double cosPoly(double x) {
+    double x2 = x*x;
+    return 1 + x2*(-1.0/2 + x2*(1.0/24 + x2*(-1.0/720 + x2*(1.0/40320 + x2*(-1.0/3628800
+           + x2*(1.0/479001600 + x2*(-1.0/87178291200.0 + x2*(1.0/20922789888000.0
+           + x2*(-1.0/6402373705728000.0 + x2*(1.0/2432902008176640000.0))))))))));
+}
+
+inline double asinPoly(double x) {
+    double x2 = x*x;
+    return x*(1 + x2*(1.0/6 + x2*(3.0/40 + x2*(15.0/336 + x2*(105.0/3456 + x2*(945.0/42240
+           + x2*(10395.0/599040 + x2*(135135.0/9676800 + x2*(2027025.0/175472640)))))))));
+}
+
+inline double sphericalStep(const double *lat, const double *lon, const double *ele, int i) {
+    double dlon = lon[i+1] - lon[i];
+    double turns = dlon * (1.0/360);
+    dlon -= 360 * ((turns + Magic) - Magic);
+
+    double sphi = sinPoly((lat[i+1] - lat[i]) * (GpxDegree/2));
+    double slam = sinPoly(dlon * (GpxDegree/2));
+    double c = cosPoly(lat[i] * GpxDegree) * cosPoly(lat[i+1] * GpxDegree);
+
+    double h = sphi*sphi + c*(slam*slam);
+    h = 1.0 < h ? 1.0 : h;
+    double x = std::sqrt(h);
+    double ground = (2*GpxMeanRadius) * (x < AsinLimit ? asinPoly(x) : std::asin(x));
+
+    double dz = ele[i+1] - ele[i];
+    return std::sqrt(ground*ground + dz*dz);
+}
+
+void sphericalScalar(const double *lat, const double *lon, const double *ele,
+                     int steps, double *d) {
+    for (int i=0; i<steps; ++i) {
+        d[i] = sphericalStep(lat, lon, ele, i);
+    }
+}
+
+#ifdef GPX_DISTANCE_X86
+
+// The polynomials for any vector type, with the intrinsics passed in
+#define GPX_SIN_POLY(T, MUL, ADD, SET, x, out) {                              \
+        T x2 = MUL(x, x);                                                     \
+        T p = SET(-1.0/121645100408832000.0);                                 \
+        p = ADD(SET(1.0/355687428096000.0), MUL(x2, p));                      \
+        p = ADD(SET(-1.0/1307674368000.0), MUL(x2, p));                       \
+        p = ADD(SET(1.0/6227020800.0), MUL(x2, p));                           \
+        p = ADD(SET(-1.0/39916800), MUL(x2, p));                              \
+        p = ADD(SET(1.0/362880), MUL(x2, p));                                 \
+        p = ADD(SET(-1.0/5040), MUL(x2, p));                                  \
+        p = ADD(SET(1.0/120), MUL(x2, p));                                    \
+        p = ADD(SET(-1.0/6), MUL(x2, p));                                     \
+        p = ADD(SET(1.0), MUL(x2, p));                                        \
+        out = MUL(x, p);                                                      \
+    }
+
+#define GPX_COS_POLY(T, MUL, ADD, SET, x, out) {                              \
+        T x2 = MUL(x, x);                                                     \
+        T p = SET(1.0/2432902008176640000.0);                                 \
+        p = ADD(SET(-1.0/6402373705728000.0), MUL(x2, p));                    \
+        p = ADD(SET(1.0/20922789888000.0), MUL(x2, p));                       \
+        p = ADD(SET(-1.0/87178291200.0), MUL(x2, p));                         \
+        p = ADD(SET(1.0/479001600), MUL(x2, p));                              \
+        p = ADD(SET(-1.0/3628800), MUL(x2, p));                               \
+        p = ADD(SET(1.0/40320), MUL(x2, p));                                  \
+        p = ADD(SET(-1.0/720), MUL(x2, p));                                   \
+        p = ADD(SET(1.0/24), MUL(x2, p));                                     \
+        p = ADD(SET(-1.0/2), MUL(x2, p));                                     \
+        out = ADD(SET(1.0), MUL(x2, p));                                      \
+    }
+
+#define GPX_ASIN_POLY(T, MUL, ADD, SET, x, out) {                             \
+        T x2 = MUL(x, x);                                                     \
+        T p = SET(2027025.0/175472640);                                       \
+        p = ADD(SET(135135.0/9676800), MUL(x2, p));                           \
+        p = ADD(SET(10395.0/599040), MUL(x2, p));                             \
+        p = ADD(SET(945.0/42240), MUL(x2, p));                                \
+        p = ADD(SET(105.0/3456), MUL(x2, p));                                 \
+        p = ADD(SET(15.0/336), MUL(x2, p));                                   \
+        p = ADD(SET(3.0/40), MUL(x2, p));                                     \
+        p = ADD(SET(1.0/6), MUL(x2, p));                                      \
+        p = ADD(SET(1.0), MUL(x2, p));                                        \
+        out = MUL(x, p);                                                      \
+    }
+
+__attribute__((target("sse2")))
+void sphericalSse2(const double *lat, const double *lon, const double *ele,
+                   int steps, double *d) {
+    const __m128d magic = _mm_set1_pd(Magic);
+
+    int i = 0;
+    for (; i+2 <= steps; i += 2) {
+        __m128d lat0 = _mm_loadu_pd(lat+i), lat1 = _mm_loadu_pd(lat+i+1);
+        __m128d dlon = _mm_sub_pd(_mm_loadu_pd(lon+i+1), _mm_loadu_pd(lon+i));
+        __m128d turns = _mm_mul_pd(dlon, _mm_set1_pd(1.0/360));
+        turns = _mm_sub_pd(_mm_add_pd(turns, magic), magic);
+        dlon = _mm_sub_pd(dlon, _mm_mul_pd(_mm_set1_pd(360.0), turns));
+
+        __m128d hphi = _mm_mul_pd(_mm_sub_pd(lat1, lat0), _mm_set1_pd(GpxDegree/2));
+        __m128d hlam = _mm_mul_pd(dlon, _mm_set1_pd(GpxDegree/2));
+        __m128d phi0 = _mm_mul_pd(lat0, _mm_set1_pd(GpxDegree));
+        __m128d phi1 = _mm_mul_pd(lat1, _mm_set1_pd(GpxDegree));
+
+        __m128d sphi, slam, c0, c1;
+        GPX_SIN_POLY(__m128d, _mm_mul_pd, _mm_add_pd, _mm_set1_pd, hphi, sphi);
+        GPX_SIN_POLY(__m128d, _mm_mul_pd, _mm_add_pd, _mm_set1_pd, hlam, slam);
+        GPX_COS_POLY(__m128d, _mm_mul_pd, _mm_add_pd, _mm_set1_pd, phi0, c0);
+        GPX_COS_POLY(__m128d, _mm_mul_pd, _mm_add_pd, _mm_set1_pd, phi1, c1);
+
+        __m128d h = _mm_add_pd(_mm_mul_pd(sphi, sphi),
+                               _mm_mul_pd(_mm_mul_pd(c0, c1), _mm_mul_pd(slam, slam)));
+        h = _mm_min_pd(_mm_set1_pd(1.0), h);
+        __m128d x = _mm_sqrt_pd(h);
+
+        __m128d a;
+        GPX_ASIN_POLY(__m128d, _mm_mul_pd, _mm_add_pd, _mm_set1_pd, x, a);
+
+        // Long steps, and NaNs, go to std::asin
+        int far = _mm_movemask_pd(_mm_cmpnlt_pd(x, _mm_set1_pd(AsinLimit)));
+        if (far) {
+            double xs[2], as[2];
+            _mm_storeu_pd(xs, x);
+            _mm_storeu_pd(as, a);
+            for (int l=0; l<2; ++l) {
+                if (far & (1 << l)) as[l] = std::asin(xs[l]);
+            }
+            a = _mm_loadu_pd(as);
+        }
+
+        __m128d ground = _mm_mul_pd(_mm_set1_pd(2*GpxMeanRadius), a);
+        __m128d dz = _mm_sub_pd(_mm_loadu_pd(ele+i+1), _mm_loadu_pd(ele+i));
+        _mm_storeu_pd(d+i, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(ground, ground), _mm_mul_pd(dz, dz))));
+    }
+    for (; i<steps; ++i) {
+        d[i] = sphericalStep(lat, lon, ele, i);
+    }
+}
+
+__attribute__((target("avx2")))
+void sphericalAvx2(const double *lat, const double *lon, const double *ele,
+                   int steps, double *d) {
+    const __m256d magic = _mm256_set1_pd(Magic);
+
+    int i = 0;
+    for (; i+4 <= steps; i += 4) {
+        __m256d lat0 = _mm256_loadu_pd(lat+i), lat1 = _mm256_loadu_pd(lat+i+1);
+        __m256d dlon = _mm256_sub_pd(_mm256_loadu_pd(lon+i+1), _mm256_loadu_pd(lon+i));
+        __m256d turns = _mm256_mul_pd(dlon, _mm256_set1_pd(1.0/360));
+        turns = _mm256_sub_pd(_mm256_add_pd(turns, magic), magic);
+        dlon = _mm256_sub_pd(dlon, _mm256_mul_pd(_mm256_set1_pd(360.0), turns));
+
+        __m256d hphi = _mm256_mul_pd(_mm256_sub_pd(lat1, lat0), _mm256_set1_pd(GpxDegree/2));
+        __m256d hlam = _mm256_mul_pd(dlon, _mm256_set1_pd(GpxDegree/2));
+        __m256d phi0 = _mm256_mul_pd(lat0, _mm256_set1_pd(GpxDegree));
+        __m256d phi1 = _mm256_mul_pd(lat1, _mm256_set1_pd(GpxDegree));
+
+        __m256d sphi, slam, c0, c1;
+        GPX_SIN_POLY(__m256d, _mm256_mul_pd, _mm256_add_pd, _mm256_set1_pd, hphi, sphi);
+        GPX_SIN_POLY(__m256d, _mm256_mul_pd, _mm256_add_pd, _mm256_set1_pd, hlam, slam);
+        GPX_COS_POLY(__m256d, _mm256_mul_pd, _mm256_add_pd, _mm256_set1_pd, phi0, c0);
+        GPX_COS_POLY(__m256d, _mm256_mul_pd, _mm256_add_pd, _mm256_set1_pd, phi1, c1);
+
+        __m256d h = _mm256_add_pd(_mm256_mul_pd(sphi, sphi),
+                                  _mm256_mul_pd(_mm256_mul_pd(c0, c1), _mm256_mul_pd(slam, slam)));
+        h = _mm256_min_pd(_mm256_set1_pd(1.0), h);
+        __m256d x = _mm256_sqrt_pd(h);
+
+        __m256d a;
+        GPX_ASIN_POLY(__m256d, _mm256_mul_pd, _mm256_add_pd, _mm256_set1_pd, x, a);
+
+        int far = _mm256_movemask_pd(_mm256_cmp_pd(x, _mm256_set1_pd(AsinLimit), _CMP_NLT_UQ));
+        if (far) {
+            double xs[4], as[4];
+            _mm256_storeu_pd(xs, x);
+            _mm256_storeu_pd(as, a);
+            for (int l=0; l<4; ++l) {
+                if (far & (1 << l)) as[l] = std::asin(xs[l]);
+            }
+            a = _mm256_loadu_pd(as);
+        }
+
+        __m256d ground = _mm256_mul_pd(_mm256_set1_pd(2*GpxMeanRadius), a);
+        __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(ele+i+1), _mm256_loadu_pd(ele+i));
+        _mm256_storeu_pd(d+i, _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(ground, ground),
+                                                           _mm256_mul_pd(dz, dz))));
+    }
+    for (; i<steps; ++i) {
+        d[i] = sphericalStep(lat, lon, ele, i);
+    }
+}
+
+#undef GPX_SIN_POLY
+#undef GPX_COS_POLY
+#undef GPX_ASIN_POLY
+
+#endif
+
+void geodesicSteps(const double *lat, const double *lon, const double *ele,
+                   int steps, double *d) {
+    const GeographicLib::Geodesic &wgs84 = GeographicLib::Geodesic::WGS84();
+    for (int i=0; i<steps; ++i) {
+        double ground;
+        wgs84.Inverse(lat[i], lon[i], lat[i+1], lon[i+1], ground);
+        double dz = ele[i+1] - ele[i];
+        d[i] = std::sqrt(ground*ground + dz*dz);
+    }
+}
+
+// Distances of the steps from point i to i+1, for i < steps
+void stepDistances(const double *lat, const double *lon, const double *ele,
+                   int steps, GpxDistanceModel model, double *d) {
+    if (model == GeodesicDistance) {
+        geodesicSteps(lat, lon, ele, steps, d);
+        return;
+    }
+
+    switch (gpxKernelIsa()) {
+#ifdef GPX_DISTANCE_X86
+    case Avx2Kernels:
+        sphericalAvx2(lat, lon, ele, steps, d);
+        break;
+    case Sse2Kernels:
+        sphericalSse2(lat, lon, ele, steps, d);
+        break;
+#endif
+    default:
+        sphericalScalar(lat, lon, ele, steps, d);
+        break;
+    }
+}
+
+}
+
+GpxDistanceModel gpxDistanceModel() {
+    return currentModel;
+}
+
+void setGpxDistanceModel(GpxDistanceModel model) {
+    currentModel = model;
+}
+
+double gpxDistance(double lat1, double lon1, double ele1,
+                   double lat2, double lon2, double ele2) {
+    double lat[2] = { lat1, lat2 };
+    double lon[2] = { lon1, lon2 };
+    double ele[2] = { ele1, ele2 };
+
+    if (currentModel == UtmDistance) {
+        double x[2], y[2];
+        signed char zone[2];
+        gpxProjectUTM(lat, lon, 2, x, y, zone);
+
+        double dx = x[1] - x[0];
+        double dy = y[1] - y[0];
+        double dz = ele2 - ele1;
+        return std::sqrt(dx*dx + dy*dy + dz*dz);
+    }
+
+    double d;
+    stepDistances(lat, lon, ele, 1, currentModel, &d);
+    return d;
+}
+
+double gpxLatLonPathLength(const double *lat, const double *lon, const double *ele,
+                           int n, GpxDistanceModel model) {
+    double d[BlockSize];
+    double dist = 0.0;
+    for (int i=0; i<n-1; i += BlockSize) {
+        int steps = qMin(BlockSize, n-1-i);
+        stepDistances(lat+i, lon+i, ele+i, steps, model, d);
+        for (int j=0; j<steps; ++j) {
+            dist += d[j];
+        }
+    }
+    return dist;
+}
+
+double gpxLatLonMaxSpeed(const double *lat, const double *lon, const double *ele,
+                         const qint64 *t, int n, GpxDistanceModel model) {
+    double d[BlockSize];
+    double curMax = 0.0;
+    for (int i=0; i<n-1; i += BlockSize) {
+        int steps = qMin(BlockSize, n-1-i);
+        stepDistances(lat+i, lon+i, ele+i, steps, model, d);
+        for (int j=0; j<steps; ++j) {
+            // Same rule as the projected kernels: no speed without two
+            // times moving forward
+            qint64 t0 = t[i+j], t1 = t[i+j+1];
+            if (t0 == GpxPoint::NoTime || t1 == GpxPoint::NoTime || t1 <= t0) continue;
+            double spd = d[j] / (double(t1 - t0) / 1000.0);
+            curMax = spd > curMax ? spd : curMax;
+        }
+    }
+    return curMax;
+}
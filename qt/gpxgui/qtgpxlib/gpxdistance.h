@@ -0,0 +1,74 @@
+// gpxdistance.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef GPX_DISTANCE_H
+#define GPX_DISTANCE_H
+
+#include <QtGlobal>
+
+// The sphere SphericalDistance measures on: the WGS84 mean radius, in
+// metres.  Other code working on a sphere uses it too.
+const double GpxMeanRadius = 6371008.8;
+
+// Radians per degree
+const double GpxDegree = 3.14159265358979323846 / 180;
+
+// How distances between points are measured.  Every model includes the
+// change in elevation, as sqrt(ground^2 + dz^2).
+enum GpxDistanceModel {
+    // Straight line between UTM coordinates.  Needs every point
+    // projected.  The UTM scale factor makes distances 0.04% short on
+    // the central meridian and up to about 0.1% long at the edge of a
+    // zone, and a step crossing a zone boundary is measured between two
+    // different grids, so it can be off by hundreds of kilometres.
+    UtmDistance,
+
+    // Haversine on a sphere of the WGS84 mean radius, straight from
+    // lat/lon.  The sphere is within about 0.5% of the ellipsoid
+    // (0.3% typical); evaluation error is below 1e-14 relative.
+    // The fastest model: the trig is done with polynomials in the
+    // vector kernels.
+    SphericalDistance,
+
+    // Shortest path on the WGS84 ellipsoid with GeographicLib::Geodesic.
+    // Accurate to about 15 nanometres, and several times slower than
+    // the spherical model.
+    GeodesicDistance
+};
+
+// The model used by GpxPoint, GpxTrackSegment and GpxFile, UtmDistance
+// by default.  Cached lengths and speeds from another model are
+// recomputed the next time they're asked for.
+GpxDistanceModel gpxDistanceModel();
+void setGpxDistanceModel(GpxDistanceModel model);
+
+// Distance between two points with the current model
+double gpxDistance(double lat1, double lon1, double ele1,
+                   double lat2, double lon2, double ele2);
+
+// Sum of the distances between consecutive points, and the largest
+// distance over elapsed time between them with t in milliseconds, as
+// gpxPathLength and gpxMaxSpeed but from lat/lon in degrees.  model
+// must be SphericalDistance or GeodesicDistance.  Steps are measured in
+// blocks and added in order, so every instruction set gives the same
+// bits.
+double gpxLatLonPathLength(const double *lat, const double *lon, const double *ele,
+                           int n, GpxDistanceModel model);
+double gpxLatLonMaxSpeed(const double *lat, const double *lon, const double *ele,
+                         const qint64 *t, int n, GpxDistanceModel model);
+
+#endif
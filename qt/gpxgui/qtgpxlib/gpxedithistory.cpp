@@ -0,0 +1,92 @@
+// gpxedithistory.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gpxedithistory.h"
+
+GpxEditHistory::GpxEditHistory(int limit) : _limit(limit) {}
+
+void GpxEditHistory::record(const GpxFile &gpx, const QString &what) {
+    Step step;
+    step.gpx = gpx;
+    step.what = what;
+    _undo.push_back(step);
+    _redo.clear();
+    while (_undo.size() > _limit) {
+        _undo.removeFirst();
+    }
+}
+
+bool GpxEditHistory::canUndo() const {
+    return !_undo.isEmpty();
+}
+bool GpxEditHistory::canRedo() const {
+    return !_redo.isEmpty();
+}
+
+int GpxEditHistory::undoCount() const {
+    return _undo.size();
+}
+int GpxEditHistory::redoCount() const {
+    return _redo.size();
+}
+
+QString GpxEditHistory::undoText() const {
+    return _undo.isEmpty() ? QString() : _undo.last().what;
+}
+QString GpxEditHistory::redoText() const {
+    return _redo.isEmpty() ? QString() : _redo.last().what;
+}
+
+bool GpxEditHistory::undo(GpxFile &gpx) {
+    if (_undo.isEmpty()) return false;
+
+    Step step = _undo.takeLast();
+    Step current;
+    current.gpx = gpx;
+    current.what = step.what;
+    _redo.push_back(current);
+    gpx = step.gpx;
+    return true;
+}
+
+bool GpxEditHistory::redo(GpxFile &gpx) {
+    if (_redo.isEmpty()) return false;
+
+    Step step = _redo.takeLast();
+    Step current;
+    current.gpx = gpx;
+    current.what = step.what;
+    _undo.push_back(current);
+    gpx = step.gpx;
+    return true;
+}
+
+void GpxEditHistory::clear() {
+    _undo.clear();
+    _redo.clear();
+}
+
+int GpxEditHistory::limit() const {
+    return _limit;
+}
+
+void GpxEditHistory::setLimit(int steps) {
+    _limit = qMax(steps, 0);
+    while (_undo.size() > _limit) {
+        _undo.removeFirst();
+    }
+}
@@ -0,0 +1,76 @@
+// gpxedithistory.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef GPX_EDIT_HISTORY_H
+#define GPX_EDIT_HISTORY_H
+
+#include <QList>
+#include <QString>
+
+#include "gpxfile.h"
+
+// Undo and redo for changes to a GpxFile.
+//
+// Each step is a copy of the whole file from before or after a change.
+// Segments keep their points in implicitly shared columns, and nothing
+// that only reads a segment detaches them, so a copy costs a few
+// pointers per segment and no points.  Points are only duplicated when
+// a change writes to a segment still held by the history, such as the
+// segment merged into, and then only that segment's.
+class GpxEditHistory {
+public:
+    // Keeps at most limit steps to undo
+    GpxEditHistory(int limit = 50);
+
+    // Remember gpx as it is before a change described by what.  Anything
+    // that could be redone is dropped.
+    void record(const GpxFile &gpx, const QString &what);
+
+    bool canUndo() const;
+    bool canRedo() const;
+    int undoCount() const;
+    int redoCount() const;
+
+    // What the next undo or redo would change back, or an empty string
+    QString undoText() const;
+    QString redoText() const;
+
+    // Put gpx back how it was before the last change, keeping how it is
+    // now for redo.  Returns false if there's nothing to undo.
+    bool undo(GpxFile &gpx);
+
+    // Put gpx back how it was before the last undo
+    bool redo(GpxFile &gpx);
+
+    void clear();
+
+    int limit() const;
+    void setLimit(int steps);
+
+private:
+    struct Step {
+        GpxFile gpx;
+        QString what;
+    };
+
+    // Oldest first
+    QList<Step> _undo;
+    QList<Step> _redo;
+    int _limit;
+};
+
+#endif
@@ -15,10 +15,32 @@
 // OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include "gpxfile.h"
+#include "gpxstreamparser.h"
+#include "gpxmappedreader.h"
+#include "gpxwriter.h"
+#include "gpxbinary.h"
+
+#include <QBuffer>
+#include <QtConcurrentMap>
 
 #include <cassert>
 
-GpxFile::GpxFile(GpxTrackSegment &seg) {
+static int parallelPoints = 20000;
+
+void GpxFile::setParallelThreshold(int points) {
+    parallelPoints = points;
+}
+int GpxFile::parallelThreshold() {
+    return parallelPoints;
+}
+
+GpxFile::GpxFile() : _statsValid(false), _distanceModel(UtmDistance), _offsets(1, 0), _offsetsValid(1),
+                     _indexValid(false), _namesValid(false) {
+}
+
+GpxFile::GpxFile(GpxTrackSegment &seg) : _statsValid(false), _distanceModel(UtmDistance),
+                                          _offsets(1, 0), _offsetsValid(1), _indexValid(false),
+                                          _namesValid(false) {
     track_segments.push_back(seg);
     if (seg.pointCount()>0) {
         _time = seg[0].time();
@@ -26,73 +48,174 @@ GpxFile::GpxFile(GpxTrackSegment &seg) {
     track_segments[0].setNumber(1);
 }
 
-GpxFile::GpxFile(QString fname, bool purgeEmpty) : _time(QDateTime()) {
-    readFile(fname, purgeEmpty);
+GpxFile::GpxFile(QString fname, bool purgeEmpty, Reader reader) : _time(QDateTime()),
+                                                                  _statsValid(false),
+                                                                  _distanceModel(UtmDistance),
+                                                                  _offsets(1, 0), _offsetsValid(1),
+                                                                  _indexValid(false), _namesValid(false) {
+    readFile(fname, purgeEmpty, reader);
 }
     
 void GpxFile::toXml(QString &xmlStr) {
-    xmlStr += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
-        "<gpx version=\"1.0\" creator=\"Whatever\" "
-        "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
-        "xmlns=\"http://www.topografix.com/GPX/1/0\" "
-        "xsi:schemaLocation=\"http://www.topografix.com/GPX/1/0 "
-        "http://www.topografix.com/GPX/1/0/gpx.xsd\">";
-    if (_time.isValid()) {
-        xmlStr += "<time>" + _time.toString(Qt::ISODate) + "</time>";
-    }
-    for (int i=0; i<track_segments.size(); ++i) {
-        track_segments[i].toXml(xmlStr);
-    }
-    xmlStr += "</gpx>\n";
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+
+    GpxWriter writer(&buffer);
+    writer.write(*this);
+    xmlStr += QString::fromUtf8(bytes.constData(), bytes.size());
 }
 
 double GpxFile::length() {
-    double dist = 0.0;
-    for (int i=0; i< track_segments.size(); ++i) {
-        dist += track_segments[i].length();
-    }
-    return dist;
+    updateStats();
+    return _length;
 }
 
 double GpxFile::maxSpeed() {
-    if (track_segments.size()==0) return 0.0;
-    double maxs = 0.0;
-        
+    updateStats();
+    return _maxSpeed;
+}
+
+void GpxFile::addStats(GpxTrackSegment &seg) {
+    _length += seg.length();
+    _duration += seg.duration();
+    if (seg.maxSpeed() > _maxSpeed) {
+        _maxSpeed = seg.maxSpeed();
+    }
+}
+
+void GpxFile::removeStats(GpxTrackSegment &seg) {
+    _length -= seg.length();
+    _duration -= seg.duration();
+
+    // A maximum can't be taken back out
+    if (seg.maxSpeed() >= _maxSpeed) {
+        _statsValid = false;
+    }
+}
+
+static void cacheStats(GpxTrackSegment *seg) {
+    seg->cacheStats();
+}
+
+void GpxFile::cacheSegmentStats() {
+    if (parallelPoints < 0 || pointCount() < parallelPoints) return;
+
+    QList<GpxTrackSegment*> stale;
     for (int i=0; i<track_segments.size(); ++i) {
-        double spd = track_segments[i].maxSpeed();
-        if (spd > maxs) {
-            maxs = spd;
+        if (!track_segments[i].statsCached()) {
+            stale.push_back(&track_segments[i]);
         }
     }
-    return maxs;
+
+    // Each task only touches its own segment
+    if (stale.size() > 1) {
+        QtConcurrent::blockingMap(stale, cacheStats);
+    }
+}
+
+void GpxFile::updateStats() {
+    if (_statsValid && _distanceModel == gpxDistanceModel()) return;
+
+    cacheSegmentStats();
+
+    _length = 0.0;
+    _maxSpeed = 0.0;
+    _duration = 0;
+    for (int i=0; i<track_segments.size(); ++i) {
+        addStats(track_segments[i]);
+    }
+    _statsValid = true;
+    _distanceModel = gpxDistanceModel();
+}
+
+void GpxFile::segmentChanged(int n) {
+    _statsValid = false;
+    invalidateOffsets(n);
+}
+
+void GpxFile::invalidateOffsets(int n) {
+    if (_offsetsValid > n+1) {
+        _offsetsValid = n+1;
+    }
+    _indexValid = false;
+    _namesValid = false;
+}
+
+void GpxFile::updateOffsets() {
+    int n = track_segments.size();
+
+    // Removing the last segments, or reloading, leaves stale entries
+    // past the end
+    if (_offsets.size() != n+1) {
+        _offsets.resize(n+1);
+    }
+    if (_offsetsValid == n+1) return;
+
+    for (int i=_offsetsValid; i<=n; ++i) {
+        _offsets[i] = _offsets[i-1] + track_segments[i-1].pointCount();
+    }
+    _offsetsValid = n+1;
 }
 
 GpxTrackSegment& GpxFile::track(int n) {
     assert(n< track_segments.size());
+    segmentChanged(n);
+    return track_segments[n];
+}
+
+const GpxTrackSegment &GpxFile::at(int n) const {
+    assert(n < track_segments.size());
     return track_segments[n];
 }
+
 GpxTrackSegment& GpxFile::operator[](int n) {
     return track(n);
 }
 
-GpxPoint& GpxFile::point(int n) {
-    int nn = n;
-    for (int i=0; i<track_segments.size(); ++i) {
-        if (track_segments[i].pointCount()>nn) {
-            return track_segments[i][nn];
-        } else {
-            nn -= track_segments[i].pointCount();
-        }
-    }
-    assert(nn==0);
-    return track_segments[0][0];
+GpxPointRef GpxFile::point(int n) {
+    int seg = segmentOf(n);
+    return track_segments[seg][n - _offsets[seg]];
 }
-GpxPoint& GpxFile::operator()(int n) {
+GpxPointRef GpxFile::operator()(int n) {
     return point(n);
 }
 
+int GpxFile::segmentOf(int n) {
+    updateOffsets();
+    assert(n >= 0 && n < _offsets.last());
+
+    // Last segment starting at or before n.  Empty segments share
+    // their start with the next one, so they're never picked.
+    return qUpperBound(_offsets.constBegin(), _offsets.constEnd(), n) - _offsets.constBegin() - 1;
+}
+
+QVector<GpxSpan> GpxFile::spans(int first, int count) {
+    QVector<GpxSpan> rv;
+    if (count <= 0) return rv;
+
+    int seg = segmentOf(first);
+    int end = first + count;
+    assert(end <= _offsets.last());
+
+    while (first < end) {
+        int segEnd = qMin(_offsets[seg+1], end);
+        if (segEnd > first) {
+            GpxSpan span = { seg, first - _offsets[seg], segEnd - first };
+            rv.push_back(span);
+            first = segEnd;
+        }
+        ++seg;
+    }
+    return rv;
+}
+
 void GpxFile::addTrack(const GpxTrackSegment &seg) {
     track_segments.push_back(seg);
+    invalidateOffsets(track_segments.size()-1);
+    if (_statsValid) {
+        addStats(track_segments.last());
+    }
 }
 
 void GpxFile::addPoint(const GpxPoint &pt, int track) {
@@ -102,14 +225,16 @@ void GpxFile::addPoint(const GpxPoint &pt, int track) {
                 
     assert(track < track_segments.size());
 
+    segmentChanged(track);
     track_segments[track].addPoint(pt);
 }
 
 GpxTrackSegment &GpxFile::lastSegment() {
     assert(track_segments.size()>0);
+    segmentChanged(track_segments.size()-1);
     return track_segments[track_segments.size()-1];
 }
-GpxPoint &GpxFile::lastPoint() {
+GpxPointRef GpxFile::lastPoint() {
     assert(track_segments.size()>0);
     return track_segments[track_segments.size()-1].lastPoint();
 }
@@ -117,57 +242,124 @@ GpxPoint &GpxFile::lastPoint() {
 void GpxFile::setTime(QDateTime time) {
     _time = time;
 }
-QDateTime GpxFile::time() {
+QDateTime GpxFile::time() const {
     return _time;
 }
 
 
-int GpxFile::segmentCount() {
+int GpxFile::segmentCount() const {
     return track_segments.size();
 }
 int GpxFile::pointCount() {
-    int cnt=0;
-    for (int i=0; i<track_segments.size(); ++i) {
-        cnt += track_segments[i].pointCount();
-    }
-    return cnt;
+    updateOffsets();
+    return _offsets.last();
 }
 
 time_t GpxFile::duration() {
-    time_t dur=0;
-    for (int i=0; i<track_segments.size(); ++i) {
-        dur += track_segments[i].duration();
-    }
-    return dur;
+    updateStats();
+    return _duration;
 }
 
 void GpxFile::purgeEmptyTracks() {
     for (int i=0; i<track_segments.size(); ++i) {
         if (track_segments[i].pointCount()==0) {
+            invalidateOffsets(i);
             track_segments.removeAt(i);
             --i;
         }
     }
 }
     
-bool GpxFile::readFile(QString fname, bool pe) {
-    GpxParser handler(*this);
+bool GpxFile::load(QString fname, bool purgeEmpty, Reader reader, GpxLoadProgress *progress) {
+    track_segments.clear();
+    _time = QDateTime();
+    _statsValid = false;
+    _offsetsValid = 1;
+    _indexValid = false;
+    _namesValid = false;
+    return readFile(fname, purgeEmpty, reader, progress);
+}
+
+QString GpxFile::errorString() const {
+    return _error;
+}
+
+bool GpxFile::readFile(QString fname, bool pe, Reader rdr, GpxLoadProgress *progress) {
     QFile file( fname );
-    QXmlInputSource source( &file );
+    _error = QString();
+
+    // Binary track files are recognized whichever reader was asked for
+    if (GpxBinaryReader::isBinary(file)) {
+        GpxBinaryReader binary(*this);
+        binary.setProgress(progress);
+        bool rv = binary.parse(file);
+        if (!rv) _error = binary.errorString();
+        if (rv && progress) progress->completed(*this);
+        if (pe) purgeEmptyTracks();
+        return rv;
+    }
 
-    QXmlSimpleReader reader;
-    reader.setFeature("http://trolltech.com/xml/features/report-whitespace-only-CharData", false);
-    reader.setContentHandler( &handler );
-    reader.parse( source );
+    if (!file.isOpen()) {
+        _error = file.errorString();
+        return false;
+    }
 
+    bool rv = true;
+
+    if (rdr == MappedReader) {
+        GpxMappedReader mapped(*this);
+        mapped.setProgress(progress);
+        if (!mapped.parse(file)) {
+            if (progress && progress->isCancelled()) {
+                if (pe) purgeEmptyTracks();
+                _error = mapped.errorString();
+                return false;
+            }
+            // Anything the scanner can't handle goes through a real XML parser
+            track_segments.clear();
+            _time = QDateTime();
+            _statsValid = false;
+            _offsetsValid = 1;
+            _indexValid = false;
+            _namesValid = false;
+            file.close();
+            rdr = StreamReader;
+        }
+    }
+
+    if (rdr == StreamReader) {
+        if (file.isOpen() || file.open(QIODevice::ReadOnly)) {
+            GpxStreamParser parser(*this);
+            parser.setProgress(progress);
+            rv = parser.parse(&file);
+            if (!rv) _error = parser.errorString();
+        } else {
+            rv = false;
+            _error = file.errorString();
+        }
+
+    } else if (rdr == SaxReader) {
+        GpxParser handler(*this, progress, &file);
+        QXmlInputSource source( &file );
+
+        QXmlSimpleReader reader;
+        reader.setFeature("http://trolltech.com/xml/features/report-whitespace-only-CharData", false);
+        reader.setContentHandler( &handler );
+        reader.setErrorHandler( &handler );
+        rv = reader.parse( source );
+        if (!rv) _error = handler.errorString();
+    }
+
+    if (rv && progress) progress->completed(*this);
     if (pe) purgeEmptyTracks();
 
-    return true;
+    return rv;
 }
 
 void GpxFile::boundLatLon(double &minLat, double &minLon, double &minEle,
                           double &maxLat, double &maxLon, double &maxEle) {
     assert(track_segments.size()>0);
+    cacheSegmentStats();
 
     double tminLat, tminLon, tminEle, tmaxLat, tmaxLon, tmaxEle;
 
@@ -191,6 +383,7 @@ void GpxFile::boundLatLon(double &minLat, double &minLon, double &minEle,
 void GpxFile::boundUTM(double &minX, double &minY, double &minEle,
                        double &maxX, double &maxY, double &maxEle) {
     assert(track_segments.size()>0);
+    cacheSegmentStats();
 
     double tminX, tminY, tminEle, tmaxX, tmaxY, tmaxEle;
 
@@ -213,50 +406,134 @@ void GpxFile::boundUTM(double &minX, double &minY, double &minEle,
 }
 void GpxFile::removeTrack(int idx) {
   assert(idx>0 && idx < track_segments.size());
+  if (_statsValid) removeStats(track_segments[idx]);
+  invalidateOffsets(idx);
   track_segments.removeAt(idx);
 }
 
 void GpxFile::removeTrackByName(QString name) {
-    for (int i=0; i<track_segments.size(); ++i) {
-        if (track_segments[i].name() == name) {
-            track_segments.removeAt(i);
-            return;
-        }
-    }
+    int i = segmentIndex(name);
+    if (i < 0) return;
+
+    if (_statsValid) removeStats(track_segments[i]);
+    invalidateOffsets(i);
+    track_segments.removeAt(i);
 }
 
 void GpxFile::removeTracksByName(QStringList names) {
+    // How many more segments with each name to remove
+    QHash<QString, int> counts;
     for (int i=0; i<names.size(); ++i) {
-        removeTrackByName(names[i]);
+        counts[names[i]] += 1;
     }
+
+    QVector<bool> removed(track_segments.size(), false);
+    for (int i=0; i<track_segments.size(); ++i) {
+        QString name = track_segments[i].name();
+        if (counts.value(name, 0) > 0) {
+            counts[name] -= 1;
+            if (_statsValid) removeStats(track_segments[i]);
+            removed[i] = true;
+        }
+    }
+    removeSegments(removed);
 }
 
 void GpxFile::mergeTracksByName(QStringList names) {
     assert(names.size()>0 && track_segments.size()>0);
-    
-    int mergingTo = -1;
-    for (int i=0; i<track_segments.size(); ++i) {
-        if (track_segments[i].name() == names[0]) {
-            mergingTo = i;
-            break;
+
+    int mergingTo = segmentIndex(names[0]);
+    if (mergingTo == -1) return;
+
+    // Every other segment with one of the names, in order, found in one
+    // pass instead of searching for each name
+    QHash<QString, QVector<int> > found;
+    for (int i=1; i<names.size(); ++i) {
+        found.insert(names[i], QVector<int>());
+    }
+    for (int j=0; j<track_segments.size(); ++j) {
+        QString name = track_segments[j].name();
+        if (j != mergingTo && found.contains(name)) {
+            found[name].push_back(j);
         }
     }
+
+    // How far into each name's list the merge has got
+    QHash<QString, int> used;
+    QVector<bool> removed(track_segments.size(), false);
+    bool merged = false;
     for (int i=1; i<names.size(); ++i) {
-        for (int j=0; j<track_segments.size(); ++j) {
-            if (names[i] == track_segments[j].name()) {
-                track_segments[mergingTo].merge(track_segments[j]);
-                track_segments.removeAt(j);
-                break;
-            }
+        const QVector<int> &candidates = found[names[i]];
+        int next = used.value(names[i], 0);
+        if (next >= candidates.size()) continue;
+        used[names[i]] = next+1;
+
+        int j = candidates[next];
+        GpxTrackSegment &target = track_segments[mergingTo];
+
+        // The merged segment's maximum covers both, so only the sums
+        // need taking back out
+        if (_statsValid) {
+            _length -= target.length() + track_segments[j].length();
+            _duration -= target.duration() + track_segments[j].duration();
         }
+        target.merge(track_segments[j]);
+        if (_statsValid) {
+            addStats(target);
+        }
+        removed[j] = true;
+        merged = true;
     }
+    if (!merged) return;
+
+    invalidateOffsets(mergingTo);
+    removeSegments(removed);
 }
 
-GpxTrackSegment GpxFile::segmentByName(QString name) {
+void GpxFile::removeSegments(const QVector<bool> &removed) {
+    // Kept segments are swapped down over the removed ones, so nothing
+    // is copied and the list is only walked once
+    int first = -1;
+    int kept = 0;
     for (int i=0; i<track_segments.size(); ++i) {
-        if (track_segments[i].name() == name) {
-            return track_segments[i];
+        if (removed[i]) {
+            if (first < 0) first = i;
+            continue;
+        }
+        if (kept != i) {
+            track_segments.swap(kept, i);
+        }
+        ++kept;
+    }
+    if (first < 0) return;
+
+    invalidateOffsets(first);
+    while (track_segments.size() > kept) {
+        track_segments.removeLast();
+    }
+}
+
+const GpxSpatialIndex &GpxFile::spatialIndex() {
+    if (!_indexValid) {
+        _index.build(track_segments);
+        _indexValid = true;
+    }
+    return _index;
+}
+
+int GpxFile::segmentIndex(QString name) {
+    if (!_namesValid) {
+        _names.clear();
+        for (int i=track_segments.size()-1; i>=0; --i) {
+            _names.insert(track_segments[i].name(), i);
         }
+        _namesValid = true;
     }
-    return GpxTrackSegment();
+    return _names.value(name, -1);
+}
+
+const GpxTrackSegment &GpxFile::segmentByName(QString name) {
+    static const GpxTrackSegment none;
+    int i = segmentIndex(name);
+    return i < 0 ? none : track_segments[i];
 }
@@ -19,21 +19,54 @@
 
 #include "gpxtracksegment.h"
 #include "gpxpoint.h"
+#include "gpxloadprogress.h"
+#include "gpxspatialindex.h"
+#include "fastparse.h"
 
 #include "gpxelement.h"
 #include "track.h"
 
 #include <QList>
+#include <QVector>
 #include <QDateTime>
 #include <QMap>
+#include <QHash>
 #include <QString>
 
 #include <QtXml>
 
+// A run of consecutive points within one segment
+struct GpxSpan {
+    int segment;
+    // Index of the first point within the segment
+    int offset;
+    int count;
+};
+
 class GpxFile : public GpxElement, public Track {
 public:
+    // Parser engines that can be used to read a file
+    enum Reader {
+        // QXmlSimpleReader SAX parser
+        SaxReader,
+        // QXmlStreamReader pull parser with interned tag names
+        StreamReader,
+        // Hand written scanner over a memory mapped UTF-8 file
+        MappedReader
+    };
+
+    GpxFile();
     GpxFile(GpxTrackSegment &seg);
-    GpxFile(QString fname, bool purgeEmpty = true);
+    GpxFile(QString fname, bool purgeEmpty = true, Reader reader = StreamReader);
+
+    // Replace the contents with fname.  Returns false, with the reason in
+    // errorString(), if the file couldn't be opened or wasn't valid GPX;
+    // whatever was read before the error is kept.
+    // If progress is given, the reader reports to it as it goes and stops
+    // if it's cancelled.
+    bool load(QString fname, bool purgeEmpty = true, Reader reader = StreamReader,
+              GpxLoadProgress *progress = 0);
+    QString errorString() const;
     
     void toXml(QString &xmlStr);
 
@@ -41,22 +74,38 @@ public:
 
     double maxSpeed();
 
+    // Modifiable segments.  Handing one out drops the cached totals,
+    // point offsets, spatial index and name lookup, which are rebuilt by
+    // the next call that needs them.  So make any changes before the
+    // next call on the file and don't keep the reference past it;
+    // changes made through a kept reference aren't seen by them.
     GpxTrackSegment& operator[](int n);
     GpxTrackSegment& track(int n);
 
-    GpxPoint &operator()(int n);
-    GpxPoint &point(int n);
+    // Read only access, which leaves the cached totals alone
+    const GpxTrackSegment &at(int n) const;
+
+    // Points by index across all segments
+    GpxPointRef operator()(int n);
+    GpxPointRef point(int n);
+
+    // Segment holding point n
+    int segmentOf(int n);
+
+    // The points first .. first+count-1, split at segment boundaries
+    QVector<GpxSpan> spans(int first, int count);
 
     void addTrack(const GpxTrackSegment &seg);
     void addPoint(const GpxPoint &pt, int track=-1);
 
+    // Modifiable like track(), with the same rule
     GpxTrackSegment &lastSegment();
-    GpxPoint &lastPoint();
+    GpxPointRef lastPoint();
 
     void setTime(QDateTime time);
-    QDateTime time();
+    QDateTime time() const;
 
-    int segmentCount();
+    int segmentCount() const;
     int pointCount();
     time_t duration();
     void purgeEmptyTracks();
@@ -64,7 +113,12 @@ public:
     void removeTrack(int idx);
     void removeTrackByName(QString name);
 
+    // Remove the first segment with each name, or the first few if a
+    // name is given more than once, in one pass over the segments
     void removeTracksByName(QStringList names);
+
+    // Append the segments named by names[1] onwards to the first one
+    // called names[0], in the order given, and remove them
     void mergeTracksByName(QStringList names);
 
     void boundLatLon(double &minLat, double &minLon, double &minEle,
@@ -73,11 +127,82 @@ public:
     void boundUTM(double &minX, double &minY, double &minEle,
                   double &maxX, double &maxY, double &maxEle);
 
-    GpxTrackSegment segmentByName(QString name);
+    // Index of the first segment called name, or -1 if there isn't one
+    int segmentIndex(QString name);
+
+    // The first segment called name, or an empty one.  Read only, like
+    // at(), and valid until the file is changed.
+    const GpxTrackSegment &segmentByName(QString name);
+
+    // Index for finding points by position.  Built the first time it's
+    // asked for, and again after any segment is changed, added or
+    // removed.
+    const GpxSpatialIndex &spatialIndex();
+
+    // Files with at least this many points compute their segments'
+    // statistics on the global thread pool, one segment per task, before
+    // combining them.  Defaults to 20000; -1 keeps it all on the calling
+    // thread.
+    static void setParallelThreshold(int points);
+    static int parallelThreshold();
 private:
+    // Fill every segment's length, speed and lat/lon bounds, in parallel
+    // if the file is over the threshold
+    void cacheSegmentStats();
+
+    // Keep the totals up to date as seg is added or removed
+    void addStats(GpxTrackSegment &seg);
+    void removeStats(GpxTrackSegment &seg);
+
+    // Recompute the totals from each segment's cached statistics
+    void updateStats();
+
+    // Called before segment n's points may change
+    void segmentChanged(int n);
+
+    // Segment n's point count changed, or it was added or removed.
+    // Also drops the spatial index and the name lookup.
+    void invalidateOffsets(int n);
+
+    // Drop the segments marked in removed, keeping the rest in order
+    void removeSegments(const QVector<bool> &removed);
+
+    // Bring _offsets up to date
+    void updateOffsets();
+
     QList<GpxTrackSegment> track_segments;
     QDateTime _time;
 
+    // Why the last read failed
+    QString _error;
+
+    // Totals over all segments, valid if _statsValid is set and they
+    // were computed with the current distance model.  Handing out a
+    // modifiable segment clears it, since the caller may change its
+    // points.
+    bool _statsValid;
+    GpxDistanceModel _distanceModel;
+    double _length;
+    double _maxSpeed;
+    time_t _duration;
+
+    // Global index of each segment's first point, followed by the total
+    // point count.  Only the first _offsetsValid entries are current;
+    // changing segment n invalidates everything after it.
+    QVector<int> _offsets;
+    int _offsetsValid;
+
+    // Spatial index over every point, current if _indexValid is set.
+    // Dropped along with the offsets.
+    GpxSpatialIndex _index;
+    bool _indexValid;
+
+    // Index of the first segment with each name, current if _namesValid
+    // is set.  Dropped along with the offsets, and whenever a modifiable
+    // segment is handed out, since its name may change.
+    QHash<QString, int> _names;
+    bool _namesValid;
+
     // Callback handler class required for SAX parsing with Qt
     class GpxParser : public QXmlDefaultHandler {
     private:
@@ -89,12 +214,20 @@ private:
         QString curVal;
 
         double clat, clon, cele;
-        QDateTime ctime;
+        qint64 ctime;
         GpxFile &gpx;
 
+        QString error;
+
+        GpxLoadProgress *progress;
+        QIODevice *device;
+        qint64 size;
+
     public:
         // Clear out the state
-        GpxParser(GpxFile &file) : gpx(file) { }
+        GpxParser(GpxFile &file, GpxLoadProgress *prog = 0, QIODevice *dev = 0) :
+            ctime(GpxPoint::NoTime), gpx(file), progress(prog), device(dev),
+            size(dev ? dev->size() : 0) { }
     
         // Character data can be reported in multiple calls
         // For example <tag>character data</tag>
@@ -122,6 +255,7 @@ private:
                 // Set the latitude and longitude of the current point
                 clat = attrs.value("lat").toDouble();
                 clon = attrs.value("lon").toDouble();
+                ctime = GpxPoint::NoTime;
             }
 
             return true;
@@ -131,12 +265,19 @@ private:
             
             // Also mostly just keeping track of state
             if (name == "time") {
+                // Parsed like the other readers, so times without a
+                // zone are UTC
+                const ushort *b = curVal.utf16();
+                qint64 msecs;
+                if (!parseIsoTime(b, b+curVal.size(), msecs)) {
+                    msecs = GpxPoint::NoTime;
+                }
 
                 if (curState["trkpt"]) {
-                    ctime = QDateTime::fromString(curVal,Qt::ISODate);
+                    ctime = msecs;
 
                 } else {
-                    gpx.setTime(QDateTime::fromString(curVal,Qt::ISODate));
+                    gpx.setTime(GpxPoint::toDateTime(msecs));
                 }
             
             } else if (name == "name") {
@@ -162,11 +303,27 @@ private:
 
             curState[name] = false;
 
+            if (progress && !progress->report(device->pos(), size, gpx)) {
+                error = "Cancelled";
+                return false;
+            }
             return true;
         }
+
+        bool fatalError( const QXmlParseException &exception ) {
+            // Stopping from a handler is also reported as a fatal error
+            if (error.isEmpty()) {
+                error = QString("%1 at line %2").arg(exception.message()).arg(exception.lineNumber());
+            }
+            return false;
+        }
+
+        QString errorString() const {
+            return error;
+        }
     };
     
-    bool readFile(QString fname, bool purge);
+    bool readFile(QString fname, bool purge, Reader reader, GpxLoadProgress *progress = 0);
 };
 
 #endif
@@ -0,0 +1,357 @@
+// gpxkernels.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "gpxkernels.h"
+#include "gpxpoint.h"
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GPX_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// The min/max kernels all keep four running minimums and maximums
+// (lanes 0-3), fold lanes 2,3 into 0,1, then 1 into 0, then apply the
+// leftover elements.  Doing exactly the same comparisons in the same
+// order is what makes the results bit-identical, including for
+// signed zeros.  MINPD(a, b) is "a < b ? a : b", as is the scalar
+// version here.
+
+namespace {
+
+inline double minOf(double v, double acc) {
+    return v < acc ? v : acc;
+}
+inline double maxOf(double v, double acc) {
+    return v > acc ? v : acc;
+}
+
+inline double stepLength(const double *x, const double *y, const double *z, int i) {
+    double dx = x[i+1] - x[i];
+    double dy = y[i+1] - y[i];
+    double dz = z[i+1] - z[i];
+    return std::sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+// A step only has a speed if both points have a time and it moves
+// forward.  The others count as 0; the vector kernels mask them out.
+inline double stepSpeed(const double *x, const double *y, const double *z,
+                        const qint64 *t, int i) {
+    qint64 t0 = t[i], t1 = t[i+1];
+    if (t0 == GpxPoint::NoTime || t1 == GpxPoint::NoTime || t1 <= t0) return 0.0;
+    return stepLength(x, y, z, i) / (double(t1 - t0) / 1000.0);
+}
+
+// Fold four lanes and the tail into the final result
+void finishMinMax(const double *v, int i, int n,
+                  const double lo[4], const double hi[4],
+                  double &minV, double &maxV) {
+    double lo0 = minOf(lo[2], lo[0]);
+    double lo1 = minOf(lo[3], lo[1]);
+    double hi0 = maxOf(hi[2], hi[0]);
+    double hi1 = maxOf(hi[3], hi[1]);
+    minV = minOf(lo1, lo0);
+    maxV = maxOf(hi1, hi0);
+    for (; i<n; ++i) {
+        minV = minOf(v[i], minV);
+        maxV = maxOf(v[i], maxV);
+    }
+}
+
+void minMaxScalar(const double *v, int n, double &minV, double &maxV) {
+    double lo[4] = { v[0], v[0], v[0], v[0] };
+    double hi[4] = { v[0], v[0], v[0], v[0] };
+
+    int i = 0;
+    for (; i+4 <= n; i += 4) {
+        for (int l=0; l<4; ++l) {
+            lo[l] = minOf(v[i+l], lo[l]);
+            hi[l] = maxOf(v[i+l], hi[l]);
+        }
+    }
+    finishMinMax(v, i, n, lo, hi, minV, maxV);
+}
+
+double pathLengthScalar(const double *x, const double *y, const double *z, int n) {
+    double dist = 0.0;
+    for (int i=0; i<n-1; ++i) {
+        dist += stepLength(x, y, z, i);
+    }
+    return dist;
+}
+
+double maxSpeedScalar(const double *x, const double *y, const double *z,
+                      const qint64 *t, int n) {
+    double curMax = 0.0;
+    for (int i=0; i<n-1; ++i) {
+        curMax = maxOf(stepSpeed(x, y, z, t, i), curMax);
+    }
+    return curMax;
+}
+
+#ifdef GPX_KERNELS_X86
+
+// 1.5 * 2^52.  Adding an integer below 2^51 to its bit pattern and
+// subtracting it as a double converts int64 to double, which SSE2 and
+// AVX2 have no instruction for.
+const double magic = 6755399441055744.0;
+
+__attribute__((target("sse2")))
+void minMaxSse2(const double *v, int n, double &minV, double &maxV) {
+    __m128d lo01 = _mm_set1_pd(v[0]), lo23 = lo01;
+    __m128d hi01 = lo01, hi23 = lo01;
+
+    int i = 0;
+    for (; i+4 <= n; i += 4) {
+        __m128d a = _mm_loadu_pd(v+i);
+        __m128d b = _mm_loadu_pd(v+i+2);
+        lo01 = _mm_min_pd(a, lo01);
+        lo23 = _mm_min_pd(b, lo23);
+        hi01 = _mm_max_pd(a, hi01);
+        hi23 = _mm_max_pd(b, hi23);
+    }
+
+    double lo[4], hi[4];
+    _mm_storeu_pd(lo, lo01);
+    _mm_storeu_pd(lo+2, lo23);
+    _mm_storeu_pd(hi, hi01);
+    _mm_storeu_pd(hi+2, hi23);
+    finishMinMax(v, i, n, lo, hi, minV, maxV);
+}
+
+__attribute__((target("sse2")))
+inline __m128d stepLengthSse2(const double *x, const double *y, const double *z, int i) {
+    __m128d dx = _mm_sub_pd(_mm_loadu_pd(x+i+1), _mm_loadu_pd(x+i));
+    __m128d dy = _mm_sub_pd(_mm_loadu_pd(y+i+1), _mm_loadu_pd(y+i));
+    __m128d dz = _mm_sub_pd(_mm_loadu_pd(z+i+1), _mm_loadu_pd(z+i));
+    __m128d sq = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+    return _mm_sqrt_pd(sq);
+}
+
+// SSE2 has no 64 bit compare, so both 32 bit halves must be equal
+__attribute__((target("sse2")))
+inline __m128i equal64Sse2(__m128i a, __m128i b) {
+    __m128i eq = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+__attribute__((target("sse2")))
+double pathLengthSse2(const double *x, const double *y, const double *z, int n) {
+    __m128d sum = _mm_setzero_pd();
+
+    int steps = n-1;
+    int i = 0;
+    for (; i+2 <= steps; i += 2) {
+        sum = _mm_add_pd(sum, stepLengthSse2(x, y, z, i));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, sum);
+    double dist = lanes[0] + lanes[1];
+    for (; i<steps; ++i) {
+        dist += stepLength(x, y, z, i);
+    }
+    return dist;
+}
+
+__attribute__((target("sse2")))
+double maxSpeedSse2(const double *x, const double *y, const double *z,
+                    const qint64 *t, int n) {
+    const __m128i magicBits = _mm_castpd_si128(_mm_set1_pd(magic));
+    const __m128d magicD = _mm_set1_pd(magic);
+    const __m128d thousand = _mm_set1_pd(1000.0);
+    const __m128i noTime = _mm_set1_epi64x(GpxPoint::NoTime);
+    __m128d curMax = _mm_setzero_pd();
+
+    int steps = n-1;
+    int i = 0;
+    for (; i+2 <= steps; i += 2) {
+        __m128i t0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t+i));
+        __m128i t1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t+i+1));
+        __m128i dt = _mm_add_epi64(_mm_sub_epi64(t1, t0), magicBits);
+        __m128d secs = _mm_div_pd(_mm_sub_pd(_mm_castsi128_pd(dt), magicD), thousand);
+
+        __m128i missing = _mm_or_si128(equal64Sse2(t0, noTime), equal64Sse2(t1, noTime));
+        __m128d forward = _mm_cmpgt_pd(secs, _mm_setzero_pd());
+        __m128d valid = _mm_andnot_pd(_mm_castsi128_pd(missing), forward);
+
+        __m128d spd = _mm_and_pd(_mm_div_pd(stepLengthSse2(x, y, z, i), secs), valid);
+        curMax = _mm_max_pd(spd, curMax);
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, curMax);
+    double rv = maxOf(lanes[1], lanes[0]);
+    for (; i<steps; ++i) {
+        rv = maxOf(stepSpeed(x, y, z, t, i), rv);
+    }
+    return rv;
+}
+
+__attribute__((target("avx2")))
+void minMaxAvx2(const double *v, int n, double &minV, double &maxV) {
+    __m256d lo = _mm256_set1_pd(v[0]);
+    __m256d hi = lo;
+
+    int i = 0;
+    for (; i+4 <= n; i += 4) {
+        __m256d a = _mm256_loadu_pd(v+i);
+        lo = _mm256_min_pd(a, lo);
+        hi = _mm256_max_pd(a, hi);
+    }
+
+    double los[4], his[4];
+    _mm256_storeu_pd(los, lo);
+    _mm256_storeu_pd(his, hi);
+    finishMinMax(v, i, n, los, his, minV, maxV);
+}
+
+__attribute__((target("avx2")))
+inline __m256d stepLengthAvx2(const double *x, const double *y, const double *z, int i) {
+    __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x+i+1), _mm256_loadu_pd(x+i));
+    __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y+i+1), _mm256_loadu_pd(y+i));
+    __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(z+i+1), _mm256_loadu_pd(z+i));
+    __m256d sq = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+                               _mm256_mul_pd(dz, dz));
+    return _mm256_sqrt_pd(sq);
+}
+
+__attribute__((target("avx2")))
+double pathLengthAvx2(const double *x, const double *y, const double *z, int n) {
+    __m256d sum = _mm256_setzero_pd();
+
+    int steps = n-1;
+    int i = 0;
+    for (; i+4 <= steps; i += 4) {
+        sum = _mm256_add_pd(sum, stepLengthAvx2(x, y, z, i));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum);
+    double dist = (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+    for (; i<steps; ++i) {
+        dist += stepLength(x, y, z, i);
+    }
+    return dist;
+}
+
+__attribute__((target("avx2")))
+double maxSpeedAvx2(const double *x, const double *y, const double *z,
+                    const qint64 *t, int n) {
+    const __m256i magicBits = _mm256_castpd_si256(_mm256_set1_pd(magic));
+    const __m256d magicD = _mm256_set1_pd(magic);
+    const __m256d thousand = _mm256_set1_pd(1000.0);
+    const __m256i noTime = _mm256_set1_epi64x(GpxPoint::NoTime);
+    __m256d curMax = _mm256_setzero_pd();
+
+    int steps = n-1;
+    int i = 0;
+    for (; i+4 <= steps; i += 4) {
+        __m256i t0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t+i));
+        __m256i t1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t+i+1));
+        __m256i dt = _mm256_add_epi64(_mm256_sub_epi64(t1, t0), magicBits);
+        __m256d secs = _mm256_div_pd(_mm256_sub_pd(_mm256_castsi256_pd(dt), magicD), thousand);
+
+        __m256i missing = _mm256_or_si256(_mm256_cmpeq_epi64(t0, noTime),
+                                          _mm256_cmpeq_epi64(t1, noTime));
+        __m256d forward = _mm256_cmp_pd(secs, _mm256_setzero_pd(), _CMP_GT_OQ);
+        __m256d valid = _mm256_andnot_pd(_mm256_castsi256_pd(missing), forward);
+
+        __m256d spd = _mm256_and_pd(_mm256_div_pd(stepLengthAvx2(x, y, z, i), secs), valid);
+        curMax = _mm256_max_pd(spd, curMax);
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, curMax);
+    double rv = maxOf(maxOf(lanes[3], lanes[1]), maxOf(lanes[2], lanes[0]));
+    for (; i<steps; ++i) {
+        rv = maxOf(stepSpeed(x, y, z, t, i), rv);
+    }
+    return rv;
+}
+
+#endif
+
+typedef void (*MinMaxFn)(const double *, int, double &, double &);
+typedef double (*PathLengthFn)(const double *, const double *, const double *, int);
+typedef double (*MaxSpeedFn)(const double *, const double *, const double *, const qint64 *, int);
+
+struct Kernels {
+    GpxKernelIsa isa;
+    MinMaxFn minMax;
+    PathLengthFn pathLength;
+    MaxSpeedFn maxSpeed;
+};
+
+GpxKernelIsa bestIsa() {
+#ifdef GPX_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return Avx2Kernels;
+    if (__builtin_cpu_supports("sse2")) return Sse2Kernels;
+#endif
+    return ScalarKernels;
+}
+
+Kernels kernelsFor(GpxKernelIsa isa) {
+    Kernels k = { ScalarKernels, minMaxScalar, pathLengthScalar, maxSpeedScalar };
+#ifdef GPX_KERNELS_X86
+    if (isa == Avx2Kernels) {
+        Kernels avx2 = { Avx2Kernels, minMaxAvx2, pathLengthAvx2, maxSpeedAvx2 };
+        k = avx2;
+    } else if (isa == Sse2Kernels) {
+        Kernels sse2 = { Sse2Kernels, minMaxSse2, pathLengthSse2, maxSpeedSse2 };
+        k = sse2;
+    }
+#else
+    Q_UNUSED(isa);
+#endif
+    return k;
+}
+
+// Picked on first use.  Initialization of a function local static
+// isn't guaranteed to be thread safe on every compiler we build with,
+// but the result is the same whichever thread gets there first.
+Kernels &kernels() {
+    static Kernels k = kernelsFor(bestIsa());
+    return k;
+}
+
+}
+
+GpxKernelIsa gpxKernelIsa() {
+    return kernels().isa;
+}
+
+void setGpxKernelIsa(GpxKernelIsa isa) {
+    GpxKernelIsa best = bestIsa();
+    kernels() = kernelsFor(isa < best ? isa : best);
+}
+
+void gpxMinMax(const double *v, int n, double &minV, double &maxV) {
+    kernels().minMax(v, n, minV, maxV);
+}
+
+double gpxPathLength(const double *x, const double *y, const double *z, int n) {
+    if (n < 2) return 0.0;
+    return kernels().pathLength(x, y, z, n);
+}
+
+double gpxMaxSpeed(const double *x, const double *y, const double *z,
+                   const qint64 *t, int n) {
+    if (n < 2) return 0.0;
+    return kernels().maxSpeed(x, y, z, t, n);
+}
@@ -0,0 +1,57 @@
+// gpxkernels.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef GPX_KERNELS_H
+#define GPX_KERNELS_H
+
+#include <QtGlobal>
+
+// Reductions over contiguous coordinate arrays.
+// Each has a scalar version plus SSE2 and AVX2 versions on x86; the
+// fastest one the CPU supports is picked the first time any of them
+// is called.
+
+enum GpxKernelIsa {
+    ScalarKernels,
+    Sse2Kernels,
+    Avx2Kernels
+};
+
+// The instruction set currently in use
+GpxKernelIsa gpxKernelIsa();
+
+// Force an instruction set, for testing and benchmarking.
+// Falls back to the best supported one if isa isn't available.
+void setGpxKernelIsa(GpxKernelIsa isa);
+
+// Smallest and largest of v[0] .. v[n-1], n > 0.
+// Elements are compared the same way as "if (v[i] < minV) minV = v[i]",
+// so NaNs after the first element are ignored.  All versions give
+// bit-identical results.
+void gpxMinMax(const double *v, int n, double &minV, double &maxV);
+
+// Sum of the 3D distances between consecutive points.
+// The vector versions add in a different order than the scalar one,
+// so results can differ in the last few bits.
+double gpxPathLength(const double *x, const double *y, const double *z, int n);
+
+// Largest distance over elapsed time between consecutive points, with
+// t in milliseconds and the result in units per second.  Starts from
+// 0.0, and steps with a NaN speed are skipped.
+double gpxMaxSpeed(const double *x, const double *y, const double *z,
+                   const qint64 *t, int n);
+
+#endif
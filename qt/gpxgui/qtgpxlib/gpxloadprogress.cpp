@@ -0,0 +1,43 @@
+// gpxloadprogress.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gpxloadprogress.h"
+
+GpxLoadProgress::GpxLoadProgress(qint64 interval) : interval(interval), next(0), cancelled(0) {
+}
+
+GpxLoadProgress::~GpxLoadProgress() {
+}
+
+void GpxLoadProgress::cancel() {
+    cancelled.fetchAndStoreOrdered(1);
+}
+
+bool GpxLoadProgress::isCancelled() const {
+    return cancelled != 0;
+}
+
+void GpxLoadProgress::reset() {
+    next = 0;
+    cancelled.fetchAndStoreOrdered(0);
+}
+
+void GpxLoadProgress::progress(qint64, qint64, GpxFile &) {
+}
+
+void GpxLoadProgress::completed(GpxFile &) {
+}
@@ -0,0 +1,72 @@
+// gpxloadprogress.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef GPX_LOAD_PROGRESS_H
+#define GPX_LOAD_PROGRESS_H
+
+#include <QAtomicInt>
+#include <QtGlobal>
+
+class GpxFile;
+
+// Progress reports and cancellation for GpxFile::load.
+//
+// The readers report how many bytes of the file they've consumed as
+// they go.  That's cheap enough to do for every element; progress() is
+// only called once another interval's worth of bytes has been read.
+// cancel() may be called from any thread, and the load stops at the
+// reader's next report, failing with "Cancelled" as its error.
+class GpxLoadProgress {
+public:
+    GpxLoadProgress(qint64 interval = 1024*1024);
+    virtual ~GpxLoadProgress();
+
+    void cancel();
+    bool isCancelled() const;
+
+    // Clear the cancel flag before starting another load
+    void reset();
+
+    // Called by the readers with the bytes consumed so far and the size
+    // of the file, or 0 if it isn't known.  Returns false if the load
+    // should stop.
+    bool report(qint64 done, qint64 total, GpxFile &gpx) {
+        if (done >= next) {
+            next = done + interval;
+            progress(done, total, gpx);
+        }
+        return !isCancelled();
+    }
+
+    // Called on the loading thread after the whole file has been read
+    // successfully, before empty segments are purged
+    virtual void completed(GpxFile &gpx);
+
+protected:
+    // Called on the loading thread.  gpx holds everything read so far,
+    // and is still being filled in by the reader, so it may be copied
+    // but not kept.  Points may be removed from its segments, but
+    // segments must not be added or removed.
+    virtual void progress(qint64 done, qint64 total, GpxFile &gpx);
+
+private:
+    qint64 interval;
+    qint64 next;
+    QAtomicInt cancelled;
+};
+
+#endif
@@ -0,0 +1,410 @@
+// gpxmappedreader.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "gpxmappedreader.h"
+#include "gpxfile.h"
+#include "fastparse.h"
+
+#include <QFile>
+#include <QByteArray>
+
+#include <cstring>
+
+namespace {
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline bool isNameEnd(char c) {
+    return isSpace(c) || c == '/' || c == '>';
+}
+
+// Find needle in [p, end), or return 0
+const char *findString(const char *p, const char *end, const char *needle) {
+    int len = std::strlen(needle);
+    while (p && end-p >= len) {
+        p = static_cast<const char*>(std::memchr(p, needle[0], end-p-len+1));
+        if (p == 0) return 0;
+        if (std::memcmp(p, needle, len) == 0) return p;
+        ++p;
+    }
+    return 0;
+}
+
+// Find the '>' closing a tag, skipping over quoted attribute values
+const char *findTagEnd(const char *p, const char *end) {
+    char quote = 0;
+    for (; p < end; ++p) {
+        if (quote) {
+            if (*p == quote) quote = 0;
+        } else if (*p == '"' || *p == '\'') {
+            quote = *p;
+        } else if (*p == '>') {
+            return p;
+        }
+    }
+    return 0;
+}
+
+// Strip the namespace prefix from an element name
+void localName(const char *&name, const char *nameEnd) {
+    for (const char *p = nameEnd-1; p >= name; --p) {
+        if (*p == ':') {
+            name = p+1;
+            return;
+        }
+    }
+}
+
+// Trim whitespace and unwrap a CDATA section around character data
+void trimText(const char *&b, const char *&e) {
+    while (b < e && isSpace(*b)) ++b;
+    while (e > b && isSpace(*(e-1))) --e;
+    if (e-b >= 12 && std::memcmp(b, "<![CDATA[", 9) == 0 && std::memcmp(e-3, "]]>", 3) == 0) {
+        b += 9;
+        e -= 3;
+    }
+}
+
+}
+
+GpxMappedReader::GpxMappedReader(GpxFile &file) : gpx(file), inTrack(false), progress(0),
+                                                  dataEnd(0), textStart(0),
+                                                  openTags(0), clat(0.0), clon(0.0), cele(0.0),
+                                                  ctime(GpxPoint::NoTime) {
+}
+
+QString GpxMappedReader::errorString() const {
+    return error;
+}
+
+void GpxMappedReader::setProgress(GpxLoadProgress *p) {
+    progress = p;
+}
+
+bool GpxMappedReader::parse(QFile &file) {
+    if (!file.isOpen() && !file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    qint64 size = file.size();
+    if (size == 0) {
+        error = QString("%1 is empty").arg(file.fileName());
+        return false;
+    }
+
+    uchar *data = file.map(0, size);
+    if (data) {
+        const char *begin = reinterpret_cast<const char*>(data);
+        bool rv = parse(begin, begin+size);
+        file.unmap(data);
+        return rv;
+    }
+
+    // Not something that can be mapped, so read it instead
+    QByteArray bytes = file.readAll();
+    return parse(bytes.constData(), bytes.constData()+bytes.size());
+}
+
+bool GpxMappedReader::parse(const char *begin, const char *end) {
+    dataEnd = end;
+    textStart = begin;
+    openTags = 0;
+    inTrack = false;
+    error = QString();
+
+    if (!checkEncoding(begin, end)) {
+        return false;
+    }
+
+    const char *p = begin;
+    while (p) {
+        p = static_cast<const char*>(std::memchr(p, '<', end-p));
+        if (p == 0) break;
+
+        if (end-p < 2) {
+            error = "Unexpected end of file";
+            return false;
+        }
+
+        if (p[1] == '/') {
+            p = endTag(p);
+        } else if (p[1] == '?' || p[1] == '!') {
+            p = skipMarkup(p);
+        } else {
+            p = startTag(p);
+        }
+        if (p == 0) {
+            if (error.isEmpty()) error = "Unterminated markup";
+            return false;
+        }
+        if (progress && !progress->report(p-begin, end-begin, gpx)) {
+            error = "Cancelled";
+            return false;
+        }
+    }
+
+    if (isOpen(TagGpx)) {
+        error = "Unexpected end of file";
+        return false;
+    }
+    return true;
+}
+
+// Only UTF-8 and its ASCII subset can be read directly
+bool GpxMappedReader::checkEncoding(const char *p, const char *end) {
+    if (end-p >= 2 && ((uchar(p[0]) == 0xfe && uchar(p[1]) == 0xff) ||
+                       (uchar(p[0]) == 0xff && uchar(p[1]) == 0xfe))) {
+        error = "UTF-16 files are not supported";
+        return false;
+    }
+    if (end-p >= 3 && uchar(p[0]) == 0xef && uchar(p[1]) == 0xbb && uchar(p[2]) == 0xbf) {
+        p += 3;
+    }
+    if (end-p < 5 || std::memcmp(p, "<?xml", 5) != 0) {
+        return true;
+    }
+
+    const char *declEnd = findString(p, end, "?>");
+    if (declEnd == 0) {
+        error = "Unterminated XML declaration";
+        return false;
+    }
+    const char *enc = findString(p, declEnd, "encoding");
+    if (enc == 0) {
+        return true;
+    }
+    const char *quote = enc + 8;
+    while (quote < declEnd && *quote != '"' && *quote != '\'') ++quote;
+    if (quote == declEnd) {
+        return true;
+    }
+    const char *valEnd = static_cast<const char*>(std::memchr(quote+1, *quote, declEnd-quote-1));
+    if (valEnd == 0) {
+        return true;
+    }
+
+    QByteArray name = QByteArray(quote+1, valEnd-quote-1).toLower();
+    if (name == "utf-8" || name == "utf8" || name == "us-ascii" || name == "ascii") {
+        return true;
+    }
+    error = QString("Unsupported encoding %1").arg(QString::fromLatin1(name.constData()));
+    return false;
+}
+
+const char *GpxMappedReader::startTag(const char *p) {
+    const char *name = p+1;
+    const char *nameEnd = name;
+    while (nameEnd < dataEnd && !isNameEnd(*nameEnd)) ++nameEnd;
+
+    const char *gt = findTagEnd(nameEnd, dataEnd);
+    if (gt == 0) return 0;
+
+    localName(name, nameEnd);
+    GpxTag tag = gpxTag(name, nameEnd-name);
+
+    openElement(tag);
+    if (tag == TagTrkpt) {
+        parseTrkptAttributes(nameEnd, gt);
+    }
+    textStart = gt+1;
+
+    // <tag/> opens and closes with no character data
+    if (*(gt-1) == '/') {
+        closeElement(tag, textStart);
+    }
+    return gt+1;
+}
+
+const char *GpxMappedReader::endTag(const char *p) {
+    const char *name = p+2;
+    const char *nameEnd = name;
+    while (nameEnd < dataEnd && !isNameEnd(*nameEnd)) ++nameEnd;
+
+    const char *gt = static_cast<const char*>(std::memchr(nameEnd, '>', dataEnd-nameEnd));
+    if (gt == 0) return 0;
+
+    localName(name, nameEnd);
+    closeElement(gpxTag(name, nameEnd-name), p);
+    return gt+1;
+}
+
+// Skip comments, CDATA, DOCTYPEs and processing instructions.
+// CDATA inside a leaf element is picked up again by closeElement.
+const char *GpxMappedReader::skipMarkup(const char *p) {
+    const char *e;
+    if (p[1] == '?') {
+        e = findString(p, dataEnd, "?>");
+        return e ? e+2 : 0;
+    }
+    if (dataEnd-p >= 4 && std::memcmp(p, "<!--", 4) == 0) {
+        e = findString(p+4, dataEnd, "-->");
+        return e ? e+3 : 0;
+    }
+    if (dataEnd-p >= 9 && std::memcmp(p, "<![CDATA[", 9) == 0) {
+        e = findString(p+9, dataEnd, "]]>");
+        return e ? e+3 : 0;
+    }
+
+    // <!DOCTYPE ...> possibly with an internal subset in []
+    const char *gt = findTagEnd(p, dataEnd);
+    const char *bracket = static_cast<const char*>(std::memchr(p, '[', (gt ? gt : dataEnd)-p));
+    if (bracket) {
+        e = findString(bracket, dataEnd, "]>");
+        return e ? e+2 : 0;
+    }
+    return gt ? gt+1 : 0;
+}
+
+void GpxMappedReader::openElement(GpxTag tag) {
+    openTags |= gpxTagBit(tag);
+
+    switch (tag) {
+    case TagTrk:
+        // Add a new track segment for the points that follow
+        gpx.addTrack(GpxTrackSegment());
+        inTrack = true;
+        break;
+
+    case TagTrkpt:
+        clat = clon = cele = 0.0;
+        ctime = GpxPoint::NoTime;
+        break;
+
+    default:
+        break;
+    }
+}
+
+void GpxMappedReader::closeElement(GpxTag tag, const char *textEnd) {
+    const char *b = textStart;
+    const char *e = textEnd;
+
+    switch (tag) {
+    case TagTime:
+        trimText(b, e);
+        if (isOpen(TagTrkpt)) {
+            if (!parseIsoTime(b, e, ctime)) {
+                ctime = GpxPoint::NoTime;
+            }
+        } else if (!isOpen(TagTrk)) {
+            qint64 msecs;
+            if (parseIsoTime(b, e, msecs)) {
+                gpx.setTime(GpxPoint::toDateTime(msecs));
+            }
+        }
+        break;
+
+    case TagName:
+        if (inTrack && !isOpen(TagTrkpt)) {
+            trimText(b, e);
+            gpx.lastSegment().setName(decodeText(b, e));
+        }
+        break;
+
+    case TagNumber:
+        if (inTrack && !isOpen(TagTrkpt)) {
+            int number = 0;
+            trimText(b, e);
+            parseInt(b, e, number);
+            gpx.lastSegment().setNumber(number);
+        }
+        break;
+
+    case TagEle:
+        if (isOpen(TagTrkpt)) {
+            trimText(b, e);
+            parseDouble(b, e, cele);
+        }
+        break;
+
+    case TagTrkpt:
+        if (inTrack && isOpen(TagTrkseg)) {
+            gpx.addPoint(GpxPoint(clat, clon, cele, ctime));
+        }
+        break;
+
+    case TagTrk:
+        inTrack = false;
+        break;
+
+    default:
+        break;
+    }
+
+    openTags &= ~gpxTagBit(tag);
+}
+
+void GpxMappedReader::parseTrkptAttributes(const char *p, const char *end) {
+    while (p < end) {
+        while (p < end && isSpace(*p)) ++p;
+
+        const char *name = p;
+        while (p < end && *p != '=' && !isSpace(*p)) ++p;
+        const char *nameEnd = p;
+
+        while (p < end && *p != '"' && *p != '\'') ++p;
+        if (p == end) return;
+
+        char quote = *p++;
+        const char *val = p;
+        while (p < end && *p != quote) ++p;
+        if (p == end) return;
+
+        int len = nameEnd-name;
+        if (len == 3 && std::memcmp(name, "lat", 3) == 0) {
+            parseDouble(val, p, clat);
+        } else if (len == 3 && std::memcmp(name, "lon", 3) == 0) {
+            parseDouble(val, p, clon);
+        }
+        ++p;
+    }
+}
+
+// Convert UTF-8 character data to a QString, replacing entity references
+QString GpxMappedReader::decodeText(const char *begin, const char *end) {
+    QString text = QString::fromUtf8(begin, end-begin);
+    if (!text.contains('&')) {
+        return text;
+    }
+
+    QString rv;
+    rv.reserve(text.size());
+    for (int i=0; i<text.size(); ++i) {
+        int semi;
+        if (text[i] != '&' || (semi = text.indexOf(';', i)) < 0) {
+            rv += text[i];
+            continue;
+        }
+
+        QString ent = text.mid(i+1, semi-i-1);
+        if (ent == "amp") rv += '&';
+        else if (ent == "lt") rv += '<';
+        else if (ent == "gt") rv += '>';
+        else if (ent == "quot") rv += '"';
+        else if (ent == "apos") rv += '\'';
+        else if (ent.startsWith("#x")) rv += QChar(ent.mid(2).toUInt(0, 16));
+        else if (ent.startsWith("#")) rv += QChar(ent.mid(1).toUInt());
+        else {
+            rv += text[i];
+            continue;
+        }
+        i = semi;
+    }
+    return rv;
+}
@@ -0,0 +1,87 @@
+// gpxmappedreader.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef GPX_MAPPED_READER_H
+#define GPX_MAPPED_READER_H
+
+#include <QString>
+
+#include "gpxtag.h"
+
+class GpxFile;
+class GpxLoadProgress;
+class GpxTrackSegment;
+class QFile;
+
+// Reader for UTF-8 GPX files that works directly on the bytes of a
+// memory mapped file.  Markup is scanned by hand, and numbers are
+// parsed from byte ranges, so nothing is decoded or copied except
+// track names.  Peak memory is the point data itself; the mapping is
+// backed by the page cache.
+//
+// This is not a validating XML parser.  Comments, CDATA, processing
+// instructions and DOCTYPEs are skipped, and only the predefined and
+// numeric entities are decoded.  Files declaring an encoding other
+// than UTF-8 or ASCII are rejected so the caller can fall back to
+// a real XML parser.
+class GpxMappedReader {
+public:
+    GpxMappedReader(GpxFile &file);
+
+    bool parse(QFile &file);
+    bool parse(const char *begin, const char *end);
+
+    QString errorString() const;
+
+    // Report progress to, and stop when cancelled by, progress
+    void setProgress(GpxLoadProgress *progress);
+
+private:
+    const char *startTag(const char *p);
+    const char *endTag(const char *p);
+    const char *skipMarkup(const char *p);
+
+    void openElement(GpxTag tag);
+    void closeElement(GpxTag tag, const char *textEnd);
+
+    bool checkEncoding(const char *p, const char *end);
+    void parseTrkptAttributes(const char *p, const char *end);
+
+    bool isOpen(GpxTag tag) const {
+        return (openTags & gpxTagBit(tag)) != 0;
+    }
+
+    static QString decodeText(const char *begin, const char *end);
+
+    GpxFile &gpx;
+    // Inside a <trk>; its points go to the file's last segment
+    bool inTrack;
+    GpxLoadProgress *progress;
+
+    const char *dataEnd;
+
+    // Start of the character data of the innermost element
+    const char *textStart;
+
+    unsigned int openTags;
+
+    double clat, clon, cele;
+    qint64 ctime;
+
+    QString error;
+};
+
+#endif
@@ -16,33 +16,63 @@
 
 #include "gpxpoint.h"
 
-#include <GeographicLib/UTMUPS.hpp>
+#include "fastparse.h"
+#include "gpxutm.h"
+#include "gpxdistance.h"
+
+#include <cmath>
+
+const qint64 GpxPoint::NoTime;
 
 // Default constructor
-GpxPoint::GpxPoint(double latitude, double longitude, double elev, QDateTime timev) : _lat(latitude), _lon(longitude), _ele(elev), _time(timev) {
+GpxPoint::GpxPoint(double latitude, double longitude, double elev, QDateTime timev) : _lat(latitude), _lon(longitude), _ele(elev),
+                                                                                       _time(timev.isValid() ? timev.toMSecsSinceEpoch() : NoTime) {
+    setLatLon(latitude, longitude);
+}
+GpxPoint::GpxPoint(double latitude, double longitude, double elev, qint64 msecs) : _lat(latitude), _lon(longitude), _ele(elev), _time(msecs) {
     setLatLon(latitude, longitude);
 }
 void GpxPoint::setLatLon(double latitude, double longitude) {
     _lat = latitude;
     _lon = longitude;
+    _projected = false;
+}
+
+void GpxPoint::project() const {
+    if (_projected) return;
 
-    double gamma;
-    double k;
-    GeographicLib::UTMUPS::Forward(_lat, _lon, _zone, _north, _x, _y, gamma, k);
+    signed char zone;
+    gpxProjectUTM(&_lat, &_lon, 1, &_x, &_y, &zone);
+    _zone = (zone < 0 ? -zone : zone) - 1;
+    _north = zone > 0;
+    _projected = true;
 }
 
 // Convert to an XML string
 void GpxPoint::toXml(QString &xmlStr) {
-    xmlStr += QString("<trkpt lat=\"%1\" lon=\"%2\">"
-                      "<ele>%3</ele><time>%4</time>"
-                      "</trkpt>")
-        .arg(_lat, 0, 'f', 9)
-        .arg(_lon, 0, 'f', 9)
-        .arg(_ele, 0, 'f', 9)
-        .arg(_time.toString(Qt::ISODate));
+    char buf[40];
+    xmlStr += "<trkpt lat=\"";
+    xmlStr += QString::fromLatin1(buf, formatDouble(_lat, buf));
+    xmlStr += "\" lon=\"";
+    xmlStr += QString::fromLatin1(buf, formatDouble(_lon, buf));
+    xmlStr += "\"><ele>";
+    xmlStr += QString::fromLatin1(buf, formatDouble(_ele, buf));
+    xmlStr += "</ele>";
+    if (_time != NoTime) {
+        int len = formatIsoTime(_time, buf);
+        xmlStr += "<time>" + QString::fromLatin1(buf, len) + "</time>";
+    }
+    xmlStr += "</trkpt>";
 }
 // Compute the distance between two GPX points
 double GpxPoint::distanceTo(const GpxPoint &p2) {
+    if (gpxDistanceModel() != UtmDistance) {
+        return gpxDistance(_lat, _lon, _ele, p2._lat, p2._lon, p2._ele);
+    }
+
+    project();
+    p2.project();
+
     double dx = _x - p2._x;
     double dy = _y - p2._y;
     double dz = _ele - p2._ele;
@@ -51,39 +81,55 @@ double GpxPoint::distanceTo(const GpxPoint &p2) {
 }
 
 double GpxPoint::speedBetween(const GpxPoint &p2) {
+    if (_time == NoTime || p2._time == NoTime || p2._time <= _time) return 0.0;
     double dist = distanceTo(p2);
-    double dt = p2._time.toTime_t() - _time.toTime_t();
+    double dt = (p2._time - _time) / 1000.0;
     return dist/dt;
 }
 
 time_t GpxPoint::secondsBetween(const GpxPoint &p2) {
-    return p2._time.toTime_t() - _time.toTime_t();
+    if (_time == NoTime || p2._time == NoTime) return 0;
+    return (p2._time - _time) / 1000;
 }
-double GpxPoint::latitude() {
+double GpxPoint::latitude() const {
     return _lat;
 }
-double GpxPoint::longitude() {
+double GpxPoint::longitude() const {
     return _lon;
 }
 
-double GpxPoint::elevation() {
+double GpxPoint::elevation() const {
     return _ele;
 }
 
-QDateTime GpxPoint::time() {
+QDateTime GpxPoint::time() const {
+    return toDateTime(_time);
+}
+qint64 GpxPoint::timestamp() const {
     return _time;
 }
 
+QDateTime GpxPoint::toDateTime(qint64 msecs) {
+    if (msecs == NoTime) {
+        return QDateTime();
+    }
+    return QDateTime::fromMSecsSinceEpoch(msecs).toUTC();
+}
+
 double GpxPoint::x() {
+    project();
     return _x;
 }
 double GpxPoint::y() {
+    project();
     return _y;
 }
 
 bool GpxPoint::north() {
+    project();
     return _north;
 }
 int GpxPoint::zone() {
+    project();
     return _zone;
 }
@@ -24,21 +24,33 @@
 
 class GpxPoint : public GpxElement {
 public:
+    // Timestamp of points without a <time>
+    static const qint64 NoTime = Q_INT64_C(-9223372036854775807) - 1;
+
     // Default constructor
     GpxPoint(double latitude=0.0, double longitude=0.0, double elev=0.0, QDateTime timev=QDateTime());
+    // msecs is milliseconds since 1970-01-01T00:00:00Z, or NoTime
+    GpxPoint(double latitude, double longitude, double elev, qint64 msecs);
     void setLatLon(double latitude, double longitude);
 
     // Compute the distance between two GPX points
     double distanceTo(const GpxPoint &p2);
+    // Both are 0 if either point has no time, and the speed is also 0
+    // unless p2 is later
     double speedBetween(const GpxPoint &p2);
     time_t secondsBetween(const GpxPoint &p2);
 
-    double latitude();
-    double longitude();
+    double latitude() const;
+    double longitude() const;
+
+    double elevation() const;
 
-    double elevation();
+    // Built from timestamp() on each call
+    QDateTime time() const;
+    qint64 timestamp() const;
 
-    QDateTime time();
+    // UTC QDateTime for a timestamp, invalid for NoTime
+    static QDateTime toDateTime(qint64 msecs);
 
     double x();
     double y();
@@ -48,18 +60,22 @@ public:
 
     void toXml(QString &xmlStr);
 
+    // Compute the UTM coordinates now instead of on first use
+    void project() const;
+
 private:
     // Latitude, longitude and elevation straight from the GPX file
     double _lat, _lon;
     double _ele;
 
-    // UTM coordinates
-    double _x, _y;
-    bool _north;
-    int _zone;
+    // UTM coordinates, computed the first time they're needed
+    mutable double _x, _y;
+    mutable bool _north;
+    mutable int _zone;
+    mutable bool _projected;
 
-    // Time from the GPX file
-    QDateTime _time;
+    // Time from the GPX file, in milliseconds since the epoch
+    qint64 _time;
 };
 
 #endif
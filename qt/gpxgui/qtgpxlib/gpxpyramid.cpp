@@ -0,0 +1,127 @@
+// gpxpyramid.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gpxpyramid.h"
+
+#include <cassert>
+#include <cstring>
+
+// Same comparisons as the min/max kernels, so NaNs are skipped unless
+// they come first
+static inline double minOf(double v, double acc) {
+    return v < acc ? v : acc;
+}
+static inline double maxOf(double v, double acc) {
+    return v > acc ? v : acc;
+}
+
+GpxMinMaxPyramid::GpxMinMaxPyramid() {
+}
+
+void GpxMinMaxPyramid::update(const QVector<double> &values) {
+    int old = _values.size();
+    if (values.constData() == _values.constData() && values.size() == old) return;
+
+    bool extends = old == 0 || (values.size() >= old &&
+        std::memcmp(values.constData(), _values.constData(), old*sizeof(double)) == 0);
+
+    _values = values;
+    build(extends ? old : 0);
+}
+
+int GpxMinMaxPyramid::size() const {
+    return _values.size();
+}
+
+const double *GpxMinMaxPyramid::values() const {
+    return _values.constData();
+}
+
+void GpxMinMaxPyramid::build(int from) {
+    int n = _values.size();
+    const double *v = _values.constData();
+
+    int levels = 0;
+    while ((n / BucketSize) >> levels) ++levels;
+    _min.resize(levels);
+    _max.resize(levels);
+
+    for (int l=0; l<levels; ++l) {
+        int size = bucketSize(l);
+        int count = n / size;
+
+        // Buckets before the old end were complete and haven't changed
+        int first = from / size;
+
+        QVector<double> &lo = _min[l];
+        QVector<double> &hi = _max[l];
+        lo.resize(count);
+        hi.resize(count);
+
+        for (int j=first; j<count; ++j) {
+            double a, b;
+            if (l == 0) {
+                const double *p = v + j*BucketSize;
+                a = b = p[0];
+                for (int k=1; k<BucketSize; ++k) {
+                    a = minOf(p[k], a);
+                    b = maxOf(p[k], b);
+                }
+            } else {
+                const QVector<double> &plo = _min[l-1];
+                const QVector<double> &phi = _max[l-1];
+                a = minOf(plo[2*j+1], plo[2*j]);
+                b = maxOf(phi[2*j+1], phi[2*j]);
+            }
+            lo[j] = a;
+            hi[j] = b;
+        }
+    }
+}
+
+void GpxMinMaxPyramid::minMax(int first, int count, double &minV, double &maxV) const {
+    assert(count > 0 && first >= 0 && first+count <= _values.size());
+
+    const double *v = _values.constData();
+    int i = first;
+    int end = first + count;
+    minV = maxV = v[i];
+
+    // Take the biggest bucket that starts at i and fits, climbing while
+    // i is aligned to the next level and dropping back near the end
+    int level = -1;
+    while (i < end) {
+        while (level+1 < _min.size()) {
+            int size = bucketSize(level+1);
+            if (i % size != 0 || i + size > end) break;
+            ++level;
+        }
+        while (level >= 0 && i + bucketSize(level) > end) {
+            --level;
+        }
+
+        if (level < 0) {
+            minV = minOf(v[i], minV);
+            maxV = maxOf(v[i], maxV);
+        } else {
+            int j = i / bucketSize(level);
+            minV = minOf(_min[level][j], minV);
+            maxV = maxOf(_max[level][j], maxV);
+        }
+        i += bucketSize(level);
+    }
+}
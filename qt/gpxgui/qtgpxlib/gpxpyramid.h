@@ -0,0 +1,60 @@
+// gpxpyramid.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef GPX_PYRAMID_H
+#define GPX_PYRAMID_H
+
+#include <QVector>
+
+// Min/max pyramid over a column of values, such as a segment's
+// elevations, for drawing long series at screen resolution.
+// Level k holds the smallest and largest value of each complete run of
+// BucketSize << k values, so the extremes of any range take O(log n)
+// lookups and no peak is ever lost to decimation.  The levels add up
+// to about half the size of the values themselves, and the values are
+// shared with the caller's QVector rather than copied.
+class GpxMinMaxPyramid {
+public:
+    GpxMinMaxPyramid();
+
+    // Bring the pyramid up to date with values.  Nothing is done if
+    // it's the same data as last time, and if the old values are a
+    // prefix of the new ones only the added part is built.
+    void update(const QVector<double> &values);
+
+    int size() const;
+    const double *values() const;
+
+    // Smallest and largest of values first .. first+count-1, count > 0
+    void minMax(int first, int count, double &minV, double &maxV) const;
+
+private:
+    enum { BucketSize = 8 };
+
+    int bucketSize(int level) const {
+        return level < 0 ? 1 : BucketSize << level;
+    }
+
+    // Rebuild every level from complete buckets starting at value from
+    void build(int from);
+
+    QVector<double> _values;
+    QVector<QVector<double> > _min;
+    QVector<QVector<double> > _max;
+};
+
+#endif
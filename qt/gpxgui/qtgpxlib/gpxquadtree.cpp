@@ -0,0 +1,290 @@
+// gpxquadtree.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gpxquadtree.h"
+#include "gpxsimplify.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+inline bool overlaps(double minX1, double minY1, double maxX1, double maxY1,
+                     double minX2, double minY2, double maxX2, double maxY2) {
+    return minX1 <= maxX2 && minX2 <= maxX1 && minY1 <= maxY2 && minY2 <= maxY1;
+}
+
+}
+
+GpxQuadtree::GpxQuadtree() : _minX(0.0), _minY(0.0), _maxX(0.0), _maxY(0.0) {}
+
+void GpxQuadtree::clear() {
+    _x.clear();
+    _y.clear();
+    _levels.clear();
+    _minX = _minY = _maxX = _maxY = 0.0;
+}
+
+int GpxQuadtree::size() const {
+    return _x.size();
+}
+
+bool GpxQuadtree::isEmpty() const {
+    return _x.isEmpty();
+}
+
+int GpxQuadtree::levelCount() const {
+    return _levels.size();
+}
+
+const double *GpxQuadtree::x() const {
+    return _x.constData();
+}
+
+const double *GpxQuadtree::y() const {
+    return _y.constData();
+}
+
+void GpxQuadtree::bounds(double &minX, double &minY, double &maxX, double &maxY) const {
+    minX = _minX;
+    minY = _minY;
+    maxX = _maxX;
+    maxY = _maxY;
+}
+
+void GpxQuadtree::build(const double *x, const double *y, int n) {
+    clear();
+    if (n <= 0) return;
+
+    _x.resize(n);
+    _y.resize(n);
+    std::copy(x, x+n, _x.begin());
+    std::copy(y, y+n, _y.begin());
+
+    _minX = _maxX = x[0];
+    _minY = _maxY = y[0];
+    for (int i=1; i<n; ++i) {
+        _minX = std::min(_minX, x[i]);
+        _maxX = std::max(_maxX, x[i]);
+        _minY = std::min(_minY, y[i]);
+        _maxY = std::max(_maxY, y[i]);
+    }
+
+    Level all;
+    all.tolerance = 0.0;
+    all.points.resize(n);
+    for (int i=0; i<n; ++i) {
+        all.points[i] = i;
+    }
+    _levels.push_back(all);
+
+    // Tolerances double from well under anything drawn up to the size
+    // of the whole track, and a level is only added once it has at most
+    // half the points of the last one
+    double extent = std::max(_maxX-_minX, _maxY-_minY);
+    if (extent > 0.0) {
+        QVector<double> rank = ranks();
+        int kept = n;
+        for (int d=MaxDepth; d>=0 && kept > 2; --d) {
+            double tolerance = std::ldexp(extent, -d);
+            int count = 0;
+            for (int i=0; i<n; ++i) {
+                if (rank[i] > tolerance) ++count;
+            }
+            if (count > kept/2) continue;
+
+            Level level;
+            level.tolerance = tolerance;
+            level.points.reserve(count);
+            for (int i=0; i<n; ++i) {
+                if (rank[i] > tolerance) level.points.push_back(i);
+            }
+            _levels.push_back(level);
+            kept = count;
+        }
+    }
+
+    for (int i=0; i<_levels.size(); ++i) {
+        buildLevel(_levels[i]);
+    }
+}
+
+QVector<double> GpxQuadtree::ranks() const {
+    int n = _x.size();
+    const double *x = _x.constData();
+    const double *y = _y.constData();
+
+    // A point can't outrank the split that made its span, so keeping
+    // the points ranked above a tolerance gives the same track as
+    // running Douglas-Peucker with it
+    QVector<double> rank(n, 0.0);
+    rank[0] = rank[n-1] = HUGE_VAL;
+
+    // Spans still to be split, as end points and the rank of the split
+    // that made them
+    QVector<int> spans;
+    QVector<double> bounds;
+    spans.push_back(0);
+    spans.push_back(n-1);
+    bounds.push_back(HUGE_VAL);
+    while (!spans.isEmpty()) {
+        int b = spans.last();
+        spans.pop_back();
+        int a = spans.last();
+        spans.pop_back();
+        double bound = bounds.last();
+        bounds.pop_back();
+
+        // The same split as GpxSimplifier's Douglas-Peucker
+        double worst;
+        int split = gpxFarthestFromChord(x, y, 0, a, b, worst);
+        if (split < 0) continue;
+
+        rank[split] = std::min(std::sqrt(worst), bound);
+        spans.push_back(a);
+        spans.push_back(split);
+        bounds.push_back(rank[split]);
+        spans.push_back(split);
+        spans.push_back(b);
+        bounds.push_back(rank[split]);
+    }
+    return rank;
+}
+
+void GpxQuadtree::buildLevel(Level &level) const {
+    const QVector<int> &points = level.points;
+    int steps = points.size()-1;
+
+    // One chunk even for a single point, so it can still be found
+    for (int first=0; first == 0 || first < steps; first += ChunkSize) {
+        Chunk chunk;
+        chunk.first = first;
+        chunk.steps = std::min(int(ChunkSize), steps-first);
+        chunk.minX = chunk.maxX = _x[points[first]];
+        chunk.minY = chunk.maxY = _y[points[first]];
+        for (int i=first+1; i<=first+chunk.steps; ++i) {
+            chunk.minX = std::min(chunk.minX, _x[points[i]]);
+            chunk.maxX = std::max(chunk.maxX, _x[points[i]]);
+            chunk.minY = std::min(chunk.minY, _y[points[i]]);
+            chunk.maxY = std::max(chunk.maxY, _y[points[i]]);
+        }
+        level.chunks.push_back(chunk);
+    }
+
+    Node root;
+    root.x = _minX;
+    root.y = _minY;
+    root.size = std::max(std::max(_maxX-_minX, _maxY-_minY), 1e-9);
+    root.child[0] = root.child[1] = root.child[2] = root.child[3] = -1;
+    root.first = root.count = 0;
+    level.nodes.push_back(root);
+
+    // Walk each chunk down while it fits inside one quarter of the cell
+    QVector<int> nodeOf(level.chunks.size());
+    for (int c=0; c<level.chunks.size(); ++c) {
+        const Chunk &chunk = level.chunks[c];
+        int node = 0;
+        for (int depth=0; depth<MaxDepth; ++depth) {
+            double half = level.nodes[node].size / 2;
+            double cx = level.nodes[node].x + half;
+            double cy = level.nodes[node].y + half;
+            bool left = chunk.maxX <= cx, right = chunk.minX >= cx;
+            bool below = chunk.maxY <= cy, above = chunk.minY >= cy;
+            if (!(left || right) || !(below || above)) break;
+
+            int q = (right ? 1 : 0) + (above ? 2 : 0);
+            if (level.nodes[node].child[q] < 0) {
+                Node child;
+                child.x = level.nodes[node].x + (right ? half : 0.0);
+                child.y = level.nodes[node].y + (above ? half : 0.0);
+                child.size = half;
+                child.child[0] = child.child[1] = child.child[2] = child.child[3] = -1;
+                child.first = child.count = 0;
+                level.nodes[node].child[q] = level.nodes.size();
+                level.nodes.push_back(child);
+            }
+            node = level.nodes[node].child[q];
+        }
+        nodeOf[c] = node;
+        ++level.nodes[node].count;
+    }
+
+    // Group the chunks by cell, keeping track order within each
+    int first = 0;
+    for (int i=0; i<level.nodes.size(); ++i) {
+        level.nodes[i].first = first;
+        first += level.nodes[i].count;
+        level.nodes[i].count = 0;
+    }
+    level.nodeChunks.resize(level.chunks.size());
+    for (int c=0; c<level.chunks.size(); ++c) {
+        Node &node = level.nodes[nodeOf[c]];
+        level.nodeChunks[node.first + node.count++] = c;
+    }
+}
+
+void GpxQuadtree::query(double minX, double minY, double maxX, double maxY, double tolerance,
+                        QVector<int> &points, QVector<int> &runs) const {
+    points.clear();
+    runs.clear();
+    if (_levels.isEmpty()) {
+        runs.push_back(0);
+        return;
+    }
+
+    int l = 0;
+    while (l+1 < _levels.size() && _levels[l+1].tolerance <= tolerance) {
+        ++l;
+    }
+    const Level &level = _levels[l];
+
+    QVector<int> found;
+    QVector<int> stack;
+    stack.push_back(0);
+    while (!stack.isEmpty()) {
+        const Node &node = level.nodes[stack.last()];
+        stack.pop_back();
+        if (!overlaps(node.x, node.y, node.x+node.size, node.y+node.size, minX, minY, maxX, maxY)) {
+            continue;
+        }
+        for (int i=node.first; i<node.first+node.count; ++i) {
+            const Chunk &chunk = level.chunks[level.nodeChunks[i]];
+            if (overlaps(chunk.minX, chunk.minY, chunk.maxX, chunk.maxY, minX, minY, maxX, maxY)) {
+                found.push_back(level.nodeChunks[i]);
+            }
+        }
+        for (int q=0; q<4; ++q) {
+            if (node.child[q] >= 0) stack.push_back(node.child[q]);
+        }
+    }
+    std::sort(found.begin(), found.end());
+
+    // Neighbouring chunks share an end point, so they join into one run
+    for (int i=0; i<found.size(); ++i) {
+        const Chunk &chunk = level.chunks[found[i]];
+        int from = chunk.first;
+        if (i > 0 && found[i-1] == found[i]-1) {
+            ++from;
+        } else {
+            runs.push_back(points.size());
+        }
+        for (int j=from; j<=chunk.first+chunk.steps; ++j) {
+            points.push_back(level.points[j]);
+        }
+    }
+    runs.push_back(points.size());
+}
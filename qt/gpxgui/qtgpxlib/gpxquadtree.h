@@ -0,0 +1,111 @@
+// gpxquadtree.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef GPX_QUADTREE_H
+#define GPX_QUADTREE_H
+
+#include <QVector>
+
+// Level of detail quadtree over one track, for drawing a small part of
+// a long track quickly at any scale.
+//
+// Every point is ranked by Douglas-Peucker: its rank is the largest
+// tolerance that would still keep it.  Levels keep the points ranked
+// above doubling tolerances, each about half the size of the one below,
+// so a level can be drawn at the scale where its tolerance is under a
+// pixel.  Each level's track is cut into short chunks, and chunks are
+// stored in the smallest quadtree cell holding their bounding box, so a
+// query only looks at chunks near the box it's asked about and the work
+// per frame depends on what's on screen rather than the track's length.
+//
+// Coordinates are planar and up to the caller, in whatever projection
+// it draws with.  They're copied, so the tree can be built and queried
+// on any thread.
+class GpxQuadtree {
+public:
+    GpxQuadtree();
+
+    // Index the track through n points, replacing what was there
+    void build(const double *x, const double *y, int n);
+    void clear();
+
+    int size() const;
+    bool isEmpty() const;
+    int levelCount() const;
+
+    const double *x() const;
+    const double *y() const;
+
+    // Bounding box of every point
+    void bounds(double &minX, double &minY, double &maxX, double &maxY) const;
+
+    // The parts of the track crossing the box, simplified so nothing
+    // dropped is further than tolerance from what's left.  points gets
+    // the indices of the points to join with lines, as runs of
+    // consecutive ones: run k is points[runs[k]] to points[runs[k+1]-1],
+    // and runs ends with points.size().  Both are cleared first.  Runs
+    // include the points just outside the box, so lines crossing its
+    // edge are drawn.
+    void query(double minX, double minY, double maxX, double maxY, double tolerance,
+               QVector<int> &points, QVector<int> &runs) const;
+
+private:
+    // Steps per chunk
+    enum { ChunkSize = 64 };
+
+    // Deepest quadtree cell, and the finest level's tolerance as a
+    // fraction of the track's size, 2^-MaxDepth
+    enum { MaxDepth = 24 };
+
+    struct Chunk {
+        // Offset of the first point in the level's points, and how many
+        // steps follow it
+        int first;
+        int steps;
+        double minX, minY, maxX, maxY;
+    };
+
+    struct Node {
+        double x, y, size;
+        int child[4];
+        // Chunks in this cell and no smaller one, from nodeChunks
+        int first, count;
+    };
+
+    struct Level {
+        double tolerance;
+        QVector<int> points;
+        QVector<Chunk> chunks;
+        QVector<Node> nodes;
+        QVector<int> nodeChunks;
+    };
+
+    // Douglas-Peucker rank of every point
+    QVector<double> ranks() const;
+
+    // Cut level's points into chunks and file them in its quadtree
+    void buildLevel(Level &level) const;
+
+    QVector<double> _x;
+    QVector<double> _y;
+    double _minX, _minY, _maxX, _maxY;
+
+    // Finest first.  Level 0 has every point and a tolerance of 0.
+    QVector<Level> _levels;
+};
+
+#endif
@@ -0,0 +1,393 @@
+// gpxrenderer.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gpxrenderer.h"
+#include "gpxdistance.h"
+#include "gpxfile.h"
+
+#include <QPainter>
+#include <QPen>
+#include <QPolygonF>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Pixels left around the tracks
+const int Margin = 10;
+
+// Steps of the colour ramp
+const int RampSteps = 256;
+
+// Maps lat/lon to pixels in the whole image
+struct View {
+    double minLon, maxLat;
+    double ox, oy, sx, sy;
+
+    double x(double lon) const { return ox + (lon - minLon) * sx; }
+    double y(double lat) const { return oy + (maxLat - lat) * sy; }
+};
+
+}
+
+// Part of the image and the chunks crossing it
+struct GpxRenderer::Tile {
+    const GpxRenderer *renderer;
+    View view;
+    double lo, hi;
+
+    // The whole image's pixels, and where this tile is in it
+    uchar *bits;
+    int bytesPerLine;
+    int x, y, width, height;
+
+    QVector<int> chunks;
+};
+
+GpxRenderer::GpxRenderer(ColorBy colorBy) : _colorBy(colorBy), _rangeSet(false), _lo(0.0), _hi(1.0),
+                                            _boundsSet(false), _minLat(0.0), _minLon(0.0),
+                                            _maxLat(0.0), _maxLon(0.0), _lineWidth(2.0),
+                                            _background(Qt::white), _tileSize(256) {
+}
+
+GpxRenderer::ColorBy GpxRenderer::colorBy() const {
+    return _colorBy;
+}
+
+void GpxRenderer::setColorBy(ColorBy colorBy) {
+    if (colorBy != _colorBy) {
+        clear();
+        _colorBy = colorBy;
+    }
+}
+
+void GpxRenderer::setRange(double lo, double hi) {
+    _rangeSet = true;
+    _lo = lo;
+    _hi = hi;
+}
+
+void GpxRenderer::clearRange() {
+    _rangeSet = false;
+}
+
+void GpxRenderer::setBounds(double minLat, double minLon, double maxLat, double maxLon) {
+    _boundsSet = true;
+    _minLat = minLat;
+    _minLon = minLon;
+    _maxLat = maxLat;
+    _maxLon = maxLon;
+}
+
+void GpxRenderer::clearBounds() {
+    _boundsSet = false;
+}
+
+double GpxRenderer::lineWidth() const {
+    return _lineWidth;
+}
+
+void GpxRenderer::setLineWidth(double width) {
+    _lineWidth = width;
+}
+
+QColor GpxRenderer::background() const {
+    return _background;
+}
+
+void GpxRenderer::setBackground(const QColor &color) {
+    _background = color;
+}
+
+int GpxRenderer::tileSize() const {
+    return _tileSize;
+}
+
+void GpxRenderer::setTileSize(int pixels) {
+    _tileSize = std::max(pixels, 16);
+}
+
+void GpxRenderer::clear() {
+    _lat.clear();
+    _lon.clear();
+    _value.clear();
+    _chunks.clear();
+}
+
+int GpxRenderer::pointCount() const {
+    return _lat.size();
+}
+
+void GpxRenderer::addFile(GpxFile &gpx) {
+    for (int i=0; i<gpx.segmentCount(); ++i) {
+        addSegment(gpx.at(i));
+    }
+}
+
+void GpxRenderer::addSegment(const GpxTrackSegment &seg) {
+    int n = seg.pointCount();
+    if (n == 0) return;
+
+    const double *lat = seg.latitudes();
+    const double *lon = seg.longitudes();
+    const double *ele = seg.elevations();
+    const qint64 *time = seg.timestamps();
+
+    int base = _lat.size();
+    _lat.resize(base + n);
+    _lon.resize(base + n);
+    _value.resize(base + n);
+    std::copy(lat, lat+n, _lat.begin() + base);
+    std::copy(lon, lon+n, _lon.begin() + base);
+
+    // Points without a time keep the value before them.  Speeds only
+    // decide a colour, so steps are measured on a flat earth.
+    double *value = _value.data() + base;
+    double last = 0.0;
+    for (int i=0; i<n; ++i) {
+        if (_colorBy == ElevationColor) {
+            last = ele[i];
+        } else if (_colorBy == TimeColor) {
+            if (time[i] != GpxPoint::NoTime) last = double(time[i]);
+        } else if (i > 0 && time[i] != GpxPoint::NoTime && time[i-1] != GpxPoint::NoTime &&
+                   time[i] > time[i-1]) {
+            double dx = (lon[i] - lon[i-1]) * std::cos(lat[i]*GpxDegree) * GpxMeanRadius * GpxDegree;
+            double dy = (lat[i] - lat[i-1]) * GpxMeanRadius * GpxDegree;
+            double dz = ele[i] - ele[i-1];
+            last = std::sqrt(dx*dx + dy*dy + dz*dz) / ((time[i] - time[i-1]) / 1000.0);
+        }
+        value[i] = last;
+    }
+    if (_colorBy == SpeedColor && n > 1) value[0] = value[1];
+
+    // Neighbouring chunks share their end points
+    int steps = n-1;
+    for (int s=0; s==0 || s<steps; s+=ChunkSize) {
+        Chunk c;
+        c.first = base + s;
+        c.steps = std::min(int(ChunkSize), steps - s);
+        c.minLat = c.maxLat = lat[s];
+        c.minLon = c.maxLon = lon[s];
+        for (int i=s+1; i<=s+c.steps; ++i) {
+            c.minLat = std::min(c.minLat, lat[i]);
+            c.maxLat = std::max(c.maxLat, lat[i]);
+            c.minLon = std::min(c.minLon, lon[i]);
+            c.maxLon = std::max(c.maxLon, lon[i]);
+        }
+        _chunks.push_back(c);
+    }
+}
+
+void GpxRenderer::valueRange(double &lo, double &hi) const {
+    if (_rangeSet || _value.isEmpty()) {
+        lo = _lo;
+        hi = _hi;
+        return;
+    }
+
+    // Percentiles of at most 100000 of the values
+    int stride = std::max(_value.size() / 100000, 1);
+    QVector<double> sample;
+    sample.reserve(_value.size() / stride + 1);
+    for (int i=0; i<_value.size(); i+=stride) {
+        sample.push_back(_value[i]);
+    }
+    int low = sample.size() / 100;
+    int high = sample.size() - 1 - sample.size() / 100;
+    std::nth_element(sample.begin(), sample.begin() + low, sample.end());
+    lo = sample[low];
+    std::nth_element(sample.begin(), sample.begin() + high, sample.end());
+    hi = sample[high];
+}
+
+QRgb GpxRenderer::rampColor(double t) {
+    t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+
+    // Four equal legs between the five colours
+    double leg = t * 4;
+    int k = std::min(int(leg), 3);
+    int f = int((leg - k) * 255 + 0.5);
+    switch (k) {
+    case 0: return qRgb(0, f, 255);
+    case 1: return qRgb(0, 255, 255-f);
+    case 2: return qRgb(f, 255, 0);
+    default: return qRgb(255, 255-f, 0);
+    }
+}
+
+QImage GpxRenderer::render(int width, int height) const {
+    if (width <= 0 || height <= 0) return QImage();
+
+    QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+    {
+        QPainter p(&image);
+        p.setCompositionMode(QPainter::CompositionMode_Source);
+        p.fillRect(image.rect(), _background);
+    }
+    if (_chunks.isEmpty()) return image;
+
+    double minLat = _minLat, minLon = _minLon, maxLat = _maxLat, maxLon = _maxLon;
+    if (!_boundsSet) {
+        minLat = maxLat = _chunks[0].minLat;
+        minLon = maxLon = _chunks[0].minLon;
+        for (int c=0; c<_chunks.size(); ++c) {
+            minLat = std::min(minLat, _chunks[c].minLat);
+            minLon = std::min(minLon, _chunks[c].minLon);
+            maxLat = std::max(maxLat, _chunks[c].maxLat);
+            maxLon = std::max(maxLon, _chunks[c].maxLon);
+        }
+    }
+
+    // Longitude shrinks with the cosine of the latitude, and the whole
+    // area is scaled to fit and centred
+    double kx = std::cos((minLat + maxLat) / 2 * GpxDegree);
+    double spanX = (maxLon - minLon) * kx;
+    double spanY = maxLat - minLat;
+    double availX = std::max(width - 2*Margin, 1);
+    double availY = std::max(height - 2*Margin, 1);
+    double scale = 1.0;
+    if (spanX > 0 && spanY > 0) {
+        scale = std::min(availX / spanX, availY / spanY);
+    } else if (spanX > 0) {
+        scale = availX / spanX;
+    } else if (spanY > 0) {
+        scale = availY / spanY;
+    }
+
+    View view;
+    view.minLon = minLon;
+    view.maxLat = maxLat;
+    view.sx = kx * scale;
+    view.sy = scale;
+    view.ox = Margin + (availX - spanX*scale) / 2;
+    view.oy = Margin + (availY - spanY*scale) / 2;
+
+    // Hand each chunk to every tile its box reaches, pen included
+    int ts = _tileSize;
+    int cols = (width + ts - 1) / ts;
+    int rows = (height + ts - 1) / ts;
+    QVector<QVector<int> > lists(cols * rows);
+    double pad = _lineWidth / 2 + 1;
+    for (int c=0; c<_chunks.size(); ++c) {
+        const Chunk &chunk = _chunks[c];
+        double x0 = view.x(chunk.minLon) - pad, x1 = view.x(chunk.maxLon) + pad;
+        double y0 = view.y(chunk.maxLat) - pad, y1 = view.y(chunk.minLat) + pad;
+        if (x1 < 0 || y1 < 0 || x0 >= width || y0 >= height) continue;
+
+        int c0 = std::max(int(x0) / ts, 0), c1 = std::min(int(x1) / ts, cols-1);
+        int r0 = std::max(int(y0) / ts, 0), r1 = std::min(int(y1) / ts, rows-1);
+        for (int r=r0; r<=r1; ++r) {
+            for (int col=c0; col<=c1; ++col) {
+                lists[r*cols + col].push_back(c);
+            }
+        }
+    }
+
+    double lo, hi;
+    valueRange(lo, hi);
+
+    QList<Tile> tiles;
+    for (int r=0; r<rows; ++r) {
+        for (int col=0; col<cols; ++col) {
+            if (lists[r*cols + col].isEmpty()) continue;
+
+            Tile tile;
+            tile.renderer = this;
+            tile.view = view;
+            tile.lo = lo;
+            tile.hi = hi;
+            tile.bits = image.bits();
+            tile.bytesPerLine = image.bytesPerLine();
+            tile.x = col * ts;
+            tile.y = r * ts;
+            tile.width = std::min(ts, width - tile.x);
+            tile.height = std::min(ts, height - tile.y);
+            tile.chunks = lists[r*cols + col];
+            tiles.push_back(tile);
+        }
+    }
+
+    // Tiles don't overlap, so each can paint its own part of the image
+    QtConcurrent::blockingMap(tiles, renderTile);
+    return image;
+}
+
+void GpxRenderer::renderTile(Tile &tile) {
+    const GpxRenderer &r = *tile.renderer;
+    const View &view = tile.view;
+    const double *lat = r._lat.constData();
+    const double *lon = r._lon.constData();
+    const double *value = r._value.constData();
+    double scale = tile.hi > tile.lo ? (RampSteps - 1) / (tile.hi - tile.lo) : 0.0;
+
+    QImage part(tile.bits + tile.y * tile.bytesPerLine + 4 * tile.x, tile.width, tile.height,
+                tile.bytesPerLine, QImage::Format_ARGB32_Premultiplied);
+    QPainter p(&part);
+    p.setRenderHint(QPainter::Antialiasing);
+    p.translate(-tile.x, -tile.y);
+
+    QPen pen;
+    pen.setWidthF(r._lineWidth);
+    pen.setCapStyle(Qt::RoundCap);
+    pen.setJoinStyle(Qt::RoundJoin);
+
+    // Steps in the same colour are drawn as one polyline
+    QPolygonF line;
+    int lineColor = -1;
+    for (int k=0; k<tile.chunks.size(); ++k) {
+        const Chunk &chunk = r._chunks[tile.chunks[k]];
+        int first = chunk.first;
+        int last = first + chunk.steps;
+
+        QPointF prev(view.x(lon[first]), view.y(lat[first]));
+        line.clear();
+        line << prev;
+        lineColor = -1;
+        for (int i=first+1; i<=last; ++i) {
+            QPointF pt(view.x(lon[i]), view.y(lat[i]));
+            double dx = pt.x() - prev.x(), dy = pt.y() - prev.y();
+            if (dx*dx + dy*dy < 0.25 && i < last) continue;
+
+            int color = int((value[i] - tile.lo) * scale + 0.5);
+            color = std::max(0, std::min(color, RampSteps - 1));
+            if (color != lineColor && line.size() > 1) {
+                pen.setColor(QColor(rampColor(double(lineColor) / (RampSteps - 1))));
+                p.setPen(pen);
+                p.drawPolyline(line);
+                line.clear();
+                line << prev;
+            }
+            lineColor = color;
+            line << pt;
+            prev = pt;
+        }
+
+        if (line.size() > 1) {
+            pen.setColor(QColor(rampColor(double(lineColor) / (RampSteps - 1))));
+            p.setPen(pen);
+            p.drawPolyline(line);
+        } else if (chunk.steps == 0) {
+            int color = int((value[first] - tile.lo) * scale + 0.5);
+            color = std::max(0, std::min(color, RampSteps - 1));
+            pen.setColor(QColor(rampColor(double(color) / (RampSteps - 1))));
+            p.setPen(pen);
+            p.drawPoint(prev);
+        }
+    }
+}
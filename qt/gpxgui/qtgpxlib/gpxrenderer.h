@@ -0,0 +1,129 @@
+// gpxrenderer.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef GPX_RENDERER_H
+#define GPX_RENDERER_H
+
+#include <QColor>
+#include <QImage>
+#include <QList>
+#include <QRgb>
+#include <QVector>
+
+class GpxFile;
+class GpxTrackSegment;
+
+// Draws tracks into an image, coloured by speed, elevation or time.
+//
+// Only positions and the value being coloured by are kept, so many
+// files can be added and drawn together into one overview.  The image
+// is split into tiles drawn at the same time on the global thread
+// pool, each by its own QPainter straight into its part of the image.
+// Tracks are cut into short chunks as they're added, so each tile only
+// looks at the chunks that cross it, and points closer together than
+// half a pixel are skipped.
+//
+// Only QImage and QPainter are used, without text or pixmaps, so
+// rendering works without a display or a QApplication.
+class GpxRenderer {
+public:
+    enum ColorBy {
+        // Metres per second over the step to each point
+        SpeedColor,
+        // Metres
+        ElevationColor,
+        // Milliseconds since 1970
+        TimeColor
+    };
+
+    GpxRenderer(ColorBy colorBy = SpeedColor);
+
+    // Points only keep the value they're coloured by, so changing this
+    // drops everything added so far
+    ColorBy colorBy() const;
+    void setColorBy(ColorBy colorBy);
+
+    // Values mapped to the two ends of the colour ramp.  Unless set,
+    // from the 1st to the 99th percentile of everything added, so a few
+    // bad fixes don't wash out the rest.
+    void setRange(double lo, double hi);
+    void clearRange();
+
+    // Area drawn, in degrees.  Unless set, everything added.
+    void setBounds(double minLat, double minLon, double maxLat, double maxLon);
+    void clearBounds();
+
+    // Pen width in pixels, 2 by default
+    double lineWidth() const;
+    void setLineWidth(double width);
+
+    // White by default
+    QColor background() const;
+    void setBackground(const QColor &color);
+
+    // Square tiles this many pixels across, 256 by default
+    int tileSize() const;
+    void setTileSize(int pixels);
+
+    void addFile(GpxFile &gpx);
+    void addSegment(const GpxTrackSegment &seg);
+    void clear();
+    int pointCount() const;
+
+    // Draw everything added into a width by height image, keeping the
+    // shape of the area with a 10 pixel margin
+    QImage render(int width, int height) const;
+
+    // Colour for a value scaled from the range to 0..1: blue, cyan,
+    // green, yellow, then red
+    static QRgb rampColor(double t);
+
+private:
+    // Steps per chunk
+    enum { ChunkSize = 64 };
+
+    struct Chunk {
+        // Index of the first point, and how many follow it
+        int first;
+        int steps;
+        double minLat, minLon, maxLat, maxLon;
+    };
+
+    struct Tile;
+    static void renderTile(Tile &tile);
+
+    // Ends of the colour ramp
+    void valueRange(double &lo, double &hi) const;
+
+    ColorBy _colorBy;
+    bool _rangeSet;
+    double _lo, _hi;
+    bool _boundsSet;
+    double _minLat, _minLon, _maxLat, _maxLon;
+    double _lineWidth;
+    QColor _background;
+    int _tileSize;
+
+    // Every point added, with chunks never crossing from one segment to
+    // the next
+    QVector<double> _lat;
+    QVector<double> _lon;
+    QVector<double> _value;
+    QVector<Chunk> _chunks;
+};
+
+#endif
@@ -0,0 +1,268 @@
+// gpxresortdb.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gpxresortdb.h"
+#include "gpxdistance.h"
+#include "gpxfile.h"
+
+#include <QFile>
+#include <QXmlStreamReader>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+
+void unitVector(double lat, double lon, double *p) {
+    double phi = lat*GpxDegree, lam = lon*GpxDegree;
+    p[0] = std::cos(phi) * std::cos(lam);
+    p[1] = std::cos(phi) * std::sin(lam);
+    p[2] = std::sin(phi);
+}
+
+double chordSquared(const double *a, const double *b) {
+    double dx = a[0]-b[0], dy = a[1]-b[1], dz = a[2]-b[2];
+    return dx*dx + dy*dy + dz*dz;
+}
+
+double metresOf(double chordSq) {
+    return 2*GpxMeanRadius * std::asin(std::min(std::sqrt(chordSq) / 2, 1.0));
+}
+
+// Orders resorts by one coordinate of their unit vectors
+struct AxisLess {
+    const double *xyz;
+    int axis;
+    AxisLess(const double *p, int a) : xyz(p), axis(a) { }
+    bool operator()(int a, int b) const {
+        return xyz[3*a+axis] < xyz[3*b+axis];
+    }
+};
+
+// Arrange entry[lo..hi) so each range's middle splits it on axis, and
+// the halves on the next axis
+void buildTree(int *entry, int lo, int hi, int axis, const double *xyz) {
+    if (hi - lo < 2) return;
+    int mid = (lo + hi) / 2;
+    std::nth_element(entry+lo, entry+mid, entry+hi, AxisLess(xyz, axis));
+    buildTree(entry, lo, mid, (axis+1) % 3, xyz);
+    buildTree(entry, mid+1, hi, (axis+1) % 3, xyz);
+}
+
+// Numbers missing from the file are -1
+double toNumber(const QString &text) {
+    bool ok;
+    double v = text.toDouble(&ok);
+    return ok ? v : -1.0;
+}
+
+}
+
+GpxResort::GpxResort() : latitude(0.0), longitude(0.0), elevation(-1.0), vertical(-1.0),
+                         runs(-1), lifts(-1), snowfall(-1.0), longestRun(-1.0) {
+}
+
+GpxResortDb::GpxResortDb() {
+}
+
+bool GpxResortDb::load(const QString &fname) {
+    QFile file(fname);
+    if (!file.open(QIODevice::ReadOnly)) {
+        _error = file.errorString();
+        return false;
+    }
+    return read(&file);
+}
+
+bool GpxResortDb::read(QIODevice *device) {
+    clear();
+
+    QXmlStreamReader xml(device);
+    while (!xml.atEnd()) {
+        if (xml.readNext() != QXmlStreamReader::StartElement ||
+            xml.name() != QLatin1String("wpt")) {
+            continue;
+        }
+
+        GpxResort r;
+        bool latOk, lonOk;
+        QXmlStreamAttributes attrs = xml.attributes();
+        r.latitude = attrs.value(QLatin1String("lat")).toString().toDouble(&latOk);
+        r.longitude = attrs.value(QLatin1String("lon")).toString().toDouble(&lonOk);
+
+        while (!xml.atEnd()) {
+            QXmlStreamReader::TokenType token = xml.readNext();
+            if (token == QXmlStreamReader::EndElement) break;
+            if (token != QXmlStreamReader::StartElement) continue;
+
+            QString tag = xml.name().toString();
+            QString text = xml.readElementText();
+            if (tag == QLatin1String("name")) {
+                r.name = text;
+            } else if (tag == QLatin1String("ele")) {
+                r.elevation = toNumber(text);
+            } else if (tag == QLatin1String("vertical")) {
+                r.vertical = toNumber(text);
+            } else if (tag == QLatin1String("numruns")) {
+                r.runs = int(toNumber(text));
+            } else if (tag == QLatin1String("numlifts")) {
+                r.lifts = int(toNumber(text));
+            } else if (tag == QLatin1String("snow")) {
+                r.snowfall = toNumber(text);
+            } else if (tag == QLatin1String("longestrun")) {
+                r.longestRun = toNumber(text);
+            } else if (tag == QLatin1String("url")) {
+                r.url = text;
+            }
+        }
+
+        // Nothing to find without a position
+        if (latOk && lonOk) {
+            _resorts.push_back(r);
+        }
+    }
+    if (xml.hasError()) {
+        _error = QString("%1 at line %2").arg(xml.errorString()).arg(xml.lineNumber());
+        _resorts.clear();
+        return false;
+    }
+
+    build();
+    return true;
+}
+
+QString GpxResortDb::errorString() const {
+    return _error;
+}
+
+void GpxResortDb::clear() {
+    _resorts.clear();
+    _xyz.clear();
+    _entry.clear();
+    _error = QString();
+}
+
+int GpxResortDb::size() const {
+    return _resorts.size();
+}
+
+bool GpxResortDb::isEmpty() const {
+    return _resorts.isEmpty();
+}
+
+const GpxResort &GpxResortDb::resort(int n) const {
+    assert(n >= 0 && n < _resorts.size());
+    return _resorts[n];
+}
+
+void GpxResortDb::build() {
+    int n = _resorts.size();
+    QVector<double> xyz(3*n);
+    _entry.resize(n);
+    for (int i=0; i<n; ++i) {
+        unitVector(_resorts[i].latitude, _resorts[i].longitude, xyz.data() + 3*i);
+        _entry[i] = i;
+    }
+    buildTree(_entry.data(), 0, n, 0, xyz.constData());
+
+    // Copy the vectors into tree order so searching reads them in sequence
+    _xyz.resize(3*n);
+    for (int i=0; i<n; ++i) {
+        for (int k=0; k<3; ++k) {
+            _xyz[3*i+k] = xyz[3*_entry[i]+k];
+        }
+    }
+}
+
+void GpxResortDb::search(int lo, int hi, int axis, const double *p, int &best, double &bestChord) const {
+    if (lo >= hi) return;
+
+    int mid = (lo + hi) / 2;
+    const double *q = _xyz.constData() + 3*mid;
+    double d = chordSquared(p, q);
+    if (d < bestChord) {
+        bestChord = d;
+        best = mid;
+    }
+
+    // The near side first, then the far side if the splitting plane is
+    // closer than the best so far
+    int next = (axis+1) % 3;
+    double gap = p[axis] - q[axis];
+    if (gap < 0) {
+        search(lo, mid, next, p, best, bestChord);
+        if (gap*gap < bestChord) search(mid+1, hi, next, p, best, bestChord);
+    } else {
+        search(mid+1, hi, next, p, best, bestChord);
+        if (gap*gap < bestChord) search(lo, mid, next, p, best, bestChord);
+    }
+}
+
+int GpxResortDb::nearest(double lat, double lon, double *metres) const {
+    if (isEmpty()) return -1;
+
+    double p[3];
+    unitVector(lat, lon, p);
+
+    // Chords are at most 2 long
+    int best = -1;
+    double bestChord = 5.0;
+    search(0, _entry.size(), 0, p, best, bestChord);
+
+    if (metres) *metres = metresOf(bestChord);
+    return _entry[best];
+}
+
+int GpxResortDb::identify(GpxFile &gpx, double maxMetres) const {
+    int n = gpx.pointCount();
+    if (n == 0 || isEmpty()) return -1;
+
+    // Resorts found and how many samples were nearest each, with the
+    // closest any of them came
+    int found[Samples], votes[Samples];
+    double closest[Samples];
+    int numFound = 0;
+
+    int samples = std::min(n, int(Samples));
+    for (int s=0; s<samples; ++s) {
+        int i = samples == 1 ? 0 : int(qint64(n-1) * s / (samples-1));
+        double metres;
+        int r = nearest(gpx(i).latitude(), gpx(i).longitude(), &metres);
+        if (metres > maxMetres) continue;
+
+        int k = 0;
+        while (k < numFound && found[k] != r) ++k;
+        if (k == numFound) {
+            found[k] = r;
+            votes[k] = 0;
+            closest[k] = metres;
+            ++numFound;
+        }
+        ++votes[k];
+        closest[k] = std::min(closest[k], metres);
+    }
+
+    int best = -1;
+    for (int k=0; k<numFound; ++k) {
+        if (best < 0 || votes[k] > votes[best] ||
+            (votes[k] == votes[best] && closest[k] < closest[best])) {
+            best = k;
+        }
+    }
+    return best < 0 ? -1 : found[best];
+}
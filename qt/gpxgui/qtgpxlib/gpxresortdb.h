@@ -0,0 +1,96 @@
+// gpxresortdb.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef GPX_RESORT_DB_H
+#define GPX_RESORT_DB_H
+
+#include <QString>
+#include <QVector>
+
+class GpxFile;
+class QIODevice;
+
+// A ski resort from a resort list such as perl/north_america.xml.
+// Numbers the list leaves out are -1.
+struct GpxResort {
+    GpxResort();
+
+    QString name;
+    double latitude;
+    double longitude;
+
+    // Base elevation and vertical drop, in feet
+    double elevation;
+    double vertical;
+
+    int runs;
+    int lifts;
+
+    // Annual snowfall in inches, and the longest run in miles
+    double snowfall;
+    double longestRun;
+
+    QString url;
+};
+
+// Resort list with a k-d tree for finding the resort nearest a point.
+//
+// The tree is over unit vectors on the sphere rather than latitude and
+// longitude, so the antimeridian and the poles need no special cases,
+// and it's laid out implicitly in one array: each range's middle entry
+// splits the rest.
+class GpxResortDb {
+public:
+    GpxResortDb();
+
+    // Read a <resorts> file of <wpt> elements, replacing what was there.
+    // Returns false on error, with the reason in errorString().
+    bool load(const QString &fname);
+    bool read(QIODevice *device);
+    QString errorString() const;
+
+    void clear();
+    int size() const;
+    bool isEmpty() const;
+    const GpxResort &resort(int n) const;
+
+    // The resort closest to lat, lon, or -1 if there are none.  If
+    // metres isn't 0 it's set to the great circle distance.
+    int nearest(double lat, double lon, double *metres = 0) const;
+
+    // The resort gpx was recorded at: the one nearest most of a few
+    // points spread through the file, ignoring points further than
+    // maxMetres from any resort.  -1 if there's none.
+    int identify(GpxFile &gpx, double maxMetres = 25000.0) const;
+
+private:
+    // Points identify() looks at
+    enum { Samples = 16 };
+
+    void build();
+    void search(int lo, int hi, int axis, const double *p, int &best, double &bestChord) const;
+
+    QVector<GpxResort> _resorts;
+
+    // Unit vector of each tree entry, and the resort it is
+    QVector<double> _xyz;
+    QVector<int> _entry;
+
+    QString _error;
+};
+
+#endif
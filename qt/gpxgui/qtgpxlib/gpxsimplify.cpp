@@ -0,0 +1,312 @@
+// gpxsimplify.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gpxsimplify.h"
+#include "gpxfile.h"
+#include "gpxtracksegment.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+
+// Squared distance from p to the line segment a-b, in the x-y plane
+// if z is 0
+inline double segmentDistance2(const double *x, const double *y, const double *z,
+                               int p, int a, int b) {
+    double dx = x[b]-x[a], dy = y[b]-y[a], dz = z ? z[b]-z[a] : 0.0;
+    double px = x[p]-x[a], py = y[p]-y[a], pz = z ? z[p]-z[a] : 0.0;
+
+    double len2 = dx*dx + dy*dy + dz*dz;
+    double t = len2 > 0.0 ? (px*dx + py*dy + pz*dz) / len2 : 0.0;
+    if (t < 0.0) t = 0.0;
+    if (t > 1.0) t = 1.0;
+
+    px -= t*dx;
+    py -= t*dy;
+    pz -= t*dz;
+    return px*px + py*py + pz*pz;
+}
+
+// Area of the triangle a, p, b
+inline double triangleArea(const double *x, const double *y, const double *z,
+                           int a, int p, int b) {
+    double ux = x[p]-x[a], uy = y[p]-y[a], uz = z[p]-z[a];
+    double vx = x[b]-x[a], vy = y[b]-y[a], vz = z[b]-z[a];
+    double cx = uy*vz - uz*vy;
+    double cy = uz*vx - ux*vz;
+    double cz = ux*vy - uy*vx;
+    return 0.5*std::sqrt(cx*cx + cy*cy + cz*cz);
+}
+
+struct HeapEntry {
+    double area;
+    int point;
+};
+
+// Orders the heap smallest area first, then by position, so ties are
+// broken the same way every time
+inline bool operator<(const HeapEntry &a, const HeapEntry &b) {
+    if (a.area != b.area) return a.area > b.area;
+    return a.point > b.point;
+}
+
+}
+
+GpxSimplifier::GpxSimplifier(double tolerance, Algorithm algorithm) :
+    _tolerance(tolerance), _algorithm(algorithm), _preserveElevation(false) {
+}
+
+double GpxSimplifier::tolerance() const {
+    return _tolerance;
+}
+void GpxSimplifier::setTolerance(double metres) {
+    _tolerance = metres;
+}
+
+GpxSimplifier::Algorithm GpxSimplifier::algorithm() const {
+    return _algorithm;
+}
+void GpxSimplifier::setAlgorithm(Algorithm algorithm) {
+    _algorithm = algorithm;
+}
+
+bool GpxSimplifier::preserveElevation() const {
+    return _preserveElevation;
+}
+void GpxSimplifier::setPreserveElevation(bool preserve) {
+    _preserveElevation = preserve;
+}
+
+QVector<int> GpxSimplifier::select(GpxTrackSegment &seg) const {
+    return select(seg, 0, seg.pointCount()-1);
+}
+
+QVector<int> GpxSimplifier::select(GpxTrackSegment &seg, int first, int last) const {
+    QVector<int> indices;
+    if (last < first) return indices;
+    assert(first >= 0 && last < seg.pointCount());
+
+    int n = last-first+1;
+    if (n <= 2) {
+        for (int i=first; i<=last; ++i) indices.push_back(i);
+        return indices;
+    }
+
+    // Local copies, so the algorithms only see plain arrays
+    QVector<double> x(n), y(n), z(n, 0.0);
+    QVector<int> zone(n);
+    const double *ele = seg.elevations() + first;
+    for (int i=0; i<n; ++i) {
+        x[i] = seg.x(first+i);
+        y[i] = seg.y(first+i);
+        zone[i] = seg.north(first+i) ? seg.zone(first+i) : -seg.zone(first+i);
+        if (_preserveElevation) z[i] = ele[i];
+    }
+
+    QVector<bool> keep(n, false);
+    keep[0] = keep[n-1] = true;
+
+    // Each run of points in one zone is simplified on its own
+    int start = 0;
+    for (int i=1; i<=n; ++i) {
+        if (i < n && zone[i] == zone[i-1]) continue;
+        if (_algorithm == DouglasPeucker) {
+            douglasPeucker(x.constData(), y.constData(), z.constData(), start, i-1, keep);
+        } else {
+            visvalingamWhyatt(x.constData(), y.constData(), z.constData(), start, i-1, keep);
+        }
+        keep[start] = keep[i-1] = true;
+        start = i;
+    }
+
+    if (_preserveElevation) {
+        int lo = 0, hi = 0;
+        for (int i=1; i<n; ++i) {
+            if (ele[i] < ele[lo]) lo = i;
+            if (ele[i] > ele[hi]) hi = i;
+        }
+        keep[lo] = keep[hi] = true;
+    }
+
+    for (int i=0; i<n; ++i) {
+        if (keep[i]) indices.push_back(first+i);
+    }
+    return indices;
+}
+
+int gpxFarthestFromChord(const double *x, const double *y, const double *z,
+                         int a, int b, double &dist2) {
+    dist2 = 0.0;
+    int split = -1;
+    for (int i=a+1; i<b; ++i) {
+        double d2 = segmentDistance2(x, y, z, i, a, b);
+        if (d2 > dist2) {
+            dist2 = d2;
+            split = i;
+        }
+    }
+    return split;
+}
+
+void GpxSimplifier::douglasPeucker(const double *x, const double *y, const double *z,
+                                   int first, int last, QVector<bool> &keep) const {
+    double tol2 = _tolerance*_tolerance;
+
+    // Spans still to be checked, as pairs of end points
+    QVector<int> stack;
+    stack.push_back(first);
+    stack.push_back(last);
+    while (!stack.isEmpty()) {
+        int b = stack.last();
+        stack.pop_back();
+        int a = stack.last();
+        stack.pop_back();
+
+        double worst;
+        int split = gpxFarthestFromChord(x, y, z, a, b, worst);
+        if (split < 0 || worst <= tol2) continue;
+
+        keep[split] = true;
+        stack.push_back(a);
+        stack.push_back(split);
+        stack.push_back(split);
+        stack.push_back(b);
+    }
+}
+
+void GpxSimplifier::visvalingamWhyatt(const double *x, const double *y, const double *z,
+                                      int first, int last, QVector<bool> &keep) const {
+    if (last-first < 2) return;
+    double minArea = _tolerance*_tolerance;
+
+    // Neighbours of each point still in the track
+    int n = last-first+1;
+    QVector<int> prev(n), next(n);
+    QVector<double> area(n, 0.0);
+    QVector<bool> removed(n, false);
+
+    QVector<HeapEntry> heap;
+    heap.reserve(n);
+    for (int i=0; i<n; ++i) {
+        prev[i] = i-1;
+        next[i] = i+1;
+        if (i > 0 && i < n-1) {
+            area[i] = triangleArea(x, y, z, first+i-1, first+i, first+i+1);
+            if (area[i] < minArea) {
+                HeapEntry e = { area[i], i };
+                heap.push_back(e);
+            }
+        }
+    }
+    std::make_heap(heap.begin(), heap.end());
+
+    // Only points that could be removed are in the heap.  Entries are
+    // left in it when a point's area changes, and skipped when they no
+    // longer match.
+    while (!heap.isEmpty()) {
+        std::pop_heap(heap.begin(), heap.end());
+        HeapEntry e = heap.last();
+        heap.pop_back();
+
+        int i = e.point;
+        if (removed[i] || e.area != area[i]) continue;
+
+        removed[i] = true;
+        int p = prev[i];
+        int q = next[i];
+        next[p] = q;
+        prev[q] = p;
+
+        // A neighbour's area never drops below the one just removed,
+        // so points go in order of how much they matter
+        int neighbours[] = { p, q };
+        for (int k=0; k<2; ++k) {
+            int j = neighbours[k];
+            if (j == 0 || j == n-1) continue;
+            area[j] = std::max(triangleArea(x, y, z, first+prev[j], first+j, first+next[j]), e.area);
+            if (area[j] < minArea) {
+                HeapEntry u = { area[j], j };
+                heap.push_back(u);
+                std::push_heap(heap.begin(), heap.end());
+            }
+        }
+    }
+
+    for (int i=0; i<n; ++i) {
+        if (!removed[i]) keep[first+i] = true;
+    }
+}
+
+int GpxSimplifier::simplify(GpxTrackSegment &seg) const {
+    QVector<int> indices = select(seg);
+    int removed = seg.pointCount() - indices.size();
+    if (removed > 0) {
+        seg.keepPoints(indices);
+    }
+    return removed;
+}
+
+int GpxSimplifier::simplify(GpxFile &gpx) const {
+    int removed = 0;
+    for (int i=0; i<gpx.segmentCount(); ++i) {
+        removed += simplify(gpx[i]);
+    }
+    return removed;
+}
+
+GpxSimplifyFilter::GpxSimplifyFilter(const GpxSimplifier &simp, qint64 interval) :
+    GpxLoadProgress(interval), simplifier(simp) {
+}
+
+void GpxSimplifyFilter::progress(qint64, qint64, GpxFile &gpx) {
+    simplifyNew(gpx, MinBlock);
+}
+
+void GpxSimplifyFilter::completed(GpxFile &gpx) {
+    simplifyNew(gpx, 1);
+    simplified.clear();
+}
+
+void GpxSimplifyFilter::simplifyNew(GpxFile &gpx, int minPoints) {
+    int segs = gpx.segmentCount();
+
+    // The reader started over
+    if (segs < simplified.size()) simplified.clear();
+    simplified.resize(segs);
+
+    for (int i=0; i<segs; ++i) {
+        int n = gpx.at(i).pointCount();
+        int done = simplified[i];
+        if (n - done < minPoints) continue;
+
+        // Carry on from the last point kept by the previous block
+        int from = done > 0 ? done-1 : 0;
+        QVector<int> indices;
+        indices.reserve(from);
+        for (int j=0; j<from; ++j) {
+            indices.push_back(j);
+        }
+        indices += simplifier.select(gpx[i], from, n-1);
+
+        if (indices.size() < n) {
+            gpx[i].keepPoints(indices);
+        }
+        simplified[i] = indices.size();
+    }
+}
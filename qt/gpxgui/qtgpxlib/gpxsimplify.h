@@ -0,0 +1,121 @@
+// gpxsimplify.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef GPX_SIMPLIFY_H
+#define GPX_SIMPLIFY_H
+
+#include <QVector>
+
+#include "gpxloadprogress.h"
+
+class GpxFile;
+class GpxTrackSegment;
+
+// Reduces the number of points in a track while keeping its shape.
+//
+// The kept points are a subset of the originals, unchanged, so they
+// keep their own timestamps and elevations.  Distances are measured
+// between UTM coordinates, and the points on either side of a change
+// of zone are always kept.
+class GpxSimplifier {
+public:
+    enum Algorithm {
+        // Douglas-Peucker.  Every removed point is within the tolerance
+        // of the simplified track.  O(n log n) on real tracks, though a
+        // track that spirals in on itself can take O(n^2).
+        DouglasPeucker,
+
+        // Visvalingam-Whyatt.  Repeatedly removes the point making the
+        // smallest triangle with its neighbours, until none is smaller
+        // than the square of the tolerance.  Always O(n log n), and
+        // keeps the overall shape better at high reductions, but
+        // there's no bound on how far a removed point was.
+        VisvalingamWhyatt
+    };
+
+    // tolerance is in metres
+    GpxSimplifier(double tolerance = 5.0, Algorithm algorithm = DouglasPeucker);
+
+    double tolerance() const;
+    void setTolerance(double metres);
+
+    Algorithm algorithm() const;
+    void setAlgorithm(Algorithm algorithm);
+
+    // Measure in three dimensions, so climbs and descents are kept as
+    // well as turns, and always keep the highest and lowest points of
+    // whatever is simplified.  Off by default.
+    bool preserveElevation() const;
+    void setPreserveElevation(bool preserve);
+
+    // Indices of the points to keep, in order.  The first and last are
+    // always kept.
+    QVector<int> select(GpxTrackSegment &seg) const;
+
+    // The same for points first to last, inclusive
+    QVector<int> select(GpxTrackSegment &seg, int first, int last) const;
+
+    // Simplify in place.  Returns the number of points removed.
+    int simplify(GpxTrackSegment &seg) const;
+    int simplify(GpxFile &gpx) const;
+
+private:
+    void douglasPeucker(const double *x, const double *y, const double *z,
+                        int first, int last, QVector<bool> &keep) const;
+    void visvalingamWhyatt(const double *x, const double *y, const double *z,
+                           int first, int last, QVector<bool> &keep) const;
+
+    double _tolerance;
+    Algorithm _algorithm;
+    bool _preserveElevation;
+};
+
+// The Douglas-Peucker split: the point strictly between a and b that is
+// farthest from the line segment joining them, or -1 if there are none,
+// with its squared distance in dist2.  z may be 0 to measure in the x-y
+// plane.  GpxQuadtree ranks points with it too.
+int gpxFarthestFromChord(const double *x, const double *y, const double *z,
+                         int a, int b, double &dist2);
+
+// Simplifies a file while it's read, when passed to GpxFile::load, so
+// the whole track is never held in memory.  Each segment is simplified
+// a block at a time as it grows.  The end of each block is always kept,
+// so there are a few more points than simplifying after loading, and
+// with preserveElevation each block keeps its own extremes.
+class GpxSimplifyFilter : public GpxLoadProgress {
+public:
+    GpxSimplifyFilter(const GpxSimplifier &simplifier, qint64 interval = 256*1024);
+
+    void completed(GpxFile &gpx);
+
+protected:
+    void progress(qint64 done, qint64 total, GpxFile &gpx);
+
+private:
+    // Fewest new points worth simplifying before the end of the file
+    enum { MinBlock = 256 };
+
+    void simplifyNew(GpxFile &gpx, int minPoints);
+
+    GpxSimplifier simplifier;
+
+    // How many points at the start of each segment are already
+    // simplified
+    QVector<int> simplified;
+};
+
+#endif
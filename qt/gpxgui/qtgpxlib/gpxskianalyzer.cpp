@@ -0,0 +1,311 @@
+// gpxskianalyzer.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gpxskianalyzer.h"
+#include "gpxfile.h"
+#include "gpxdistance.h"
+#include "gpxutm.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Anything faster than 100 mph is a bad fix
+const double GpxSkiAnalyzer::StopSpeed = 0.5;
+const double GpxSkiAnalyzer::MaxSpeed = 44.7;
+
+namespace {
+
+// Points projected at a time for UtmDistance
+const int Block = 256;
+
+inline bool hasTime(qint64 t) {
+    return t != GpxPoint::NoTime;
+}
+
+}
+
+GpxSkiRun::GpxSkiRun() : start(GpxPoint::NoTime), end(GpxPoint::NoTime),
+                         topLatitude(0.0), topLongitude(0.0), vertical(0.0), distance(0.0),
+                         maxSpeed(0.0), movingTime(0), liftTime(0), liftVertical(0.0) {
+}
+
+double GpxSkiRun::averageSpeed() const {
+    return movingTime > 0 ? distance / (movingTime / 1000.0) : 0.0;
+}
+
+qint64 GpxSkiRun::duration() const {
+    return hasTime(start) && hasTime(end) ? end - start : 0;
+}
+
+void GpxSkiAnalyzer::Stretch::clear() {
+    distance = 0.0;
+    maxSpeed = 0.0;
+    movingTime = 0;
+}
+
+void GpxSkiAnalyzer::Stretch::add(const Stretch &other) {
+    distance += other.distance;
+    maxSpeed = std::max(maxSpeed, other.maxSpeed);
+    movingTime += other.movingTime;
+}
+
+GpxSkiAnalyzer::GpxSkiAnalyzer(double threshold) : _threshold(threshold) {
+    reset();
+}
+
+double GpxSkiAnalyzer::threshold() const {
+    return _threshold;
+}
+
+void GpxSkiAnalyzer::setThreshold(double metres) {
+    _threshold = metres;
+}
+
+void GpxSkiAnalyzer::reset() {
+    _climbing = true;
+    _started = false;
+    _toExtreme.clear();
+    _sinceExtreme.clear();
+    _liftTime = 0;
+    _liftVertical = 0.0;
+    _runs.clear();
+    _totalLiftTime = 0;
+    _totalLiftVertical = 0.0;
+}
+
+void GpxSkiAnalyzer::addPoints(const double *lat, const double *lon, const double *ele,
+                               const qint64 *time, int n) {
+    bool utm = gpxDistanceModel() == UtmDistance;
+    double x[Block], y[Block];
+    signed char zone[Block];
+
+    for (int b=0; b<n; b+=Block) {
+        int m = std::min(n-b, Block);
+        if (utm) {
+            gpxProjectUTM(lat+b, lon+b, m, x, y, zone);
+        }
+
+        for (int k=0; k<m; ++k) {
+            int i = b+k;
+            if (!_started) {
+                _started = true;
+                _climbing = true;
+                _turnLat = _extremeLat = _lastLat = lat[i];
+                _turnLon = _extremeLon = _lastLon = lon[i];
+                _turnEle = _extremeEle = _lastEle = ele[i];
+                _turnTime = _extremeTime = _lastTime = time[i];
+                if (utm) {
+                    _lastX = x[k];
+                    _lastY = y[k];
+                }
+                _toExtreme.clear();
+                _sinceExtreme.clear();
+                continue;
+            }
+
+            double metres;
+            if (utm) {
+                double dx = x[k] - _lastX, dy = y[k] - _lastY, dz = ele[i] - _lastEle;
+                metres = std::sqrt(dx*dx + dy*dy + dz*dz);
+            } else {
+                metres = gpxDistance(_lastLat, _lastLon, _lastEle, lat[i], lon[i], ele[i]);
+            }
+
+            if (addStep(lat[i], lon[i], ele[i], time[i], metres) && utm) {
+                _lastX = x[k];
+                _lastY = y[k];
+            }
+        }
+    }
+}
+
+bool GpxSkiAnalyzer::addStep(double lat, double lon, double ele, qint64 time, double metres) {
+    qint64 dt = hasTime(time) && hasTime(_lastTime) ? time - _lastTime : 0;
+    double speed = dt > 0 ? metres / (dt / 1000.0) : 0.0;
+    if (speed > MaxSpeed) return false;
+
+    Stretch step;
+    step.distance = metres;
+    step.maxSpeed = speed;
+    step.movingTime = speed >= StopSpeed ? dt : 0;
+    _sinceExtreme.add(step);
+
+    _lastLat = lat;
+    _lastLon = lon;
+    _lastEle = ele;
+    _lastTime = time;
+
+    if (_climbing ? ele > _extremeEle : ele < _extremeEle) {
+        // Further the same way
+        _toExtreme.add(_sinceExtreme);
+        _sinceExtreme.clear();
+    } else if (_climbing ? ele > _extremeEle - _threshold : ele < _extremeEle + _threshold) {
+        return true;
+    } else {
+        // Turned.  This is the first point past the threshold, so it's
+        // also the furthest since the old extreme.
+        Stretch rest = _sinceExtreme;
+        endPhase();
+        _climbing = !_climbing;
+        _turnLat = _extremeLat;
+        _turnLon = _extremeLon;
+        _turnEle = _extremeEle;
+        _turnTime = _extremeTime;
+        _toExtreme = rest;
+        _sinceExtreme.clear();
+    }
+
+    _extremeLat = lat;
+    _extremeLon = lon;
+    _extremeEle = ele;
+    _extremeTime = time;
+    return true;
+}
+
+void GpxSkiAnalyzer::endPhase() {
+    qint64 duration = hasTime(_turnTime) && hasTime(_extremeTime) ? _extremeTime - _turnTime : 0;
+
+    if (_climbing) {
+        _liftTime += duration;
+        _liftVertical += _extremeEle - _turnEle;
+        _totalLiftTime += duration;
+        _totalLiftVertical += _extremeEle - _turnEle;
+        return;
+    }
+
+    GpxSkiRun run;
+    run.start = _turnTime;
+    run.end = _extremeTime;
+    run.topLatitude = _turnLat;
+    run.topLongitude = _turnLon;
+    run.vertical = _turnEle - _extremeEle;
+    run.distance = _toExtreme.distance;
+    run.maxSpeed = _toExtreme.maxSpeed;
+    run.movingTime = _toExtreme.movingTime;
+    run.liftTime = _liftTime;
+    run.liftVertical = _liftVertical;
+    _runs.push_back(run);
+
+    _liftTime = 0;
+    _liftVertical = 0.0;
+}
+
+void GpxSkiAnalyzer::endSegment() {
+    if (_started) {
+        endPhase();
+        _started = false;
+    }
+}
+
+void GpxSkiAnalyzer::finish() {
+    endSegment();
+}
+
+void GpxSkiAnalyzer::analyze(GpxFile &gpx) {
+    reset();
+    for (int i=0; i<gpx.segmentCount(); ++i) {
+        const GpxTrackSegment &seg = gpx.at(i);
+        addPoints(seg.latitudes(), seg.longitudes(), seg.elevations(), seg.timestamps(),
+                  seg.pointCount());
+        endSegment();
+    }
+    finish();
+}
+
+const QVector<GpxSkiRun> &GpxSkiAnalyzer::runs() const {
+    return _runs;
+}
+
+double GpxSkiAnalyzer::verticalSkied() const {
+    double total = 0.0;
+    for (int i=0; i<_runs.size(); ++i) {
+        total += _runs[i].vertical;
+    }
+    return total;
+}
+
+double GpxSkiAnalyzer::distanceSkied() const {
+    double total = 0.0;
+    for (int i=0; i<_runs.size(); ++i) {
+        total += _runs[i].distance;
+    }
+    return total;
+}
+
+double GpxSkiAnalyzer::maxSpeed() const {
+    double best = 0.0;
+    for (int i=0; i<_runs.size(); ++i) {
+        best = std::max(best, _runs[i].maxSpeed);
+    }
+    return best;
+}
+
+qint64 GpxSkiAnalyzer::skiTime() const {
+    qint64 total = 0;
+    for (int i=0; i<_runs.size(); ++i) {
+        total += _runs[i].duration();
+    }
+    return total;
+}
+
+qint64 GpxSkiAnalyzer::liftTime() const {
+    return _totalLiftTime;
+}
+
+double GpxSkiAnalyzer::liftVertical() const {
+    return _totalLiftVertical;
+}
+
+GpxSkiAnalysisFilter::GpxSkiAnalysisFilter(GpxSkiAnalyzer &a, qint64 interval) :
+    GpxLoadProgress(interval), analyzer(a), current(-1), lastDone(0) {
+}
+
+void GpxSkiAnalysisFilter::progress(qint64 done, qint64, GpxFile &gpx) {
+    // The reader started over
+    if (done < lastDone) current = -1;
+    lastDone = done;
+
+    analyzeNew(gpx);
+}
+
+void GpxSkiAnalysisFilter::completed(GpxFile &gpx) {
+    analyzeNew(gpx);
+    analyzer.finish();
+    current = -1;
+    lastDone = 0;
+}
+
+void GpxSkiAnalysisFilter::analyzeNew(GpxFile &gpx) {
+    if (current < 0) {
+        analyzer.reset();
+        current = 0;
+    }
+
+    // Earlier segments are finished once the reader has started another
+    for (int i=current; i<gpx.segmentCount(); ++i) {
+        if (i > current) {
+            analyzer.endSegment();
+            current = i;
+        }
+        const GpxTrackSegment &seg = gpx.at(i);
+        if (seg.pointCount() == 0) continue;
+
+        analyzer.addPoints(seg.latitudes(), seg.longitudes(), seg.elevations(), seg.timestamps(),
+                           seg.pointCount());
+        gpx[i].keepPoints(QVector<int>());
+    }
+}
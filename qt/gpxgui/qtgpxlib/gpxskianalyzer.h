@@ -0,0 +1,189 @@
+// gpxskianalyzer.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef GPX_SKI_ANALYZER_H
+#define GPX_SKI_ANALYZER_H
+
+#include <QVector>
+
+#include "gpxloadprogress.h"
+
+class GpxFile;
+
+// One descent, and the lift ride that came before it
+struct GpxSkiRun {
+    GpxSkiRun();
+
+    // Milliseconds since 1970, as GpxPoint::timestamp(), at the top and
+    // the bottom
+    qint64 start;
+    qint64 end;
+
+    // Where the run started
+    double topLatitude;
+    double topLongitude;
+
+    // Metres from the top to the bottom, and along the way
+    double vertical;
+    double distance;
+
+    // In metres per second.  The average leaves out time spent standing
+    // still.
+    double maxSpeed;
+    double averageSpeed() const;
+
+    // Milliseconds moving faster than GpxSkiAnalyzer::StopSpeed
+    qint64 movingTime;
+
+    // Milliseconds and metres climbed on the way up, 0 for a run that
+    // doesn't start with a climb
+    qint64 liftTime;
+    double liftVertical;
+
+    qint64 duration() const;
+};
+
+// Splits a day's tracks into runs and lift rides in one pass.
+//
+// The track is always either climbing or descending.  A climb becomes a
+// descent once the elevation is threshold below the highest point since
+// the climb started, and the descent starts from that highest point;
+// likewise the other way round.  Dips and bumps smaller than threshold
+// stay part of the run or ride they're in, so GPS noise in the
+// elevation doesn't split runs.  Steps faster than MaxSpeed are
+// dropped as glitches.
+//
+// Only the runs found so far are stored, so the memory used doesn't
+// depend on the number of points.  Distances use gpxDistanceModel().
+class GpxSkiAnalyzer {
+public:
+    // Metres per second
+    static const double StopSpeed;
+    static const double MaxSpeed;
+
+    // threshold is in metres
+    GpxSkiAnalyzer(double threshold = 30.0);
+
+    double threshold() const;
+    void setThreshold(double metres);
+
+    // Forget everything seen so far
+    void reset();
+
+    // Continue the track with n more points.  Timestamps are in
+    // milliseconds, or GpxPoint::NoTime.
+    void addPoints(const double *lat, const double *lon, const double *ele,
+                   const qint64 *time, int n);
+
+    // The next point doesn't follow on from the last one, as at the
+    // start of a new track segment.  Ends the current run or ride at its
+    // lowest or highest point.
+    void endSegment();
+
+    // End the last run or ride
+    void finish();
+
+    // reset(), every segment of gpx, then finish()
+    void analyze(GpxFile &gpx);
+
+    const QVector<GpxSkiRun> &runs() const;
+
+    // Totals over every run, and every lift ride including any after
+    // the last run
+    double verticalSkied() const;
+    double distanceSkied() const;
+    double maxSpeed() const;
+    qint64 skiTime() const;
+    qint64 liftTime() const;
+    double liftVertical() const;
+
+private:
+    // Totals for part of a run or ride
+    struct Stretch {
+        double distance;
+        double maxSpeed;
+        qint64 movingTime;
+        void clear();
+        void add(const Stretch &other);
+    };
+
+    // Record the phase from the turn to the extreme, as a lift ride or
+    // a run
+    void endPhase();
+
+    // Extend the phase to the next point.  Returns false if the step
+    // was dropped.
+    bool addStep(double lat, double lon, double ele, qint64 time, double metres);
+
+    double _threshold;
+
+    bool _climbing;
+    bool _started;
+
+    // The point the phase started from, and the highest point of a
+    // climb or lowest of a descent since then
+    double _turnLat, _turnLon, _turnEle;
+    qint64 _turnTime;
+    double _extremeLat, _extremeLon, _extremeEle;
+    qint64 _extremeTime;
+
+    // From the turn to the extreme, and from the extreme to the last
+    // point.  Only the first counts if the phase ends now.
+    Stretch _toExtreme;
+    Stretch _sinceExtreme;
+
+    // The last point, for the next step
+    double _lastLat, _lastLon, _lastEle;
+    qint64 _lastTime;
+    double _lastX, _lastY;
+
+    // The last ride up, waiting for a run to attach to
+    qint64 _liftTime;
+    double _liftVertical;
+
+    QVector<GpxSkiRun> _runs;
+    qint64 _totalLiftTime;
+    double _totalLiftVertical;
+};
+
+// Analyzes a file while it's read, when passed to GpxFile::load.  Points
+// are dropped from the file as they're analyzed, so the file is left
+// empty and the track is never held in memory.  The analyzer is reset
+// when loading starts, or when a reader starts the file over, and
+// finished when it's done.
+class GpxSkiAnalysisFilter : public GpxLoadProgress {
+public:
+    GpxSkiAnalysisFilter(GpxSkiAnalyzer &analyzer, qint64 interval = 256*1024);
+
+    void completed(GpxFile &gpx);
+
+protected:
+    void progress(qint64 done, qint64 total, GpxFile &gpx);
+
+private:
+    void analyzeNew(GpxFile &gpx);
+
+    GpxSkiAnalyzer &analyzer;
+
+    // The segment being fed to the analyzer, -1 before the first
+    int current;
+
+    // Bytes read at the last report, to see the reader start over
+    qint64 lastDone;
+};
+
+#endif
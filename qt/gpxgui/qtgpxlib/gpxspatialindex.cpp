@@ -0,0 +1,341 @@
+// gpxspatialindex.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gpxspatialindex.h"
+#include "gpxdistance.h"
+#include "gpxtracksegment.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace {
+
+const double Pi = 3.14159265358979323846;
+
+// Position of x, y along a Hilbert curve filling a 2^16 square
+quint32 hilbert(quint32 x, quint32 y) {
+    quint32 d = 0;
+    for (quint32 s = 1<<15; s > 0; s >>= 1) {
+        quint32 rx = (x & s) ? 1 : 0;
+        quint32 ry = (y & s) ? 1 : 0;
+        d += s * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = 0xffff - x;
+                y = 0xffff - y;
+            }
+            quint32 t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
+
+// Scale v from lo..hi to 0..0xffff
+quint32 toGrid(double v, double lo, double hi) {
+    if (!(hi > lo)) return 0;
+    double g = (v - lo) / (hi - lo) * 65535.0;
+    return g < 0.0 ? 0 : (g > 65535.0 ? 0xffff : quint32(g));
+}
+
+// Degrees east from lon to the nearest longitude in lo..hi, either way
+// round the globe
+double lonGap(double lon, double lo, double hi) {
+    if (lon >= lo && lon <= hi) return 0.0;
+    double east = std::fmod(lo - lon + 720.0, 360.0);
+    double west = std::fmod(lon - hi + 720.0, 360.0);
+    return std::min(east, west);
+}
+
+inline double haversineOf(double angle) {
+    double s = std::sin(angle/2);
+    return s*s;
+}
+
+inline double metresOf(double h) {
+    return 2*GpxMeanRadius * std::asin(std::sqrt(std::min(h, 1.0)));
+}
+
+// Node or point waiting to be looked at by nearest()
+struct Candidate {
+    double h;
+    int level;
+    int n;
+};
+
+// Closest first
+inline bool operator<(const Candidate &a, const Candidate &b) {
+    return a.h > b.h;
+}
+
+}
+
+GpxSpatialIndex::GpxSpatialIndex() {
+}
+
+void GpxSpatialIndex::clear() {
+    _lat.clear();
+    _lon.clear();
+    _point.clear();
+    _boxes.clear();
+    _levels.clear();
+}
+
+int GpxSpatialIndex::size() const {
+    return _point.size();
+}
+
+bool GpxSpatialIndex::isEmpty() const {
+    return _point.isEmpty();
+}
+
+void GpxSpatialIndex::build(const QList<GpxTrackSegment> &segments) {
+    clear();
+
+    int n = 0;
+    double minLat = 90.0, maxLat = -90.0, minLon = 180.0, maxLon = -180.0;
+    for (int s=0; s<segments.size(); ++s) {
+        const double *lat = segments[s].latitudes();
+        const double *lon = segments[s].longitudes();
+        for (int i=0; i<segments[s].pointCount(); ++i) {
+            minLat = std::min(minLat, lat[i]);
+            maxLat = std::max(maxLat, lat[i]);
+            minLon = std::min(minLon, lon[i]);
+            maxLon = std::max(maxLon, lon[i]);
+        }
+        n += segments[s].pointCount();
+    }
+    if (n == 0) return;
+
+    // Sort by Hilbert position, then by index
+    QVector<quint64> keys(n);
+    int k = 0;
+    for (int s=0; s<segments.size(); ++s) {
+        const double *lat = segments[s].latitudes();
+        const double *lon = segments[s].longitudes();
+        for (int i=0; i<segments[s].pointCount(); ++i, ++k) {
+            quint32 h = hilbert(toGrid(lon[i], minLon, maxLon), toGrid(lat[i], minLat, maxLat));
+            keys[k] = (quint64(h) << 32) | quint32(k);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+
+    // Where each segment starts, to look points up by index
+    QVector<const double*> lats, lons;
+    QVector<int> starts;
+    k = 0;
+    for (int s=0; s<segments.size(); ++s) {
+        lats.push_back(segments[s].latitudes());
+        lons.push_back(segments[s].longitudes());
+        starts.push_back(k);
+        k += segments[s].pointCount();
+    }
+
+    _lat.resize(n);
+    _lon.resize(n);
+    _point.resize(n);
+    for (int i=0; i<n; ++i) {
+        int p = int(keys[i] & 0xffffffff);
+        int s = int(std::upper_bound(starts.begin(), starts.end(), p) - starts.begin()) - 1;
+        _lat[i] = lats[s][p - starts[s]];
+        _lon[i] = lons[s][p - starts[s]];
+        _point[i] = p;
+    }
+
+    // Each level boxes NodeSize entries of the one below
+    _levels.push_back(0);
+    int below = n;
+    for (int level=1; level == 1 || below > 1; ++level) {
+        int count = (below + NodeSize - 1) / NodeSize;
+        int first = _levels.last();
+        _boxes.resize(4*(first + count));
+        for (int node=0; node<count; ++node) {
+            double *box = _boxes.data() + 4*(first + node);
+            int c0 = firstChild(node);
+            int c1 = std::min(c0 + int(NodeSize), below);
+            if (level == 1) {
+                box[0] = box[2] = _lat[c0];
+                box[1] = box[3] = _lon[c0];
+                for (int c=c0+1; c<c1; ++c) {
+                    box[0] = std::min(box[0], _lat[c]);
+                    box[1] = std::min(box[1], _lon[c]);
+                    box[2] = std::max(box[2], _lat[c]);
+                    box[3] = std::max(box[3], _lon[c]);
+                }
+            } else {
+                const double *child = _boxes.constData() + 4*(_levels[level-2] + c0);
+                box[0] = child[0];
+                box[1] = child[1];
+                box[2] = child[2];
+                box[3] = child[3];
+                for (int c=1; c<c1-c0; ++c) {
+                    box[0] = std::min(box[0], child[4*c]);
+                    box[1] = std::min(box[1], child[4*c+1]);
+                    box[2] = std::max(box[2], child[4*c+2]);
+                    box[3] = std::max(box[3], child[4*c+3]);
+                }
+            }
+        }
+        _levels.push_back(first + count);
+        below = count;
+    }
+}
+
+int GpxSpatialIndex::levelSize(int level) const {
+    if (level == 0) return _point.size();
+    return _levels[level] - _levels[level-1];
+}
+
+int GpxSpatialIndex::firstChild(int n) const {
+    return n*NodeSize;
+}
+
+int GpxSpatialIndex::lastChild(int level, int n) const {
+    return std::min((n+1)*int(NodeSize), levelSize(level-1));
+}
+
+double GpxSpatialIndex::pointHaversine(int i, double lat, double lon, double cosLat) const {
+    double sphi = std::sin((_lat[i] - lat) * (GpxDegree/2));
+    double slam = std::sin((_lon[i] - lon) * (GpxDegree/2));
+    return sphi*sphi + cosLat*std::cos(_lat[i]*GpxDegree)*slam*slam;
+}
+
+// A point in the box is at least as far away as the latitude gap, and
+// at least as far as the great circle through the nearest meridian
+// that bounds it, which is asin(cos lat * sin gap) away.
+double GpxSpatialIndex::nodeBound(int level, int n, double lat, double lon, double cosLat) const {
+    const double *box = _boxes.constData() + 4*(_levels[level-1] + n);
+
+    double angle = 0.0;
+    if (lat < box[0]) {
+        angle = (box[0] - lat) * GpxDegree;
+    } else if (lat > box[2]) {
+        angle = (lat - box[2]) * GpxDegree;
+    }
+
+    double gap = lonGap(lon, box[1], box[3]);
+    if (gap > 0.0) {
+        double meridian = std::asin(cosLat * std::sin(std::min(gap, 90.0) * GpxDegree));
+        angle = std::max(angle, meridian);
+    }
+    return haversineOf(angle);
+}
+
+int GpxSpatialIndex::nearest(double lat, double lon, double *metres) const {
+    if (isEmpty()) return -1;
+
+    double cosLat = std::cos(lat*GpxDegree);
+
+    // Best first: the first point off the queue is closer than anything
+    // still in it could be.  Nothing further than the closest point seen
+    // so far is worth queueing.
+    std::priority_queue<Candidate> queue;
+    Candidate root = { 0.0, _levels.size()-1, 0 };
+    queue.push(root);
+    double best = 2.0;
+    while (!queue.empty()) {
+        Candidate c = queue.top();
+        queue.pop();
+
+        if (c.level == 0) {
+            if (metres) *metres = metresOf(c.h);
+            return _point[c.n];
+        }
+        for (int child=firstChild(c.n); child<lastChild(c.level, c.n); ++child) {
+            Candidate next;
+            next.level = c.level-1;
+            next.n = child;
+            if (next.level == 0) {
+                next.h = pointHaversine(child, lat, lon, cosLat);
+                if (next.h >= best) continue;
+                best = next.h;
+            } else {
+                next.h = nodeBound(next.level, child, lat, lon, cosLat);
+                if (next.h >= best) continue;
+            }
+            queue.push(next);
+        }
+    }
+    return -1;
+}
+
+QVector<int> GpxSpatialIndex::inBox(double minLat, double minLon, double maxLat, double maxLon) const {
+    QVector<int> found;
+    if (isEmpty()) return found;
+
+    // Pairs of level and node still to visit
+    QVector<int> stack;
+    stack.push_back(_levels.size()-1);
+    stack.push_back(0);
+    while (!stack.isEmpty()) {
+        int n = stack.last();
+        stack.pop_back();
+        int level = stack.last();
+        stack.pop_back();
+
+        for (int child=firstChild(n); child<lastChild(level, n); ++child) {
+            if (level == 1) {
+                if (_lat[child] >= minLat && _lat[child] <= maxLat &&
+                    _lon[child] >= minLon && _lon[child] <= maxLon) {
+                    found.push_back(_point[child]);
+                }
+                continue;
+            }
+            const double *box = _boxes.constData() + 4*(_levels[level-2] + child);
+            if (box[0] > maxLat || box[2] < minLat || box[1] > maxLon || box[3] < minLon) {
+                continue;
+            }
+            stack.push_back(level-1);
+            stack.push_back(child);
+        }
+    }
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+QVector<int> GpxSpatialIndex::withinDistance(double lat, double lon, double metres) const {
+    QVector<int> found;
+    if (isEmpty() || metres < 0.0) return found;
+
+    double cosLat = std::cos(lat*GpxDegree);
+    double limit = haversineOf(std::min(metres / GpxMeanRadius, Pi));
+
+    QVector<int> stack;
+    stack.push_back(_levels.size()-1);
+    stack.push_back(0);
+    while (!stack.isEmpty()) {
+        int n = stack.last();
+        stack.pop_back();
+        int level = stack.last();
+        stack.pop_back();
+
+        for (int child=firstChild(n); child<lastChild(level, n); ++child) {
+            if (level == 1) {
+                if (pointHaversine(child, lat, lon, cosLat) <= limit) {
+                    found.push_back(_point[child]);
+                }
+            } else if (nodeBound(level-1, child, lat, lon, cosLat) <= limit) {
+                stack.push_back(level-1);
+                stack.push_back(child);
+            }
+        }
+    }
+    std::sort(found.begin(), found.end());
+    return found;
+}
@@ -0,0 +1,88 @@
+// gpxspatialindex.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef GPX_SPATIAL_INDEX_H
+#define GPX_SPATIAL_INDEX_H
+
+#include <QList>
+#include <QVector>
+
+class GpxTrackSegment;
+
+// Packed R-tree over track points by latitude and longitude.
+//
+// Points are sorted along a Hilbert curve and grouped NodeSize at a
+// time, and each level of nodes is grouped the same way until there's
+// one left.  The tree is a few flat arrays with no pointers: a node's
+// children are the NodeSize entries of the level below starting at
+// node*NodeSize.
+//
+// Points are identified by their index across all segments, as used by
+// GpxFile::point(n).  Distances are great circle distances on the same
+// sphere as SphericalDistance, without elevation.
+class GpxSpatialIndex {
+public:
+    GpxSpatialIndex();
+
+    // Index every point of segments, replacing what was there
+    void build(const QList<GpxTrackSegment> &segments);
+    void clear();
+
+    int size() const;
+    bool isEmpty() const;
+
+    // The point closest to lat, lon, or -1 if there are none.
+    // If metres isn't 0 it's set to the distance.
+    int nearest(double lat, double lon, double *metres = 0) const;
+
+    // Points with minLat <= latitude <= maxLat and minLon <= longitude
+    // <= maxLon, in increasing order
+    QVector<int> inBox(double minLat, double minLon, double maxLat, double maxLon) const;
+
+    // Points at most metres from lat, lon, in increasing order
+    QVector<int> withinDistance(double lat, double lon, double metres) const;
+
+private:
+    enum { NodeSize = 16 };
+
+    // Smallest possible haversine of the distance from lat, lon to
+    // anything in node n of level
+    double nodeBound(int level, int n, double lat, double lon, double cosLat) const;
+
+    // Haversine of the distance from lat, lon to point i in Hilbert order
+    double pointHaversine(int i, double lat, double lon, double cosLat) const;
+
+    // First and one past the last child of node n of level
+    int firstChild(int n) const;
+    int lastChild(int level, int n) const;
+
+    int levelSize(int level) const;
+
+    // Point coordinates in Hilbert order, and their indices in the file
+    QVector<double> _lat;
+    QVector<double> _lon;
+    QVector<int> _point;
+
+    // minLat, minLon, maxLat, maxLon of each node, level 1 first
+    QVector<double> _boxes;
+
+    // Index of the first node of each level in _boxes, from level 1,
+    // followed by the total.  Level 0 is the points themselves.
+    QVector<int> _levels;
+};
+
+#endif
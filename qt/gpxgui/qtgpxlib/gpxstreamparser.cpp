@@ -0,0 +1,165 @@
+// gpxstreamparser.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "gpxstreamparser.h"
+#include "gpxfile.h"
+#include "fastparse.h"
+
+#include <QIODevice>
+
+GpxStreamParser::GpxStreamParser(GpxFile &file) : gpx(file), inTrack(false), progress(0), openTags(0),
+                                                  clat(0.0), clon(0.0), cele(0.0), ctime(GpxPoint::NoTime) {
+    curVal.reserve(64);
+}
+
+// Helpers to run the fast parsers directly on Qt's UTF-16 data
+static inline bool parseDouble(const QStringRef &str, double &value) {
+    const ushort *b = reinterpret_cast<const ushort*>(str.unicode());
+    return parseDouble(b, b+str.size(), value);
+}
+static inline bool parseDouble(const QString &str, double &value) {
+    return parseDouble(str.utf16(), str.utf16()+str.size(), value);
+}
+static inline bool parseInt(const QString &str, int &value) {
+    return parseInt(str.utf16(), str.utf16()+str.size(), value);
+}
+static inline bool parseIsoTime(const QString &str, qint64 &msecs) {
+    return parseIsoTime(str.utf16(), str.utf16()+str.size(), msecs);
+}
+
+bool GpxStreamParser::parse(QIODevice *device) {
+    QXmlStreamReader xml(device);
+
+    // Sequential devices report a size of 0, which means unknown
+    qint64 size = device->size();
+
+    while (!xml.atEnd()) {
+        switch (xml.readNext()) {
+        case QXmlStreamReader::StartElement:
+            startElement(gpxTag(xml.name()), xml);
+            break;
+
+        case QXmlStreamReader::EndElement:
+            endElement(gpxTag(xml.name()));
+            if (progress && !progress->report(device->pos(), size, gpx)) {
+                error = "Cancelled";
+                return false;
+            }
+            break;
+
+        case QXmlStreamReader::Characters:
+            // Only leaf elements have character data we want
+            if (!xml.isWhitespace()) {
+                curVal.append(xml.text());
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+    if (xml.hasError()) {
+        error = QString("%1 at line %2").arg(xml.errorString()).arg(xml.lineNumber());
+        return false;
+    }
+    return true;
+}
+
+QString GpxStreamParser::errorString() const {
+    return error;
+}
+
+void GpxStreamParser::setProgress(GpxLoadProgress *p) {
+    progress = p;
+}
+
+void GpxStreamParser::startElement(GpxTag tag, QXmlStreamReader &xml) {
+    curVal.resize(0);
+    openTags |= gpxTagBit(tag);
+
+    switch (tag) {
+    case TagTrk:
+        // Add a new track segment for the points that follow
+        gpx.addTrack(GpxTrackSegment());
+        inTrack = true;
+        break;
+
+    case TagTrkpt: {
+        QXmlStreamAttributes attrs = xml.attributes();
+        clat = clon = cele = 0.0;
+        parseDouble(attrs.value(QLatin1String("lat")), clat);
+        parseDouble(attrs.value(QLatin1String("lon")), clon);
+        ctime = GpxPoint::NoTime;
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void GpxStreamParser::endElement(GpxTag tag) {
+    switch (tag) {
+    case TagTime:
+        if (isOpen(TagTrkpt)) {
+            if (!parseIsoTime(curVal, ctime)) {
+                ctime = GpxPoint::NoTime;
+            }
+        } else if (!isOpen(TagTrk)) {
+            qint64 msecs;
+            if (parseIsoTime(curVal, msecs)) {
+                gpx.setTime(GpxPoint::toDateTime(msecs));
+            }
+        }
+        break;
+
+    case TagName:
+        if (inTrack && !isOpen(TagTrkpt)) {
+            gpx.lastSegment().setName(curVal);
+        }
+        break;
+
+    case TagNumber:
+        if (inTrack && !isOpen(TagTrkpt)) {
+            int number = 0;
+            parseInt(curVal, number);
+            gpx.lastSegment().setNumber(number);
+        }
+        break;
+
+    case TagEle:
+        if (isOpen(TagTrkpt)) {
+            parseDouble(curVal, cele);
+        }
+        break;
+
+    case TagTrkpt:
+        if (inTrack && isOpen(TagTrkseg)) {
+            gpx.addPoint(GpxPoint(clat, clon, cele, ctime));
+        }
+        break;
+
+    case TagTrk:
+        inTrack = false;
+        break;
+
+    default:
+        break;
+    }
+
+    openTags &= ~gpxTagBit(tag);
+    curVal.resize(0);
+}
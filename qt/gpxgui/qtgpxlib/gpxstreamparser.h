@@ -0,0 +1,75 @@
+// gpxstreamparser.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef GPX_STREAM_PARSER_H
+#define GPX_STREAM_PARSER_H
+
+#include <QString>
+#include <QXmlStreamReader>
+
+#include "gpxtag.h"
+
+class GpxFile;
+class GpxLoadProgress;
+class GpxTrackSegment;
+class QIODevice;
+
+// Pull parser for GPX files built on QXmlStreamReader.
+// Tag names are interned to a GpxTag once per element, and the set of
+// currently open elements is kept in a bitmask, so there are no string
+// keyed lookups or per tag allocations while reading points.
+class GpxStreamParser {
+public:
+    GpxStreamParser(GpxFile &file);
+
+    bool parse(QIODevice *device);
+
+    QString errorString() const;
+
+    // Report progress to, and stop when cancelled by, progress
+    void setProgress(GpxLoadProgress *progress);
+
+private:
+    bool isOpen(GpxTag tag) const {
+        return (openTags & gpxTagBit(tag)) != 0;
+    }
+
+    void startElement(GpxTag tag, QXmlStreamReader &xml);
+    void endElement(GpxTag tag);
+
+    GpxFile &gpx;
+
+    // Inside a <trk>, whose points go to the file's last segment.  It's
+    // reached through the file each time, so the file's caches see
+    // every change.
+    bool inTrack;
+
+    GpxLoadProgress *progress;
+
+    // Bitmask of open elements, indexed by GpxTag
+    unsigned int openTags;
+
+    // Character data of the innermost open element.
+    // Reused between elements so its buffer is only allocated once.
+    QString curVal;
+
+    QString error;
+
+    double clat, clon, cele;
+    qint64 ctime;
+};
+
+#endif
@@ -0,0 +1,66 @@
+// gpxtag.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "gpxtag.h"
+
+#include <cstring>
+
+// Both versions switch on the length first, so most names are
+// rejected or accepted with a single comparison.
+
+GpxTag gpxTag(const QStringRef &name) {
+    switch (name.size()) {
+    case 3:
+        if (name == QLatin1String("ele")) return TagEle;
+        if (name == QLatin1String("trk")) return TagTrk;
+        if (name == QLatin1String("gpx")) return TagGpx;
+        break;
+    case 4:
+        if (name == QLatin1String("time")) return TagTime;
+        if (name == QLatin1String("name")) return TagName;
+        break;
+    case 5:
+        if (name == QLatin1String("trkpt")) return TagTrkpt;
+        break;
+    case 6:
+        if (name == QLatin1String("number")) return TagNumber;
+        if (name == QLatin1String("trkseg")) return TagTrkseg;
+        break;
+    }
+    return TagUnknown;
+}
+
+GpxTag gpxTag(const char *name, int len) {
+    switch (len) {
+    case 3:
+        if (std::memcmp(name, "ele", 3) == 0) return TagEle;
+        if (std::memcmp(name, "trk", 3) == 0) return TagTrk;
+        if (std::memcmp(name, "gpx", 3) == 0) return TagGpx;
+        break;
+    case 4:
+        if (std::memcmp(name, "time", 4) == 0) return TagTime;
+        if (std::memcmp(name, "name", 4) == 0) return TagName;
+        break;
+    case 5:
+        if (std::memcmp(name, "trkpt", 5) == 0) return TagTrkpt;
+        break;
+    case 6:
+        if (std::memcmp(name, "number", 6) == 0) return TagNumber;
+        if (std::memcmp(name, "trkseg", 6) == 0) return TagTrkseg;
+        break;
+    }
+    return TagUnknown;
+}
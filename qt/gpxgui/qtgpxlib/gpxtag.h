@@ -0,0 +1,44 @@
+// gpxtag.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef GPX_TAG_H
+#define GPX_TAG_H
+
+#include <QString>
+
+// GPX elements the parsers care about.
+// Element names are mapped to these once, so parsers can switch on
+// them and keep the set of open elements in a bitmask.
+enum GpxTag {
+    TagUnknown = 0,
+    TagGpx,
+    TagTime,
+    TagTrk,
+    TagName,
+    TagNumber,
+    TagTrkseg,
+    TagTrkpt,
+    TagEle
+};
+
+inline unsigned int gpxTagBit(GpxTag tag) {
+    return 1u << tag;
+}
+
+GpxTag gpxTag(const QStringRef &name);
+GpxTag gpxTag(const char *name, int len);
+
+#endif
@@ -15,126 +15,337 @@
 // OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include "gpxtracksegment.h"
+#include "gpxkernels.h"
+#include "gpxwriter.h"
+#include "gpxutm.h"
+
+#include <QBuffer>
 
 #include <cassert>
+#include <cstring>
 
-GpxTrackSegment::GpxTrackSegment() : _name(""), _number(0) { }
+GpxTrackSegment::GpxTrackSegment() : _name(""), _number(0), _cached(0),
+                                     _distanceModel(gpxDistanceModel()), _length(0.0), _maxSpeed(0.0) { }
 
 // Convert to an XML string;
 void GpxTrackSegment::toXml(QString &xmlStr) {
-    xmlStr += QString("<trk><name>%1</name>").arg(_name);
-    if (_number > 0) {
-        xmlStr += QString("<number>%1</number>").arg(_number);
-    }
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
 
-    xmlStr += "<trkseg>";
-    for (int i=0; i<track_pts.size(); ++i) {
-        track_pts[i].toXml(xmlStr);
+    GpxWriter writer(&buffer);
+    writer.writeTrack(*this);
+    writer.flush();
+    xmlStr += QString::fromUtf8(bytes.constData(), bytes.size());
+}
+
+// Drop cached distances computed with another distance model
+void GpxTrackSegment::checkDistanceModel() {
+    GpxDistanceModel model = gpxDistanceModel();
+    if (model != _distanceModel) {
+        _cached &= ~(LengthStat | MaxSpeedStat);
+        _distanceModel = model;
     }
-    xmlStr += "</trkseg></trk>";
 }
 
 // Calculate the length of the track segment
 double GpxTrackSegment::length() {
-    double dist = 0.0;
-    for (int i=0; i< track_pts.size()-1; ++i) {
-        dist += track_pts[i].distanceTo(track_pts[i+1]);
+    checkDistanceModel();
+    if (!(_cached & LengthStat)) {
+        if (_distanceModel == UtmDistance) {
+            project();
+            _length = gpxPathLength(_x.constData(), _y.constData(), _ele.constData(), _lat.size());
+        } else {
+            _length = gpxLatLonPathLength(_lat.constData(), _lon.constData(), _ele.constData(),
+                                          _lat.size(), _distanceModel);
+        }
+        _cached |= LengthStat;
     }
-    return dist;
+    return _length;
 }
 
 time_t GpxTrackSegment::duration() {
-    if (track_pts.size()<2) return 0;
-    return track_pts[0].secondsBetween(track_pts[track_pts.size()-1]);
+    if (_time.size()<2) return 0;
+    qint64 first = _time.at(0), last = _time.at(_time.size()-1);
+    if (first == GpxPoint::NoTime || last == GpxPoint::NoTime) return 0;
+    return (last - first) / 1000;
 }
 
 double GpxTrackSegment::maxSpeed() {
-    double curMax = 0.0;
-    for (int i=0; i< track_pts.size()-1; ++i) {
-
-        double spd = track_pts[i].speedBetween(track_pts[i+1]);
-
-        if (spd > curMax) {
-            curMax = spd;
+    checkDistanceModel();
+    if (!(_cached & MaxSpeedStat)) {
+        if (_distanceModel == UtmDistance) {
+            project();
+            _maxSpeed = gpxMaxSpeed(_x.constData(), _y.constData(), _ele.constData(),
+                                    _time.constData(), _lat.size());
+        } else {
+            _maxSpeed = gpxLatLonMaxSpeed(_lat.constData(), _lon.constData(), _ele.constData(),
+                                          _time.constData(), _lat.size(), _distanceModel);
         }
+        _cached |= MaxSpeedStat;
     }
-    return curMax;
+    return _maxSpeed;
 }
 
-GpxPoint& GpxTrackSegment::operator [](int n) {
-    assert(n<track_pts.size());
+GpxPointRef GpxTrackSegment::operator [](int n) {
+    assert(n<_lat.size());
 
-    return track_pts[n];
+    return GpxPointRef(this, n);
+}
+
+GpxPoint GpxTrackSegment::point(int n) {
+    assert(n<_lat.size());
+
+    return GpxPoint(_lat.at(n), _lon.at(n), _ele.at(n), _time.at(n));
 }
 
 void GpxTrackSegment::addPoint(const GpxPoint &pt) {
-    track_pts.push_back(pt);
+    _lat.push_back(pt.latitude());
+    _lon.push_back(pt.longitude());
+    _ele.push_back(pt.elevation());
+    _time.push_back(pt.timestamp());
+    _cached = 0;
+}
+
+void GpxTrackSegment::appendPoints(const double *lat, const double *lon, const double *ele,
+                                   const qint64 *time, int n) {
+    int old = _lat.size();
+    _lat.resize(old+n);
+    _lon.resize(old+n);
+    _ele.resize(old+n);
+    _time.resize(old+n);
+
+    std::memcpy(_lat.data()+old, lat, n*sizeof(double));
+    std::memcpy(_lon.data()+old, lon, n*sizeof(double));
+    std::memcpy(_ele.data()+old, ele, n*sizeof(double));
+    std::memcpy(_time.data()+old, time, n*sizeof(qint64));
+    _cached = 0;
+}
+
+// Move values[indices[i]] to values[i]
+template <typename T>
+static void compact(QVector<T> &values, const QVector<int> &indices) {
+    int n = values.size();
+    T *v = values.data();
+    int kept = 0;
+    while (kept < indices.size() && indices[kept] < n) {
+        v[kept] = v[indices[kept]];
+        ++kept;
+    }
+    values.resize(kept);
+}
+
+void GpxTrackSegment::keepPoints(const QVector<int> &indices) {
+    for (int i=1; i<indices.size(); ++i) {
+        assert(indices[i-1] < indices[i]);
+    }
+    assert(indices.isEmpty() || indices.last() < _lat.size());
+
+    compact(_lat, indices);
+    compact(_lon, indices);
+    compact(_ele, indices);
+    compact(_time, indices);
+
+    // The projected prefix stays a prefix
+    compact(_x, indices);
+    compact(_y, indices);
+    compact(_zone, indices);
+    _cached = 0;
 }
 
-GpxPoint &GpxTrackSegment::lastPoint() {
-    assert(track_pts.size()>0);
-    return track_pts[track_pts.size()-1];
+GpxPointRef GpxTrackSegment::lastPoint() {
+    assert(_lat.size()>0);
+    return GpxPointRef(this, _lat.size()-1);
 }
-QString GpxTrackSegment::name() {
+QString GpxTrackSegment::name() const {
     return _name;
 }
 void GpxTrackSegment::setName(const QString &name) {
     _name = name;
 }
     
-int GpxTrackSegment::number() {
+int GpxTrackSegment::number() const {
     return _number;
 }
 void GpxTrackSegment::setNumber(int number) {
     _number = number;
 }
 
-int GpxTrackSegment::pointCount() {
-    return track_pts.size();
+int GpxTrackSegment::pointCount() const {
+    return _lat.size();
 }
 
-void GpxTrackSegment::boundLatLon(double &minLat, double &minLon, double &minEle,
-                                  double &maxLat, double &maxLon, double &maxEle) {
-    assert(track_pts.size()>0);
+double GpxTrackSegment::latitude(int n) const {
+    return _lat.at(n);
+}
+double GpxTrackSegment::longitude(int n) const {
+    return _lon.at(n);
+}
+double GpxTrackSegment::elevation(int n) const {
+    return _ele.at(n);
+}
+qint64 GpxTrackSegment::timestamp(int n) const {
+    return _time.at(n);
+}
 
-    minLat = maxLat = track_pts[0].latitude();
-    minLon = maxLon = track_pts[0].longitude();
-    minEle = maxEle = track_pts[0].elevation();
-    
-    if (track_pts.size()==1) return;
-    
-    for (int i=1; i< track_pts.size(); ++i) {
+const double *GpxTrackSegment::latitudes() const {
+    return _lat.constData();
+}
+const double *GpxTrackSegment::longitudes() const {
+    return _lon.constData();
+}
+const double *GpxTrackSegment::elevations() const {
+    return _ele.constData();
+}
+QVector<double> GpxTrackSegment::elevationColumn() const {
+    return _ele;
+}
+const qint64 *GpxTrackSegment::timestamps() const {
+    return _time.constData();
+}
 
-        if (track_pts[i].latitude() < minLat) minLat = track_pts[i].latitude();
-        if (track_pts[i].longitude() < minLon) minLon = track_pts[i].longitude();
-        if (track_pts[i].elevation() < minEle) minEle = track_pts[i].elevation();
+double GpxTrackSegment::x(int n) {
+    project();
+    return _x.at(n);
+}
+double GpxTrackSegment::y(int n) {
+    project();
+    return _y.at(n);
+}
+bool GpxTrackSegment::north(int n) {
+    project();
+    return _zone.at(n) > 0;
+}
+int GpxTrackSegment::zone(int n) {
+    project();
+    int z = _zone.at(n);
+    return (z < 0 ? -z : z) - 1;
+}
 
-        if (track_pts[i].latitude() > maxLat) maxLat = track_pts[i].latitude();
-        if (track_pts[i].longitude() > maxLon) maxLon = track_pts[i].longitude();
-        if (track_pts[i].elevation() > maxEle) maxEle = track_pts[i].elevation();
+void GpxTrackSegment::boundLatLon(double &minLat, double &minLon, double &minEle,
+                                  double &maxLat, double &maxLon, double &maxEle) {
+    assert(_lat.size()>0);
+
+    double *b = _latLonBounds;
+    if (!(_cached & LatLonStat)) {
+        int n = _lat.size();
+        gpxMinMax(_lat.constData(), n, b[0], b[3]);
+        gpxMinMax(_lon.constData(), n, b[1], b[4]);
+        gpxMinMax(_ele.constData(), n, b[2], b[5]);
+        _cached |= LatLonStat;
     }
+    minLat = b[0]; minLon = b[1]; minEle = b[2];
+    maxLat = b[3]; maxLon = b[4]; maxEle = b[5];
 }
 
 void GpxTrackSegment::boundUTM(double &minX, double &minY, double &minEle,
                                double &maxX, double &maxY, double &maxEle) {
-    assert(track_pts.size()>0);
+    assert(_lat.size()>0);
 
-    minX = maxX = track_pts[0].x();
-    minY = maxY = track_pts[0].y();
-    minEle = maxEle = track_pts[0].elevation();
-    
-    for (int i=1; i< track_pts.size(); ++i) {
+    double *b = _utmBounds;
+    if (!(_cached & UTMStat)) {
+        project();
 
-        if (track_pts[i].x() < minX) minX = track_pts[i].x();
-        if (track_pts[i].y() < minY) minY = track_pts[i].y();
-        if (track_pts[i].elevation() < minEle) minEle = track_pts[i].elevation();
+        int n = _lat.size();
+        gpxMinMax(_x.constData(), n, b[0], b[3]);
+        gpxMinMax(_y.constData(), n, b[1], b[4]);
+        gpxMinMax(_ele.constData(), n, b[2], b[5]);
+        _cached |= UTMStat;
+    }
+    minX = b[0]; minY = b[1]; minEle = b[2];
+    maxX = b[3]; maxY = b[4]; maxEle = b[5];
+}
 
-        if (track_pts[i].x() > maxX) maxX = track_pts[i].x();
-        if (track_pts[i].y() > maxY) maxY = track_pts[i].y();
-        if (track_pts[i].elevation() > maxEle) maxEle = track_pts[i].elevation();
+// Combine two cached bounds
+static void mergeBounds(double *bounds, const double *other) {
+    for (int i=0; i<3; ++i) {
+        if (other[i] < bounds[i]) bounds[i] = other[i];
+        if (other[i+3] > bounds[i+3]) bounds[i+3] = other[i+3];
     }
 }
 
 void GpxTrackSegment::merge(const GpxTrackSegment &other) {
-    track_pts.append(other.track_pts);
+    if (other._lat.isEmpty()) return;
+
+    int oldCount = _lat.size();
+    if (oldCount == 0) {
+        QString name = _name;
+        int number = _number;
+        *this = other;
+        _name = name;
+        _number = number;
+        return;
+    }
+
+    _lat += other._lat;
+    _lon += other._lon;
+    _ele += other._ele;
+    _time += other._time;
+
+    // Keep the projections if both sides are fully projected.
+    // Otherwise ours is still a valid prefix, and project() fills in the rest.
+    if (_x.size() == oldCount && other._x.size() == other._lat.size()) {
+        _x += other._x;
+        _y += other._y;
+        _zone += other._zone;
+    }
+
+    // Statistics cached on both sides are combined with the step
+    // joining them instead of walking every point again.  Length and
+    // speed only combine if both sides used the current distance model.
+    checkDistanceModel();
+    _cached &= other._cached;
+    if (other._distanceModel != _distanceModel) {
+        _cached &= ~(LengthStat | MaxSpeedStat);
+    }
+    GpxPointRef last = (*this)[oldCount-1];
+    GpxPointRef first = (*this)[oldCount];
+    if (_cached & LengthStat) {
+        _length += other._length + last.distanceTo(first);
+    }
+    if (_cached & MaxSpeedStat) {
+        double spd = last.speedBetween(first);
+        if (other._maxSpeed > _maxSpeed) _maxSpeed = other._maxSpeed;
+        if (spd > _maxSpeed) _maxSpeed = spd;
+    }
+    if (_cached & LatLonStat) {
+        mergeBounds(_latLonBounds, other._latLonBounds);
+    }
+    if (_cached & UTMStat) {
+        mergeBounds(_utmBounds, other._utmBounds);
+    }
+}
+
+void GpxTrackSegment::cacheStats() {
+    length();
+    maxSpeed();
+
+    // Bounds aren't defined for an empty segment
+    if (_lat.size() > 0) {
+        double b[6];
+        boundLatLon(b[0], b[1], b[2], b[3], b[4], b[5]);
+    }
+}
+
+bool GpxTrackSegment::statsCached() const {
+    if (_distanceModel != gpxDistanceModel()) return false;
+    if ((_cached & SummaryStats) == SummaryStats) return true;
+    return _lat.isEmpty() && (_cached & LengthStat);
+}
+
+int GpxTrackSegment::projectedCount() const {
+    return _x.size();
+}
+
+void GpxTrackSegment::project() {
+    int n = _lat.size();
+    if (_x.size() == n) return;
+
+    int first = _x.size();
+    _x.resize(n);
+    _y.resize(n);
+    _zone.resize(n);
+
+    gpxProjectUTM(_lat.constData()+first, _lon.constData()+first, n-first,
+                  _x.data()+first, _y.data()+first, _zone.data()+first);
 }
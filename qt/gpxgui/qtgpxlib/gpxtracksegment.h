@@ -20,30 +20,102 @@
 #include "gpxtracksegment.h"
 
 #include "gpxpoint.h"
+#include "gpxdistance.h"
 
 #include "gpxelement.h"
 #include "track.h"
 
 #include <QString>
-#include <QList>
+#include <QVector>
 
+#include <cmath>
+
+class GpxTrackSegment;
+
+// Handle to a point stored in a GpxTrackSegment.
+// It has the same accessors as GpxPoint, and converts to a GpxPoint
+// when a standalone copy is needed.  Like an iterator, it's only
+// valid until the segment is modified.
+class GpxPointRef {
+public:
+    GpxPointRef(GpxTrackSegment *seg, int n) : _seg(seg), _n(n) { }
+
+    double latitude() const;
+    double longitude() const;
+    double elevation() const;
+
+    QDateTime time() const;
+    qint64 timestamp() const;
+
+    double x() const;
+    double y() const;
+    bool north() const;
+    int zone() const;
+
+    double distanceTo(const GpxPointRef &p2) const;
+    double speedBetween(const GpxPointRef &p2) const;
+    time_t secondsBetween(const GpxPointRef &p2) const;
+
+    operator GpxPoint() const;
+
+private:
+    GpxTrackSegment *_seg;
+    int _n;
+};
+
+// Points are stored column-wise: one contiguous array per field
+// instead of one heap allocated GpxPoint each.  That's about a third
+// of the memory, and the statistics below stream over plain arrays.
 class GpxTrackSegment : public GpxElement, public Track {
 public:
     GpxTrackSegment();
 
-    GpxPoint& operator [](int n);
+    GpxPointRef operator [](int n);
     void addPoint(const GpxPoint &pt);
 
-    GpxPoint &lastPoint();
+    // Add n points from separate arrays of each field
+    void appendPoints(const double *lat, const double *lon, const double *ele,
+                      const qint64 *time, int n);
 
-    QString name();
+    // Keep only the points at the given indices, which must be
+    // increasing, and drop the rest.  Projections are kept.
+    void keepPoints(const QVector<int> &indices);
+
+    GpxPointRef lastPoint();
+    GpxPoint point(int n);
+
+    QString name() const;
     void setName(const QString &name);
     
-    int number();
+    int number() const;
     void setNumber(int number);
 
-    int pointCount();
+    int pointCount() const;
+
+    // Per point accessors
+    double latitude(int n) const;
+    double longitude(int n) const;
+    double elevation(int n) const;
+    qint64 timestamp(int n) const;
+
+    // Whole columns, pointCount() long.
+    // Only valid until the segment is modified.
+    const double *latitudes() const;
+    const double *longitudes() const;
+    const double *elevations() const;
+    const qint64 *timestamps() const;
+
+    // The elevation column itself, implicitly shared
+    QVector<double> elevationColumn() const;
+
+    // These project the segment if it hasn't been already
+    double x(int n);
+    double y(int n);
+    bool north(int n);
+    int zone(int n);
 
+    // Statistics are cached until the points change.
+    // Length and speed use gpxDistanceModel().
     double length();
     time_t duration();
     double maxSpeed();
@@ -58,12 +130,114 @@ public:
 
     void merge(const GpxTrackSegment &other);
 
+    // Project every point to UTM in one pass.
+    // Only points added since the last call are projected.
+    void project();
+
+    // Points projected so far, a prefix of the segment
+    int projectedCount() const;
+
+    // Compute the length, max speed and lat/lon bounds now, so later
+    // calls are just reads.  The UTM bounds are left to boundUTM(), so
+    // only the UTM distance model projects the points.
+    void cacheStats();
+    bool statsCached() const;
+
 private:
+    // Drop the length and speed if they were computed with another
+    // distance model
+    void checkDistanceModel();
+
+    // Bits of _cached
+    enum CachedStat {
+        LengthStat = 1,
+        MaxSpeedStat = 2,
+        LatLonStat = 4,
+        UTMStat = 8,
+        // What cacheStats() fills
+        SummaryStats = LengthStat | MaxSpeedStat | LatLonStat
+    };
+
     QString _name;
 
     // number and track_pts are optional
     int _number;
-    QList<GpxPoint> track_pts;
+
+    // Point data, one entry per point
+    QVector<double> _lat;
+    QVector<double> _lon;
+    QVector<double> _ele;
+    QVector<qint64> _time;
+
+    // UTM coordinates of the first _x.size() points.
+    // _zone holds the zone plus one, negated in the southern hemisphere.
+    QVector<double> _x;
+    QVector<double> _y;
+    QVector<signed char> _zone;
+
+    // Which statistics below are up to date.
+    // Cleared by anything that adds or changes points.
+    unsigned int _cached;
+    GpxDistanceModel _distanceModel;
+    double _length;
+    double _maxSpeed;
+
+    // min lat/x, lon/y, ele, then max lat/x, lon/y, ele
+    double _latLonBounds[6];
+    double _utmBounds[6];
 };
 
+inline double GpxPointRef::latitude() const {
+    return _seg->latitude(_n);
+}
+inline double GpxPointRef::longitude() const {
+    return _seg->longitude(_n);
+}
+inline double GpxPointRef::elevation() const {
+    return _seg->elevation(_n);
+}
+inline QDateTime GpxPointRef::time() const {
+    return GpxPoint::toDateTime(_seg->timestamp(_n));
+}
+inline qint64 GpxPointRef::timestamp() const {
+    return _seg->timestamp(_n);
+}
+inline double GpxPointRef::x() const {
+    return _seg->x(_n);
+}
+inline double GpxPointRef::y() const {
+    return _seg->y(_n);
+}
+inline bool GpxPointRef::north() const {
+    return _seg->north(_n);
+}
+inline int GpxPointRef::zone() const {
+    return _seg->zone(_n);
+}
+inline double GpxPointRef::distanceTo(const GpxPointRef &p2) const {
+    if (gpxDistanceModel() != UtmDistance) {
+        return gpxDistance(latitude(), longitude(), elevation(),
+                           p2.latitude(), p2.longitude(), p2.elevation());
+    }
+
+    double dx = x() - p2.x();
+    double dy = y() - p2.y();
+    double dz = elevation() - p2.elevation();
+
+    return std::sqrt(dx*dx + dy*dy + dz*dz);
+}
+inline double GpxPointRef::speedBetween(const GpxPointRef &p2) const {
+    qint64 t0 = timestamp(), t1 = p2.timestamp();
+    if (t0 == GpxPoint::NoTime || t1 == GpxPoint::NoTime || t1 <= t0) return 0.0;
+    return distanceTo(p2) / ((t1 - t0) / 1000.0);
+}
+inline time_t GpxPointRef::secondsBetween(const GpxPointRef &p2) const {
+    qint64 t0 = timestamp(), t1 = p2.timestamp();
+    if (t0 == GpxPoint::NoTime || t1 == GpxPoint::NoTime) return 0;
+    return (t1 - t0) / 1000;
+}
+inline GpxPointRef::operator GpxPoint() const {
+    return _seg->point(_n);
+}
+
 #endif
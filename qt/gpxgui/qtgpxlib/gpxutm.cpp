@@ -0,0 +1,357 @@
+// gpxutm.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gpxutm.h"
+#include "gpxdistance.h"
+#include "gpxkernels.h"
+
+#include <GeographicLib/UTMUPS.hpp>
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GPX_UTM_X86
+#include <immintrin.h>
+#endif
+
+// Forward transverse Mercator following Karney, "Transverse Mercator
+// with an accuracy of a few nanometers" (2011), which is also what
+// GeographicLib implements.  With tau' the tangent of the conformal
+// latitude and lambda the longitude from the central meridian,
+//
+//   xi'  = atan2(tau', cos lambda)
+//   eta' = asinh(sin lambda / hypot(tau', cos lambda))
+//   xi + i eta = (xi' + i eta') + sum alpha_j sin(2j (xi' + i eta'))
+//
+// The series only needs sin and cos of 2 xi' and sinh and cosh of
+// 2 eta', and those are rational in tau', sin lambda and cos lambda, so
+// the series kernels below are nothing but arithmetic and square roots.
+// It's summed with Clenshaw's recurrence in complex arithmetic.  Every
+// version does the same operations in the same order.
+
+namespace {
+
+// WGS84, as used by UTMUPS
+const double Radius = 6378137.0;
+const double Flattening = 1/298.257223563;
+const double ScaleFactor = 0.9996;
+const double FalseEasting = 5e5;
+const double FalseNorthing = 1e7;
+
+// Points projected per pass, sized so the scratch arrays stay in L1
+const int BlockSize = 256;
+
+struct Series {
+    // First eccentricity
+    double e;
+    // Scale factor times the rectifying radius
+    double kA;
+    // alpha[1] .. alpha[6]
+    double alpha[7];
+};
+
+Series makeSeries() {
+    double n = Flattening / (2 - Flattening);
+    double n2 = n*n;
+
+    Series s;
+    s.e = std::sqrt(Flattening * (2 - Flattening));
+    s.kA = ScaleFactor * Radius / (1 + n) * (1 + n2*(1.0/4 + n2*(1.0/64 + n2/256)));
+
+    s.alpha[0] = 0;
+    s.alpha[1] = n*(1.0/2 + n*(-2.0/3 + n*(5.0/16 + n*(41.0/180 + n*(-127.0/288 + n*7891.0/37800)))));
+    s.alpha[2] = n2*(13.0/48 + n*(-3.0/5 + n*(557.0/1440 + n*(281.0/630 + n*-1983433.0/1935360))));
+    s.alpha[3] = n2*n*(61.0/240 + n*(-103.0/140 + n*(15061.0/26880 + n*167603.0/181440)));
+    s.alpha[4] = n2*n2*(49561.0/161280 + n*(-179.0/168 + n*6601661.0/7257600));
+    s.alpha[5] = n2*n2*n*(34729.0/80640 + n*-3418889.0/1995840);
+    s.alpha[6] = n2*n2*n2*(212378941.0/319334400);
+    return s;
+}
+
+const Series &series() {
+    static const Series s = makeSeries();
+    return s;
+}
+
+// UTMUPS::StandardZone: the 6 degree zone, with the Norway and
+// Svalbard exceptions, or 0 outside the UTM latitudes
+int standardZone(double lat, double lon) {
+    if (!(lat >= -80 && lat < 84)) return 0;
+
+    int ilon = int(std::floor(lon - 360*std::floor((lon + 180) / 360)));
+    if (ilon >= 180) ilon = -180;
+
+    int zone = (ilon + 186) / 6;
+    int band = (int(std::floor(lat)) + 80) / 8 - 10;
+    if (band > 9) band = 9;
+
+    if (band == 7 && zone == 31 && ilon >= 3) {
+        zone = 32;
+    } else if (band == 9 && ilon >= 0 && ilon < 42) {
+        zone = 2 * ((ilon + 183) / 12) + 1;
+    }
+    return zone;
+}
+
+// Everything the series needs for one point
+struct Conformal {
+    double tp[BlockSize];
+    double cl[BlockSize];
+    double sl[BlockSize];
+    double xip[BlockSize];
+    double etap[BlockSize];
+};
+
+// The per point part with libm calls
+void conformal(const double *lat, const double *lon, int n, double lon0,
+               double e, Conformal &c) {
+    for (int i=0; i<n; ++i) {
+        double phi = lat[i] * GpxDegree;
+        double lam = std::remainder(lon[i] - lon0, 360.0) * GpxDegree;
+
+        double sphi = std::sin(phi);
+        double cphi = std::cos(phi);
+        double tau = sphi / cphi;
+        double tau1 = 1 / cphi;
+        double sig = std::sinh(e * std::atanh(e * sphi));
+        double tp = std::sqrt(1 + sig*sig) * tau - sig * tau1;
+
+        double sl = std::sin(lam);
+        double cl = std::cos(lam);
+
+        c.tp[i] = tp;
+        c.cl[i] = cl;
+        c.sl[i] = sl;
+        c.xip[i] = std::atan2(tp, cl);
+        c.etap[i] = std::asinh(sl / std::sqrt(tp*tp + cl*cl));
+    }
+}
+
+void seriesScalar(const Conformal &c, int n, const Series &s, double northing,
+                  double *x, double *y) {
+    const double *alpha = s.alpha;
+    for (int i=0; i<n; ++i) {
+        double tp = c.tp[i], cl = c.cl[i], sl = c.sl[i];
+        double tp2 = tp*tp;
+        double inv = 1 / (tp2 + cl*cl);
+
+        // sin, cos of 2 xi' and sinh, cosh of 2 eta'
+        double s2 = 2*tp*cl * inv;
+        double c2 = (cl*cl - tp2) * inv;
+        double sh2 = 2*sl*std::sqrt(1 + tp2) * inv;
+        double ch2 = (1 + tp2 + sl*sl) * inv;
+
+        // a = 2 cos(2z)
+        double ar = 2*c2*ch2;
+        double ai = -2*s2*sh2;
+
+        double yr0 = alpha[6], yi0 = 0;
+        double yr1 = 0, yi1 = 0;
+        for (int j=5; j>0; --j) {
+            double yr2 = yr1, yi2 = yi1;
+            yr1 = yr0;
+            yi1 = yi0;
+            yr0 = ar*yr1 - ai*yi1 - yr2 + alpha[j];
+            yi0 = ar*yi1 + ai*yr1 - yi2;
+        }
+
+        // Times sin(2z)
+        double sr = s2*ch2;
+        double si = c2*sh2;
+        double xi = c.xip[i] + (sr*yr0 - si*yi0);
+        double eta = c.etap[i] + (sr*yi0 + si*yr0);
+
+        x[i] = s.kA*eta + FalseEasting;
+        y[i] = s.kA*xi + northing;
+    }
+}
+
+#ifdef GPX_UTM_X86
+
+__attribute__((target("sse2")))
+void seriesSse2(const Conformal &c, int n, const Series &s, double northing,
+                double *x, double *y) {
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d two = _mm_set1_pd(2.0);
+    const __m128d kA = _mm_set1_pd(s.kA);
+    const __m128d east = _mm_set1_pd(FalseEasting);
+    const __m128d north = _mm_set1_pd(northing);
+
+    int i = 0;
+    for (; i+2 <= n; i += 2) {
+        __m128d tp = _mm_loadu_pd(c.tp+i);
+        __m128d cl = _mm_loadu_pd(c.cl+i);
+        __m128d sl = _mm_loadu_pd(c.sl+i);
+        __m128d tp2 = _mm_mul_pd(tp, tp);
+        __m128d cl2 = _mm_mul_pd(cl, cl);
+        __m128d inv = _mm_div_pd(one, _mm_add_pd(tp2, cl2));
+
+        __m128d s2 = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(two, tp), cl), inv);
+        __m128d c2 = _mm_mul_pd(_mm_sub_pd(cl2, tp2), inv);
+        __m128d sh2 = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(two, sl), _mm_sqrt_pd(_mm_add_pd(one, tp2))), inv);
+        __m128d ch2 = _mm_mul_pd(_mm_add_pd(_mm_add_pd(one, tp2), _mm_mul_pd(sl, sl)), inv);
+
+        __m128d ar = _mm_mul_pd(_mm_mul_pd(two, c2), ch2);
+        __m128d ai = _mm_mul_pd(_mm_mul_pd(_mm_set1_pd(-2.0), s2), sh2);
+
+        __m128d yr0 = _mm_set1_pd(s.alpha[6]), yi0 = _mm_setzero_pd();
+        __m128d yr1 = _mm_setzero_pd(), yi1 = _mm_setzero_pd();
+        for (int j=5; j>0; --j) {
+            __m128d yr2 = yr1, yi2 = yi1;
+            yr1 = yr0;
+            yi1 = yi0;
+            yr0 = _mm_add_pd(_mm_sub_pd(_mm_sub_pd(_mm_mul_pd(ar, yr1), _mm_mul_pd(ai, yi1)), yr2),
+                             _mm_set1_pd(s.alpha[j]));
+            yi0 = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(ar, yi1), _mm_mul_pd(ai, yr1)), yi2);
+        }
+
+        __m128d sr = _mm_mul_pd(s2, ch2);
+        __m128d si = _mm_mul_pd(c2, sh2);
+        __m128d xi = _mm_add_pd(_mm_loadu_pd(c.xip+i),
+                                _mm_sub_pd(_mm_mul_pd(sr, yr0), _mm_mul_pd(si, yi0)));
+        __m128d eta = _mm_add_pd(_mm_loadu_pd(c.etap+i),
+                                 _mm_add_pd(_mm_mul_pd(sr, yi0), _mm_mul_pd(si, yr0)));
+
+        _mm_storeu_pd(x+i, _mm_add_pd(_mm_mul_pd(kA, eta), east));
+        _mm_storeu_pd(y+i, _mm_add_pd(_mm_mul_pd(kA, xi), north));
+    }
+
+    // The leftover point goes through the scalar version
+    if (i < n) {
+        Conformal tail;
+        tail.tp[0] = c.tp[i]; tail.cl[0] = c.cl[i]; tail.sl[0] = c.sl[i];
+        tail.xip[0] = c.xip[i]; tail.etap[0] = c.etap[i];
+        seriesScalar(tail, 1, s, northing, x+i, y+i);
+    }
+}
+
+__attribute__((target("avx2")))
+void seriesAvx2(const Conformal &c, int n, const Series &s, double northing,
+                double *x, double *y) {
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d kA = _mm256_set1_pd(s.kA);
+    const __m256d east = _mm256_set1_pd(FalseEasting);
+    const __m256d north = _mm256_set1_pd(northing);
+
+    int i = 0;
+    for (; i+4 <= n; i += 4) {
+        __m256d tp = _mm256_loadu_pd(c.tp+i);
+        __m256d cl = _mm256_loadu_pd(c.cl+i);
+        __m256d sl = _mm256_loadu_pd(c.sl+i);
+        __m256d tp2 = _mm256_mul_pd(tp, tp);
+        __m256d cl2 = _mm256_mul_pd(cl, cl);
+        __m256d inv = _mm256_div_pd(one, _mm256_add_pd(tp2, cl2));
+
+        __m256d s2 = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(two, tp), cl), inv);
+        __m256d c2 = _mm256_mul_pd(_mm256_sub_pd(cl2, tp2), inv);
+        __m256d sh2 = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(two, sl), _mm256_sqrt_pd(_mm256_add_pd(one, tp2))), inv);
+        __m256d ch2 = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(one, tp2), _mm256_mul_pd(sl, sl)), inv);
+
+        __m256d ar = _mm256_mul_pd(_mm256_mul_pd(two, c2), ch2);
+        __m256d ai = _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(-2.0), s2), sh2);
+
+        __m256d yr0 = _mm256_set1_pd(s.alpha[6]), yi0 = _mm256_setzero_pd();
+        __m256d yr1 = _mm256_setzero_pd(), yi1 = _mm256_setzero_pd();
+        for (int j=5; j>0; --j) {
+            __m256d yr2 = yr1, yi2 = yi1;
+            yr1 = yr0;
+            yi1 = yi0;
+            yr0 = _mm256_add_pd(_mm256_sub_pd(_mm256_sub_pd(_mm256_mul_pd(ar, yr1), _mm256_mul_pd(ai, yi1)), yr2),
+                                _mm256_set1_pd(s.alpha[j]));
+            yi0 = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(ar, yi1), _mm256_mul_pd(ai, yr1)), yi2);
+        }
+
+        __m256d sr = _mm256_mul_pd(s2, ch2);
+        __m256d si = _mm256_mul_pd(c2, sh2);
+        __m256d xi = _mm256_add_pd(_mm256_loadu_pd(c.xip+i),
+                                   _mm256_sub_pd(_mm256_mul_pd(sr, yr0), _mm256_mul_pd(si, yi0)));
+        __m256d eta = _mm256_add_pd(_mm256_loadu_pd(c.etap+i),
+                                    _mm256_add_pd(_mm256_mul_pd(sr, yi0), _mm256_mul_pd(si, yr0)));
+
+        _mm256_storeu_pd(x+i, _mm256_add_pd(_mm256_mul_pd(kA, eta), east));
+        _mm256_storeu_pd(y+i, _mm256_add_pd(_mm256_mul_pd(kA, xi), north));
+    }
+
+    // Up to three leftover points
+    if (i < n) {
+        Conformal tail;
+        for (int k=0; i+k<n; ++k) {
+            tail.tp[k] = c.tp[i+k]; tail.cl[k] = c.cl[i+k]; tail.sl[k] = c.sl[i+k];
+            tail.xip[k] = c.xip[i+k]; tail.etap[k] = c.etap[i+k];
+        }
+        seriesScalar(tail, n-i, s, northing, x+i, y+i);
+    }
+}
+
+#endif
+
+// Project up to BlockSize points that share a zone and hemisphere
+void projectRun(const double *lat, const double *lon, int n, int zone, bool north,
+                double *x, double *y) {
+    const Series &s = series();
+    Conformal c;
+    conformal(lat, lon, n, 6.0*zone - 183, s.e, c);
+
+    double northing = north ? 0.0 : FalseNorthing;
+    switch (gpxKernelIsa()) {
+#ifdef GPX_UTM_X86
+    case Avx2Kernels:
+        seriesAvx2(c, n, s, northing, x, y);
+        break;
+    case Sse2Kernels:
+        seriesSse2(c, n, s, northing, x, y);
+        break;
+#endif
+    default:
+        seriesScalar(c, n, s, northing, x, y);
+        break;
+    }
+}
+
+}
+
+void gpxProjectUTM(const double *lat, const double *lon, int n,
+                   double *x, double *y, signed char *zone) {
+    int i = 0;
+    while (i < n) {
+        int z = standardZone(lat[i], lon[i]);
+        bool north = lat[i] >= 0;
+
+        if (z == 0) {
+            // UPS, and anything GeographicLib should complain about
+            double gamma, k;
+            GeographicLib::UTMUPS::Forward(lat[i], lon[i], z, north, x[i], y[i], gamma, k);
+            zone[i] = north ? z+1 : -(z+1);
+            ++i;
+            continue;
+        }
+
+        int end = i+1;
+        while (end < n && end-i < BlockSize &&
+               (lat[end] >= 0) == north && standardZone(lat[end], lon[end]) == z) {
+            ++end;
+        }
+
+        projectRun(lat+i, lon+i, end-i, z, north, x+i, y+i);
+        signed char code = north ? z+1 : -(z+1);
+        for (int k=i; k<end; ++k) {
+            zone[k] = code;
+        }
+        i = end;
+    }
+}
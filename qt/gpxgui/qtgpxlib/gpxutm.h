@@ -0,0 +1,37 @@
+// gpxutm.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef GPX_UTM_H
+#define GPX_UTM_H
+
+// Projects arrays of points to UTM, or UPS near the poles, giving the
+// same coordinates as GeographicLib::UTMUPS::Forward with the standard
+// zone to well under a millimetre.
+//
+// Consecutive points in the same zone and hemisphere are projected as a
+// run.  Each point still needs a handful of libm calls to get its
+// conformal latitude, but the 6th order Krüger series that follows is
+// evaluated with the SSE2 or AVX2 kernels picked by gpxKernelIsa(), and
+// the scale factor and meridian convergence GeographicLib also computes
+// are skipped.  UPS points go through GeographicLib one at a time.
+//
+// zone[i] is the UTM zone, or 0 for UPS, plus one, and negated in the
+// southern hemisphere.
+void gpxProjectUTM(const double *lat, const double *lon, int n,
+                   double *x, double *y, signed char *zone);
+
+#endif
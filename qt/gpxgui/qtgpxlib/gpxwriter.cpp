@@ -0,0 +1,190 @@
+// gpxwriter.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "gpxwriter.h"
+#include "gpxfile.h"
+#include "gpxtracksegment.h"
+#include "fastparse.h"
+
+#include <QIODevice>
+#include <QByteArray>
+
+#include <cstdio>
+#include <cstring>
+
+// Longest possible <trkpt> element, with room to spare
+static const int MaxPointLength = 256;
+
+GpxWriter::GpxWriter(QIODevice *dev, Precision prec) : device(dev), precision(prec),
+                                                      coordDecimals(9), eleDecimals(9),
+                                                      used(0), failed(false) {
+}
+
+GpxWriter::~GpxWriter() {
+    flush();
+}
+
+void GpxWriter::setDecimals(int coordinates, int elevation) {
+    coordDecimals = coordinates;
+    eleDecimals = elevation;
+}
+
+bool GpxWriter::write(const GpxFile &gpx) {
+    writeHeader(gpx.time());
+    for (int i=0; i<gpx.segmentCount(); ++i) {
+        // Read only, so saving leaves the file's caches alone
+        writeTrack(gpx.at(i));
+    }
+    writeFooter();
+    return flush();
+}
+
+void GpxWriter::writeHeader(const QDateTime &time) {
+    put("<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<gpx version=\"1.0\" creator=\"Whatever\" "
+        "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
+        "xmlns=\"http://www.topografix.com/GPX/1/0\" "
+        "xsi:schemaLocation=\"http://www.topografix.com/GPX/1/0 "
+        "http://www.topografix.com/GPX/1/0/gpx.xsd\">");
+    if (time.isValid()) {
+        char *p = reserve(64);
+        std::memcpy(p, "<time>", 6);
+        p += 6;
+        p += formatIsoTime(time.toMSecsSinceEpoch(), p);
+        std::memcpy(p, "</time>", 7);
+        used = p + 7 - buf;
+    }
+}
+
+void GpxWriter::writeTrack(const GpxTrackSegment &seg) {
+    put("<trk><name>");
+    putEscaped(seg.name());
+    put("</name>");
+    if (seg.number() > 0) {
+        char *p = reserve(64);
+        p += std::sprintf(p, "<number>%d</number>", seg.number());
+        used = p - buf;
+    }
+
+    put("<trkseg>");
+    int n = seg.pointCount();
+    for (int i=0; i<n; ++i) {
+        char *p = reserve(MaxPointLength);
+
+        std::memcpy(p, "<trkpt lat=\"", 12);
+        p += 12;
+        putNumber(p, seg.latitude(i), coordDecimals);
+        std::memcpy(p, "\" lon=\"", 7);
+        p += 7;
+        putNumber(p, seg.longitude(i), coordDecimals);
+        std::memcpy(p, "\"><ele>", 7);
+        p += 7;
+        putNumber(p, seg.elevation(i), eleDecimals);
+        std::memcpy(p, "</ele>", 6);
+        p += 6;
+
+        qint64 t = seg.timestamp(i);
+        if (t != GpxPoint::NoTime) {
+            std::memcpy(p, "<time>", 6);
+            p += 6;
+            p += formatIsoTime(t, p);
+            std::memcpy(p, "</time>", 7);
+            p += 7;
+        }
+        std::memcpy(p, "</trkpt>", 8);
+        used = p + 8 - buf;
+    }
+    put("</trkseg></trk>");
+}
+
+void GpxWriter::writeFooter() {
+    put("</gpx>\n");
+}
+
+bool GpxWriter::flush() {
+    if (used > 0 && !failed) {
+        if (device->write(buf, used) != used) {
+            failed = true;
+            error = device->errorString();
+        }
+    }
+    used = 0;
+    return !failed;
+}
+
+bool GpxWriter::hasError() const {
+    return failed;
+}
+
+QString GpxWriter::errorString() const {
+    return error;
+}
+
+char *GpxWriter::reserve(int len) {
+    if (used + len > BufferSize) {
+        flush();
+    }
+    return buf + used;
+}
+
+void GpxWriter::put(const char *str, int len) {
+    if (len > BufferSize) {
+        // Too big to buffer, so write it through
+        flush();
+        if (!failed && device->write(str, len) != len) {
+            failed = true;
+            error = device->errorString();
+        }
+        return;
+    }
+    std::memcpy(reserve(len), str, len);
+    used += len;
+}
+
+void GpxWriter::put(const char *str) {
+    put(str, std::strlen(str));
+}
+
+void GpxWriter::putNumber(char *&p, double value, int decimals) {
+    if (precision == FixedPrecision) {
+        p += formatFixed(value, decimals, p);
+    } else {
+        p += formatDouble(value, p);
+    }
+}
+
+void GpxWriter::putEscaped(const QString &str) {
+    QByteArray utf8 = str.toUtf8();
+    const char *begin = utf8.constData();
+    const char *end = begin + utf8.size();
+
+    for (const char *s = begin; s < end; ++s) {
+        const char *ent = 0;
+        switch (*s) {
+        case '&': ent = "&amp;"; break;
+        case '<': ent = "&lt;"; break;
+        case '>': ent = "&gt;"; break;
+        case '"': ent = "&quot;"; break;
+        default: break;
+        }
+        if (ent) {
+            put(begin, s-begin);
+            put(ent);
+            begin = s+1;
+        }
+    }
+    put(begin, end-begin);
+}
@@ -0,0 +1,83 @@
+// gpxwriter.h
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef GPX_WRITER_H
+#define GPX_WRITER_H
+
+#include <QString>
+#include <QDateTime>
+
+class GpxFile;
+class GpxTrackSegment;
+class QIODevice;
+
+// Writes GPX as UTF-8 straight to a device.
+// Output is collected in a fixed size buffer and flushed to the device
+// whenever it fills, so memory use doesn't depend on the file size.
+class GpxWriter {
+public:
+    enum Precision {
+        // Shortest decimal that reads back as the same double
+        ShortestPrecision,
+        // A fixed number of decimals, set with setDecimals()
+        FixedPrecision
+    };
+
+    GpxWriter(QIODevice *device, Precision precision = ShortestPrecision);
+
+    // Flushes anything still buffered
+    ~GpxWriter();
+
+    // Decimals written in FixedPrecision mode, 9 for both by default
+    void setDecimals(int coordinates, int elevation);
+
+    // Write a whole file and flush.  Returns false if the device failed.
+    bool write(const GpxFile &gpx);
+
+    // The pieces of a file, for callers building one up themselves
+    void writeHeader(const QDateTime &time);
+    void writeTrack(const GpxTrackSegment &seg);
+    void writeFooter();
+
+    bool flush();
+
+    bool hasError() const;
+    QString errorString() const;
+
+private:
+    enum { BufferSize = 64*1024 };
+
+    // Make room for len more characters
+    char *reserve(int len);
+
+    void put(const char *str, int len);
+    void put(const char *str);
+    void putNumber(char *&p, double value, int decimals);
+    void putEscaped(const QString &str);
+
+    QIODevice *device;
+    Precision precision;
+    int coordDecimals;
+    int eleDecimals;
+
+    char buf[BufferSize];
+    int used;
+
+    bool failed;
+    QString error;
+};
+
+#endif
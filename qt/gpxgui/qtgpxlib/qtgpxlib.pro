@@ -1,8 +1,18 @@
 TEMPLATE = lib
 CONFIG += staticlib
 
-SOURCES = gpxfile.cpp gpxpoint.cpp gpxtracksegment.cpp
-HEADERS = gpxelement.h gpxfile.h gpxpoint.h gpxtracksegment.h track.h
+SOURCES = gpxfile.cpp gpxpoint.cpp gpxtracksegment.cpp \
+          gpxtag.cpp gpxstreamparser.cpp gpxmappedreader.cpp fastparse.cpp \
+          gpxkernels.cpp gpxwriter.cpp gpxbinary.cpp gpxbatchloader.cpp \
+          gpxutm.cpp gpxdistance.cpp gpxpyramid.cpp gpxloadprogress.cpp \
+          gpxsimplify.cpp gpxspatialindex.cpp gpxresortdb.cpp \
+          gpxskianalyzer.cpp gpxrenderer.cpp gpxquadtree.cpp gpxedithistory.cpp
+HEADERS = gpxelement.h gpxfile.h gpxpoint.h gpxtracksegment.h track.h \
+          gpxtag.h gpxstreamparser.h gpxmappedreader.h fastparse.h \
+          gpxkernels.h gpxwriter.h gpxbinary.h gpxbatchloader.h \
+          gpxutm.h gpxdistance.h gpxpyramid.h gpxloadprogress.h \
+          gpxsimplify.h gpxspatialindex.h gpxresortdb.h \
+          gpxskianalyzer.h gpxrenderer.h gpxquadtree.h gpxedithistory.h
 
 LIBS += -lGeographic
 
@@ -0,0 +1,191 @@
+// main.cpp
+
+// Copyright (c) 2010, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Ski day statistics for a set of GPX files: which resort each was
+// recorded at, and the vertical, distance, speed and lift time of every
+// run.  Files are read in parallel, and a directory stands for every
+// track file under it.
+
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+#include <cstdio>
+
+#include "gpxbatchloader.h"
+#include "gpxresortdb.h"
+#include "gpxskianalyzer.h"
+#include "unitconversion.h"
+
+namespace {
+
+const double FeetPerMetre = 3.2808399;
+
+QString feet(double metres) {
+    return QString::number(metres * FeetPerMetre, 'f', 0);
+}
+QString miles(double metres) {
+    return QString::number(meter2mile(metres), 'f', 2);
+}
+QString mph(double speed) {
+    return QString::number(meterPerSecond2MilePerHour(speed), 'f', 1);
+}
+QString duration(qint64 msecs) {
+    return formatDuration(time_t(msecs / 1000), true);
+}
+
+// A resort list value, or "?" if it isn't known
+QString known(double value) {
+    return value < 0 ? QString("?") : QString::number(value);
+}
+
+void usage() {
+    fprintf(stderr, "Usage: skistats [-r resorts.xml] [-t metres] file-or-directory...\n"
+                    "  -r  resort list, north_america.xml by default\n"
+                    "  -t  elevation change that ends a run or a lift ride, 30 by default\n");
+}
+
+QString report(const QString &fname, GpxSkiAnalyzer &analyzer, const GpxResortDb &db, int resort) {
+    QString text;
+    QTextStream out(&text);
+
+    out << "=============================================\n";
+    out << "File: " << fname << "\n";
+    if (resort < 0) {
+        out << "Resort: Unknown\n";
+    } else {
+        const GpxResort &r = db.resort(resort);
+        out << "Resort: " << r.name << "\n";
+        out << "Elevation (base): " << known(r.elevation) << " feet\n";
+        out << "Vertical drop: " << known(r.vertical) << " feet\n";
+        out << "Number of runs: " << known(r.runs) << "\n";
+        out << "Number of lifts: " << known(r.lifts) << "\n";
+        out << "Annual snow fall (in): " << known(r.snowfall) << "\n";
+        out << "Website: " << r.url << "\n";
+    }
+    out << "=============================================\n";
+
+    const QVector<GpxSkiRun> &runs = analyzer.runs();
+    if (!runs.isEmpty()) {
+        out << " Run  Lift time  Ski time  Vertical (ft)  Distance (mi)  Max (mph)  Avg (mph)\n";
+    }
+    for (int i=0; i<runs.size(); ++i) {
+        const GpxSkiRun &run = runs[i];
+        out << QString("%1  %2  %3  %4  %5  %6  %7\n")
+            .arg(i+1, 4)
+            .arg(duration(run.liftTime), 9)
+            .arg(duration(run.duration()), 8)
+            .arg(feet(run.vertical), 13)
+            .arg(miles(run.distance), 13)
+            .arg(mph(run.maxSpeed), 9)
+            .arg(mph(run.averageSpeed()), 9);
+    }
+    out << "\n";
+    out << "Runs: " << runs.size() << "\n";
+    out << "Vertical skied: " << feet(analyzer.verticalSkied()) << " feet\n";
+    out << "Distance skied: " << miles(analyzer.distanceSkied()) << " miles\n";
+    out << "Time skiing: " << duration(analyzer.skiTime()) << "\n";
+    out << "Time on lifts: " << duration(analyzer.liftTime()) << "\n";
+    out << "Max speed: " << mph(analyzer.maxSpeed()) << " mph\n\n";
+    out.flush();
+    return text;
+}
+
+}
+
+int main(int argc, char **argv) {
+    QCoreApplication app(argc, argv);
+
+    QString resortFile = "north_america.xml";
+    double threshold = 30.0;
+    QStringList files;
+
+    QStringList args = app.arguments();
+    for (int i=1; i<args.size(); ++i) {
+        if ((args[i] == "-r" || args[i] == "-t") && i+1 < args.size()) {
+            if (args[i] == "-r") {
+                resortFile = args[++i];
+            } else {
+                threshold = args[++i].toDouble();
+            }
+        } else if (args[i].startsWith("-")) {
+            usage();
+            return 1;
+        } else if (QFileInfo(args[i]).isDir()) {
+            files += GpxBatchLoader::findFiles(args[i]);
+        } else {
+            files << args[i];
+        }
+    }
+    if (files.isEmpty()) {
+        usage();
+        return 1;
+    }
+
+    GpxResortDb db;
+    if (!db.load(resortFile)) {
+        fprintf(stderr, "Can't read resorts from %s: %s\n",
+                resortFile.toLocal8Bit().constData(), db.errorString().toLocal8Bit().constData());
+    }
+
+    // Files finish in any order, and are dropped once analyzed
+    QVector<QString> reports(files.size());
+    int runs = 0, failed = 0;
+    double vertical = 0.0, distance = 0.0, maxSpeed = 0.0;
+    qint64 skiTime = 0, liftTime = 0;
+
+    GpxBatchLoader loader(files);
+    GpxBatchResult result;
+    while (loader.next(result)) {
+        if (!result.ok) {
+            fprintf(stderr, "%s: %s\n", result.fileName.toLocal8Bit().constData(),
+                    result.error.toLocal8Bit().constData());
+            ++failed;
+            continue;
+        }
+
+        GpxSkiAnalyzer analyzer(threshold);
+        analyzer.analyze(result.gpx);
+        reports[result.index] = report(result.fileName, analyzer, db, db.identify(result.gpx));
+
+        runs += analyzer.runs().size();
+        vertical += analyzer.verticalSkied();
+        distance += analyzer.distanceSkied();
+        maxSpeed = qMax(maxSpeed, analyzer.maxSpeed());
+        skiTime += analyzer.skiTime();
+        liftTime += analyzer.liftTime();
+        result.gpx = GpxFile();
+    }
+
+    QTextStream out(stdout);
+    for (int i=0; i<reports.size(); ++i) {
+        out << reports[i];
+    }
+    if (files.size() > 1) {
+        out << "=============================================\n";
+        out << "Days: " << files.size() - failed << "\n";
+        out << "Runs: " << runs << "\n";
+        out << "Vertical skied: " << feet(vertical) << " feet\n";
+        out << "Distance skied: " << miles(distance) << " miles\n";
+        out << "Time skiing: " << duration(skiTime) << "\n";
+        out << "Time on lifts: " << duration(liftTime) << "\n";
+        out << "Max speed: " << mph(maxSpeed) << " mph\n";
+    }
+    return failed > 0 ? 2 : 0;
+}
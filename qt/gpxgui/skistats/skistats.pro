@@ -0,0 +1,15 @@
+TEMPLATE = app
+TARGET = skistats
+CONFIG += console
+CONFIG -= app_bundle
+QT -= gui
+QT += xml
+
+INCLUDEPATH += . ../qtgpxlib ../gpxgui
+
+LIBS += -lGeographic -lqtgpxlib
+
+QMAKE_LFLAGS += -L../qtgpxlib
+
+HEADERS += ../gpxgui/unitconversion.h
+SOURCES += main.cpp ../gpxgui/unitconversion.cpp
@@ -18,11 +18,34 @@
 #include <QString>
 #include <QFile>
 #include <QTextStream>
+#include <QFileInfo>
+#include <QDir>
+#include <QTime>
+#include <QBuffer>
+#include <QThread>
 
 #include <cassert>
 #include <cmath>
+#include <cstring>
 
 #include "gpxfile.h"
+#include "fastparse.h"
+#include "gpxkernels.h"
+#include "gpxwriter.h"
+#include "gpxbinary.h"
+#include "gpxbatchloader.h"
+#include "gpxutm.h"
+#include "gpxdistance.h"
+#include "gpxpyramid.h"
+#include "gpxsimplify.h"
+#include "gpxspatialindex.h"
+#include "gpxresortdb.h"
+#include "gpxskianalyzer.h"
+#include "gpxrenderer.h"
+#include "gpxquadtree.h"
+#include "gpxedithistory.h"
+
+#include <GeographicLib/UTMUPS.hpp>
 
 double meter2mile(double len) {
     return len * 0.000621371192;
@@ -93,7 +116,2107 @@ void testMerge() {
     qDebug() << tmp;
 }
 
-int main() {
+// A file of count "ACTIVE LOG #n" segments of three points each, one
+// after another in time
+GpxFile activeLogs(int count) {
+    GpxFile gpx;
+    for (int i=0; i<count; ++i) {
+        GpxTrackSegment seg;
+        seg.setName(QString("ACTIVE LOG #%1").arg(i));
+        seg.setNumber(i+1);
+        for (int j=0; j<3; ++j) {
+            int n = 3*i + j;
+            seg.addPoint(GpxPoint(39.5 + 0.0001*n, -106.0, 3000.0, qint64(n)*1000));
+        }
+        gpx.addTrack(seg);
+    }
+    return gpx;
+}
+
+void testTrackNames() {
+    qDebug() << "Testing track names";
+
+    GpxFile gpx = activeLogs(300);
+    assert(gpx.segmentIndex("ACTIVE LOG #0") == 0);
+    assert(gpx.segmentIndex("ACTIVE LOG #299") == 299);
+    assert(gpx.segmentIndex("nothing") == -1);
+    assert(&gpx.segmentByName("ACTIVE LOG #17") == &gpx.at(17));
+    assert(gpx.segmentByName("nothing").pointCount() == 0);
+
+    // Renaming through a modifiable segment is noticed
+    gpx[4].setName("Renamed");
+    assert(gpx.segmentIndex("Renamed") == 4);
+    assert(gpx.segmentIndex("ACTIVE LOG #4") == -1);
+
+    // The first of several with the same name
+    gpx[8].setName("Renamed");
+    assert(gpx.segmentIndex("Renamed") == 4);
+
+    // Both with that name, every odd one, and one that isn't there
+    QStringList remove, left;
+    remove << "Renamed" << "Renamed" << "missing";
+    for (int i=0; i<300; ++i) {
+        if (i%2) {
+            remove << QString("ACTIVE LOG #%1").arg(i);
+        } else if (i != 4 && i != 8) {
+            left << QString("ACTIVE LOG #%1").arg(i);
+        }
+    }
+    double length = gpx.length();
+    gpx.removeTracksByName(remove);
+    assert(gpx.segmentCount() == left.size());
+    for (int i=0; i<gpx.segmentCount(); ++i) {
+        assert(gpx[i].name() == left[i]);
+        assert(gpx.segmentIndex(left[i]) == i);
+    }
+    assert(gpx.pointCount() == 3*left.size());
+    double remaining = gpx.length();
+    assert(remaining < length);
+    double sum = 0.0;
+    for (int i=0; i<gpx.segmentCount(); ++i) {
+        sum += gpx[i].length();
+    }
+    assert(std::fabs(remaining - sum) < 1e-6);
+
+    // Merging in the order named, not the order in the file
+    GpxFile logs = activeLogs(300);
+    QStringList merge;
+    merge << "ACTIVE LOG #100";
+    for (int i=299; i>=0; --i) {
+        if (i != 100) merge << QString("ACTIVE LOG #%1").arg(i);
+    }
+    logs.length();
+    logs.mergeTracksByName(merge);
+    assert(logs.segmentCount() == 1);
+    assert(logs[0].name() == "ACTIVE LOG #100");
+    assert(logs.pointCount() == 900);
+    assert(logs(0).timestamp() == 300000 && logs(3).timestamp() == 897000);
+    assert(logs(899).timestamp() == 2000);
+
+    // A name given twice merges the next segment with it
+    GpxFile twice = activeLogs(3);
+    twice[2].setName("ACTIVE LOG #0");
+    twice.mergeTracksByName(QStringList() << "ACTIVE LOG #0" << "ACTIVE LOG #0" << "ACTIVE LOG #1");
+    assert(twice.segmentCount() == 1);
+    assert(twice(3).timestamp() == 6000 && twice(6).timestamp() == 3000);
+
+    qDebug() << "Track name tests passed";
+}
+
+void testEditHistory() {
+    qDebug() << "Testing edit history";
+
+    GpxEditHistory history;
+    GpxFile gpx = activeLogs(300);
+    double length = gpx.length();
+    QVector<const double*> before;
+    for (int i=0; i<gpx.segmentCount(); ++i) {
+        before.push_back(gpx.at(i).latitudes());
+    }
+    assert(!history.canUndo() && !history.canRedo());
+    bool done = history.undo(gpx);
+    assert(!done);
+
+    QStringList odd;
+    for (int i=1; i<300; i+=2) {
+        odd << QString("ACTIVE LOG #%1").arg(i);
+    }
+    history.record(gpx, "Remove Tracks");
+    gpx.removeTracksByName(odd);
+    assert(gpx.segmentCount() == 150);
+
+    // Reading points doesn't copy them away from the history
+    for (int i=0; i<gpx.segmentCount(); ++i) {
+        assert(gpx[i].latitude(0) == gpx(3*i).latitude());
+        assert(gpx.at(i).latitudes() == before[2*i]);
+    }
+
+    QStringList names;
+    names << "ACTIVE LOG #0" << "ACTIVE LOG #2" << "ACTIVE LOG #4";
+    history.record(gpx, "Merge Tracks");
+    gpx.mergeTracksByName(names);
+    assert(gpx.segmentCount() == 148);
+    assert(history.undoCount() == 2 && history.undoText() == "Merge Tracks");
+
+    // Undone, the segments are the originals, points and all
+    done = history.undo(gpx);
+    assert(done);
+    assert(gpx.segmentCount() == 150);
+    assert(history.canRedo() && history.redoText() == "Merge Tracks");
+    done = history.undo(gpx);
+    assert(done);
+    assert(gpx.segmentCount() == 300 && !history.canUndo());
+    for (int i=0; i<gpx.segmentCount(); ++i) {
+        assert(gpx.at(i).latitudes() == before[i]);
+    }
+    assert(std::fabs(gpx.length() - length) < 1e-6);
+    assert(gpx.segmentIndex("ACTIVE LOG #1") == 1);
+
+    done = history.redo(gpx);
+    assert(done);
+    done = history.redo(gpx);
+    assert(done);
+    assert(gpx.segmentCount() == 148 && gpx[0].pointCount() == 9);
+    done = history.redo(gpx);
+    assert(!done);
+
+    // A new change drops what could be redone
+    history.undo(gpx);
+    history.record(gpx, "Remove Tracks");
+    gpx.removeTrackByName("ACTIVE LOG #0");
+    assert(!history.canRedo() && history.undoCount() == 2);
+
+    // Only the newest steps are kept
+    history.setLimit(3);
+    for (int i=0; i<5; ++i) {
+        history.record(gpx, QString("Step %1").arg(i));
+        gpx.removeTrack(1);
+    }
+    assert(history.undoCount() == 3 && history.undoText() == "Step 4");
+    while (history.undo(gpx)) {}
+    assert(gpx.segmentCount() == 147);
+
+    history.clear();
+    assert(!history.canUndo() && !history.canRedo());
+
+    qDebug() << "Edit history tests passed";
+}
+
+void compareFiles(GpxFile &a, GpxFile &b) {
+    assert(a.segmentCount() == b.segmentCount());
+    assert(a.pointCount() == b.pointCount());
+    assert(a.time() == b.time());
+
+    for (int i=0; i<a.segmentCount(); ++i) {
+        assert(a[i].name() == b[i].name());
+        assert(a[i].number() == b[i].number());
+    }
+    for (int i=0; i<a.pointCount(); ++i) {
+        assert(a(i).latitude() == b(i).latitude());
+        assert(a(i).longitude() == b(i).longitude());
+        assert(a(i).elevation() == b(i).elevation());
+        assert(a(i).time() == b(i).time());
+    }
+}
+
+void testReaders() {
+    qDebug() << "Testing SAX, stream and mapped readers agree";
+
+    QStringList files = QStringList() << "data/test1.gpx" << "data/test2.gpx" << "data/quandry.gpx";
+    for (int f=0; f<files.size(); ++f) {
+        GpxFile sax(files[f], true, GpxFile::SaxReader);
+        GpxFile stream(files[f], true, GpxFile::StreamReader);
+        GpxFile mapped(files[f], true, GpxFile::MappedReader);
+
+        compareFiles(sax, stream);
+        compareFiles(sax, mapped);
+    }
+    qDebug() << "Reader tests passed";
+}
+
+void testTimestamps() {
+    qDebug() << "Testing timestamp decoding";
+
+    const char *iso = "2009-11-27T16:36:58.250Z";
+    qint64 msecs = 0;
+    bool parsed = parseIsoTime(iso, iso+std::strlen(iso), msecs);
+    assert(parsed);
+    assert(msecs == Q_INT64_C(1259339818250));
+
+    char buf[32];
+    int len = formatIsoTime(msecs, buf);
+    assert(QByteArray(buf, len) == iso);
+
+    const char *bad = "2009-02-29T16:36:58Z";
+    parsed = parseIsoTime(bad, bad+std::strlen(bad), msecs);
+    assert(!parsed);
+
+    GpxFile gpx("data/quandry.gpx");
+    assert(gpx(0).timestamp() == Q_INT64_C(1259339818000));
+    assert(gpx(0).time() == QDateTime(QDate(2009, 11, 27), QTime(16, 36, 58), Qt::UTC));
+    assert(gpx(0).secondsBetween(gpx(1)) == 10);
+
+    // Every reader takes times without a zone as UTC, and points
+    // without a time have no duration or speed
+    QString fname = QDir::temp().filePath("gpx_tools_times.gpx");
+    {
+        QFile file(fname);
+        bool opened = file.open(QIODevice::WriteOnly);
+        assert(opened);
+        file.write("<?xml version=\"1.0\"?>\n<gpx><trk><name>Times</name><trkseg>"
+                   "<trkpt lat=\"39.38\" lon=\"-106.1\"><ele>3500</ele><time>2009-11-27T16:36:58</time></trkpt>"
+                   "<trkpt lat=\"39.39\" lon=\"-106.1\"><ele>3510</ele></trkpt>"
+                   "<trkpt lat=\"39.40\" lon=\"-106.1\"><ele>3520</ele><time>2009-11-27T16:36:58Z</time></trkpt>"
+                   "</trkseg></trk></gpx>\n");
+    }
+    GpxFile::Reader readers[] = { GpxFile::SaxReader, GpxFile::StreamReader, GpxFile::MappedReader };
+    for (int r=0; r<3; ++r) {
+        GpxFile times(fname, true, readers[r]);
+        assert(times.pointCount() == 3);
+        assert(times(0).timestamp() == Q_INT64_C(1259339818000));
+        assert(times(1).timestamp() == GpxPoint::NoTime);
+        assert(times(0).secondsBetween(times(1)) == 0);
+        assert(times(1).speedBetween(times(2)) == 0.0);
+        // Both ends have the same time
+        assert(times(0).speedBetween(times(2)) == 0.0);
+        assert(times.maxSpeed() == 0.0);
+
+        GpxTrackSegment untimed;
+        untimed.addPoint(times(1));
+        untimed.addPoint(times(2));
+        assert(untimed.duration() == 0);
+    }
+    QFile::remove(fname);
+    qDebug() << "Timestamp tests passed";
+}
+
+void testColumnarSegment() {
+    qDebug() << "Testing columnar track segments";
+
+    GpxFile gpx("data/quandry.gpx");
+    GpxTrackSegment a = gpx[0];
+    GpxTrackSegment b = gpx[1];
+
+    // Projected points must match a standalone GpxPoint
+    GpxPoint pt = a[10];
+    assert(pt.latitude() == a[10].latitude());
+    assert(pt.x() == a[10].x());
+    assert(pt.y() == a[10].y());
+    assert(pt.zone() == a[10].zone());
+    assert(pt.north() == a[10].north());
+
+    // Merging a projected segment keeps the projection valid
+    double lenA = a.length();
+    double lenB = b.length();
+    a.project();
+    b.project();
+    int countA = a.pointCount();
+    a.merge(b);
+    assert(a.pointCount() == countA + b.pointCount());
+    assert(a[countA].x() == b[0].x());
+    assert(std::fabs(a.length() - (lenA + lenB + a[countA-1].distanceTo(a[countA]))) < 1e-6);
+    qDebug() << "Columnar segment tests passed";
+}
+
+void testKernels() {
+    qDebug() << "Testing vectorized kernels";
+
+    GpxFile gpx("data/quandry.gpx");
+    GpxTrackSegment seg = gpx[0];
+    GpxKernelIsa best = gpxKernelIsa();
+
+    // Every instruction set has to agree with the scalar kernels.
+    // Bounds must match exactly, sums only to rounding.
+    setGpxKernelIsa(ScalarKernels);
+    double b0[6], u0[6];
+    seg.boundLatLon(b0[0], b0[1], b0[2], b0[3], b0[4], b0[5]);
+    seg.boundUTM(u0[0], u0[1], u0[2], u0[3], u0[4], u0[5]);
+    double len0 = seg.length();
+    double spd0 = seg.maxSpeed();
+
+    for (int isa=Sse2Kernels; isa<=best; ++isa) {
+        setGpxKernelIsa(GpxKernelIsa(isa));
+        double b[6], u[6];
+        seg.boundLatLon(b[0], b[1], b[2], b[3], b[4], b[5]);
+        seg.boundUTM(u[0], u[1], u[2], u[3], u[4], u[5]);
+        assert(std::memcmp(b, b0, sizeof(b)) == 0);
+        assert(std::memcmp(u, u0, sizeof(u)) == 0);
+        assert(std::fabs(seg.length() - len0) < 1e-9*len0);
+        assert(seg.maxSpeed() == spd0);
+    }
+
+    // Steps missing a time or not moving forward have no speed, in
+    // every lane and tail position
+    double gapSpd0 = 0.0;
+    for (int isa=ScalarKernels; isa<=best; ++isa) {
+        setGpxKernelIsa(GpxKernelIsa(isa));
+        GpxTrackSegment gaps;
+        for (int i=0; i<23; ++i) {
+            qint64 t = Q_INT64_C(1259339818000) + (i/3)*5000;
+            if (i % 7 == 4) t = GpxPoint::NoTime;
+            gaps.addPoint(GpxPoint(39.38 + i*0.0001, -106.1, 3500.0 + i, t));
+        }
+        if (isa == ScalarKernels) {
+            gapSpd0 = gaps.maxSpeed();
+            assert(gapSpd0 > 0.0 && gapSpd0 < 10.0);
+        }
+        assert(gaps.maxSpeed() == gapSpd0);
+    }
+
+    // Signed zeros and every tail length
+    double v[] = { 0.0, -0.0, 3.0, -0.0, 0.0, -7.5, 2.0, -0.0, 9.0 };
+    for (int n=1; n<=9; ++n) {
+        setGpxKernelIsa(ScalarKernels);
+        double lo0, hi0;
+        gpxMinMax(v, n, lo0, hi0);
+        for (int isa=Sse2Kernels; isa<=best; ++isa) {
+            setGpxKernelIsa(GpxKernelIsa(isa));
+            double lo, hi;
+            gpxMinMax(v, n, lo, hi);
+            assert(std::memcmp(&lo, &lo0, sizeof(lo)) == 0);
+            assert(std::memcmp(&hi, &hi0, sizeof(hi)) == 0);
+        }
+    }
+
+    setGpxKernelIsa(best);
+    qDebug() << "Kernel tests passed";
+}
+
+void testCachedStats() {
+    qDebug() << "Testing cached statistics";
+
+    // Statistics kept up to date through merges and removals must
+    // match ones computed from scratch afterwards
+    GpxFile cached("data/test2.gpx");
+    GpxFile fresh("data/test2.gpx");
+    assert(cached.segmentCount() == 3);
+
+    QStringList names;
+    names << cached[2].name() << cached[0].name();
+    QString removed = cached[1].name();
+
+    double minX, minY, minEle, maxX, maxY, maxEle;
+    cached[0].boundUTM(minX, minY, minEle, maxX, maxY, maxEle);
+    cached[2].boundUTM(minX, minY, minEle, maxX, maxY, maxEle);
+    cached.length();
+    cached.maxSpeed();
+    cached.duration();
+
+    cached.mergeTracksByName(names);
+    cached.removeTrackByName(removed);
+    fresh.mergeTracksByName(names);
+    fresh.removeTrackByName(removed);
+
+    assert(std::fabs(cached.length() - fresh.length()) < 1e-6);
+    assert(cached.maxSpeed() == fresh.maxSpeed());
+    assert(cached.duration() == fresh.duration());
+
+    assert(cached.segmentCount() == 1);
+    GpxTrackSegment &merged = cached.track(0);
+    assert(merged.name() == names[0]);
+    assert(std::fabs(merged.length() - fresh[0].length()) < 1e-6);
+
+    double fminX, fminY, fminEle, fmaxX, fmaxY, fmaxEle;
+    merged.boundUTM(minX, minY, minEle, maxX, maxY, maxEle);
+    fresh[0].boundUTM(fminX, fminY, fminEle, fmaxX, fmaxY, fmaxEle);
+    assert(minX == fminX && maxX == fmaxX);
+    assert(minY == fminY && maxY == fmaxY);
+    assert(minEle == fminEle && maxEle == fmaxEle);
+
+    // Adding points drops the cached values
+    double before = merged.length();
+    GpxPoint extra(merged.lastPoint().latitude() + 0.01, merged.lastPoint().longitude(),
+                   merged.lastPoint().elevation(), merged.lastPoint().timestamp() + 60000);
+    cached.addPoint(extra);
+    assert(cached.track(0).length() > before);
+    assert(std::fabs(cached.length() - cached.track(0).length()) < 1e-6);
+    qDebug() << "Cached statistics tests passed";
+}
+
+void testPointIndex() {
+    qDebug() << "Testing global point indexing";
+
+    // Keep the empty first track to check lookups skip it
+    GpxFile gpx("data/test1.gpx", false);
+    GpxFile merged("data/test2.gpx");
+    for (int i=0; i<merged.segmentCount(); ++i) {
+        gpx.addTrack(merged[i]);
+    }
+
+    for (int pass=0; pass<2; ++pass) {
+        int n = 0;
+        for (int i=0; i<gpx.segmentCount(); ++i) {
+            for (int j=0; j<gpx[i].pointCount(); ++j, ++n) {
+                assert(gpx.segmentOf(n) == i);
+                assert(gpx(n).timestamp() == gpx[i][j].timestamp());
+            }
+        }
+        assert(n == gpx.pointCount());
+
+        // Every range splits into spans covering it exactly once
+        for (int first=0; first<n; ++first) {
+            for (int count=1; first+count<=n; ++count) {
+                QVector<GpxSpan> spans = gpx.spans(first, count);
+                int next = first;
+                for (int k=0; k<spans.size(); ++k) {
+                    assert(spans[k].count > 0);
+                    assert(spans[k].offset + spans[k].count <= gpx[spans[k].segment].pointCount());
+                    assert(gpx.point(next).timestamp() ==
+                           gpx[spans[k].segment][spans[k].offset].timestamp());
+                    next += spans[k].count;
+                }
+                assert(next == first + count);
+            }
+        }
+
+        // Offsets have to follow merges and removals
+        if (pass == 0) {
+            QStringList names;
+            names << gpx[4].name() << gpx[2].name();
+            gpx.mergeTracksByName(names);
+            gpx.removeTrack(1);
+        }
+    }
+
+    // The total drops with the last segment, and with everything on a
+    // reload
+    int lastCount = gpx.at(gpx.segmentCount()-1).pointCount();
+    int total = gpx.pointCount();
+    gpx.removeTrack(gpx.segmentCount()-1);
+    assert(gpx.pointCount() == total - lastCount);
+    bool loaded = gpx.load("data/test1.gpx");
+    assert(loaded);
+    assert(gpx.pointCount() == GpxFile("data/test1.gpx").pointCount());
+    qDebug() << "Point indexing tests passed";
+}
+
+void testWriter() {
+    qDebug() << "Testing GPX writer";
+
+    // Written files read back exactly, names included
+    GpxFile orig("data/quandry.gpx");
+    orig[0].setName("Run & <lift> \"A\"");
+
+    QString fname = QDir::temp().filePath("gpx_tools_writer.gpx");
+    {
+        QFile file(fname);
+        bool opened = file.open(QIODevice::WriteOnly);
+        assert(opened);
+        GpxWriter writer(&file);
+        bool written = writer.write(orig);
+        assert(written);
+    }
+    GpxFile copy(fname);
+    compareFiles(orig, copy);
+    QFile::remove(fname);
+
+    // Shortest output by default, the old nine decimals on request
+    GpxFile small("data/test1.gpx");
+    QByteArray shortest, fixed;
+    {
+        QBuffer buffer(&shortest);
+        buffer.open(QIODevice::WriteOnly);
+        GpxWriter writer(&buffer);
+        writer.write(small);
+    }
+    {
+        QBuffer buffer(&fixed);
+        buffer.open(QIODevice::WriteOnly);
+        GpxWriter writer(&buffer, GpxWriter::FixedPrecision);
+        writer.write(small);
+    }
+    assert(shortest.contains("<trkpt lat=\"39.38\" lon=\"-106\"><ele>50</ele>"));
+    assert(fixed.contains("<trkpt lat=\"39.380000000\" lon=\"-106.000000000\"><ele>50.000000000</ele>"));
+    qDebug() << "GPX writer tests passed";
+}
+
+void testBinary() {
+    qDebug() << "Testing binary track files";
+
+    GpxFile orig("data/quandry.gpx");
+    QString origXml;
+    orig.toXml(origXml);
+
+    // Both layouts load back to the same file
+    QString fname = QDir::temp().filePath("gpx_tools_binary.gpxb");
+    GpxBinaryWriter::Layout layouts[] = { GpxBinaryWriter::PackedLayout,
+                                          GpxBinaryWriter::ColumnarLayout };
+    for (int l=0; l<2; ++l) {
+        {
+            QFile file(fname);
+            bool opened = file.open(QIODevice::WriteOnly);
+            assert(opened);
+            GpxBinaryWriter writer(&file, layouts[l]);
+            bool written = writer.write(orig);
+            assert(written);
+        }
+        GpxFile copy(fname);
+        compareFiles(orig, copy);
+
+        QString copyXml;
+        copy.toXml(copyXml);
+        assert(copyXml == origXml);
+    }
+
+    // The columnar file can be used in place
+    GpxBinaryView view;
+    bool mapped = view.open(fname);
+    assert(mapped);
+    assert(view.segmentCount() == orig.segmentCount());
+    for (int i=0; i<view.segmentCount(); ++i) {
+        assert(view.name(i) == orig[i].name());
+        assert(view.pointCount(i) == orig[i].pointCount());
+        for (int j=0; j<view.pointCount(i); ++j) {
+            assert(view.latitudes(i)[j] == orig[i].latitude(j));
+            assert(view.timestamps(i)[j] == orig[i].timestamp(j));
+        }
+    }
+    view.close();
+    QFile::remove(fname);
+
+    // Values that don't fit the fixed point encoding are stored raw
+    GpxTrackSegment seg;
+    seg.setName("Raw");
+    seg.addPoint(GpxPoint(0.1 + 0.2, -106.0, 3000.0, GpxPoint::NoTime));
+    seg.addPoint(GpxPoint(39.5, -106.0/3.0, 3001.25, Q_INT64_C(1262422800000)));
+    GpxFile raw(seg);
+
+    QByteArray bytes;
+    {
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::WriteOnly);
+        GpxBinaryWriter writer(&buffer);
+        bool written = writer.write(raw);
+        assert(written);
+    }
+    GpxFile rawCopy(seg);
+    rawCopy.removeTrackByName("Raw");
+    GpxBinaryReader reader(rawCopy);
+    bool parsed = reader.parse(bytes.constData(), bytes.constData()+bytes.size());
+    assert(parsed);
+    compareFiles(raw, rawCopy);
+
+    // Truncated files are rejected
+    GpxFile truncated(seg);
+    GpxBinaryReader truncatedReader(truncated);
+    parsed = truncatedReader.parse(bytes.constData(), bytes.constData()+bytes.size()-3);
+    assert(!parsed);
+    qDebug() << "Binary track file tests passed";
+}
+
+void testBatchLoader() {
+    qDebug() << "Testing batch loader";
+
+    // Read failures are reported instead of giving an empty file
+    GpxFile missing;
+    bool loaded = missing.load("data/no_such_file.gpx");
+    assert(!loaded);
+    assert(!missing.errorString().isEmpty());
+
+    QString broken = QDir::temp().filePath("gpx_tools_broken.gpx");
+    {
+        QFile file(broken);
+        bool opened = file.open(QIODevice::WriteOnly);
+        assert(opened);
+        file.write("<?xml version=\"1.0\"?>\n<gpx><trk><trkseg><trkpt lat=\"1\" lon=\"2\">");
+    }
+
+    QStringList files = GpxBatchLoader::findFiles("data");
+    assert(files.size() == 3);
+    files << "data/no_such_file.gpx" << broken;
+    for (int i=0; i<4; ++i) {
+        files << files[i%3];
+    }
+
+    for (int threads=1; threads<=4; threads*=2) {
+        GpxBatchLoader loader(files);
+        loader.setThreadCount(threads);
+
+        QVector<bool> seen(files.size(), false);
+        GpxBatchResult result;
+        while (loader.next(result)) {
+            assert(!seen[result.index]);
+            seen[result.index] = true;
+            assert(result.fileName == files[result.index]);
+
+            if (result.fileName == files[3] || result.fileName == broken) {
+                assert(!result.ok);
+                assert(!result.error.isEmpty());
+            } else {
+                assert(result.ok);
+                GpxFile single(result.fileName, true, GpxFile::MappedReader);
+                compareFiles(single, result.gpx);
+            }
+        }
+        assert(loader.atEnd());
+        assert(loader.finishedCount() == files.size());
+        for (int i=0; i<files.size(); ++i) {
+            assert(seen[i]);
+        }
+    }
+
+    // Cancelling returns whatever was already read and nothing else
+    {
+        GpxBatchLoader loader(files);
+        loader.setThreadCount(2);
+        GpxBatchResult result;
+        assert(loader.next(result));
+        loader.cancel();
+        int count = 1;
+        while (loader.next(result)) ++count;
+        assert(count <= files.size());
+    }
+
+    QFile::remove(broken);
+    qDebug() << "Batch loader tests passed";
+}
+
+void testParallelStats() {
+    qDebug() << "Testing parallel statistics";
+
+    // Many segments cut from a real track
+    GpxFile orig("data/quandry.gpx");
+    GpxTrackSegment &src = orig[0];
+    GpxFile serial, parallel;
+    for (int s=0; s<40; ++s) {
+        GpxTrackSegment seg;
+        seg.setNumber(s+1);
+        for (int i=s; i<src.pointCount(); i+=7) {
+            seg.addPoint(src.point(i));
+        }
+        serial.addTrack(seg);
+        parallel.addTrack(seg);
+    }
+
+    int threshold = GpxFile::parallelThreshold();
+
+    GpxFile::setParallelThreshold(-1);
+    double length = serial.length();
+    double maxSpeed = serial.maxSpeed();
+    time_t duration = serial.duration();
+    double ll[6], utm[6];
+    serial.boundLatLon(ll[0], ll[1], ll[2], ll[3], ll[4], ll[5]);
+    serial.boundUTM(utm[0], utm[1], utm[2], utm[3], utm[4], utm[5]);
+
+    // Segments are combined in the same order, so results are identical
+    GpxFile::setParallelThreshold(0);
+    double pll[6], putm[6];
+    parallel.boundUTM(putm[0], putm[1], putm[2], putm[3], putm[4], putm[5]);
+    parallel.boundLatLon(pll[0], pll[1], pll[2], pll[3], pll[4], pll[5]);
+    assert(parallel.length() == length);
+    assert(parallel.maxSpeed() == maxSpeed);
+    assert(parallel.duration() == duration);
+    for (int i=0; i<6; ++i) {
+        assert(pll[i] == ll[i]);
+        assert(putm[i] == utm[i]);
+    }
+
+    // Changing one segment only recomputes that one
+    parallel.addPoint(src.point(0), 3);
+    serial.addPoint(src.point(0), 3);
+    assert(parallel.length() == serial.length());
+
+    // Only the UTM distance model needs the points projected
+    GpxDistanceModel model = gpxDistanceModel();
+    setGpxDistanceModel(SphericalDistance);
+    GpxFile lazy;
+    for (int s=0; s<4; ++s) {
+        GpxTrackSegment seg;
+        for (int i=s; i<src.pointCount(); i+=4) {
+            seg.addPoint(src.point(i));
+        }
+        lazy.addTrack(seg);
+    }
+    lazy.length();
+    lazy.boundLatLon(pll[0], pll[1], pll[2], pll[3], pll[4], pll[5]);
+    for (int s=0; s<lazy.segmentCount(); ++s) {
+        assert(lazy.at(s).projectedCount() == 0);
+    }
+    setGpxDistanceModel(model);
+
+    GpxFile::setParallelThreshold(threshold);
+    qDebug() << "Parallel statistics tests passed";
+}
+
+void testProjection() {
+    qDebug() << "Testing UTM projection";
+
+    // A grid over the UTM latitudes, the Norway and Svalbard zones, the
+    // antimeridian, and a few polar points for UPS
+    QVector<double> lat, lon;
+    for (double la=-80.0; la<84.0; la+=2.9) {
+        for (double lo=-180.0; lo<=180.0; lo+=3.7) {
+            lat.push_back(la);
+            lon.push_back(lo);
+        }
+    }
+    double special[][2] = { { 60.0, 4.0 }, { 60.0, 2.9 }, { 75.0, 10.0 }, { 75.0, 25.0 },
+                            { 79.9, 35.0 }, { 0.0, -180.0 }, { -0.0, 179.999 },
+                            { 84.5, 20.0 }, { -85.0, -100.0 }, { 39.48, -106.07 } };
+    for (size_t i=0; i<sizeof(special)/sizeof(special[0]); ++i) {
+        lat.push_back(special[i][0]);
+        lon.push_back(special[i][1]);
+    }
+    int n = lat.size();
+
+    QVector<double> x(n), y(n);
+    QVector<signed char> zone(n);
+
+    GpxKernelIsa best = gpxKernelIsa();
+    for (int isa=best; isa>=ScalarKernels; --isa) {
+        setGpxKernelIsa(GpxKernelIsa(isa));
+
+        QVector<double> bx(n), by(n);
+        gpxProjectUTM(lat.constData(), lon.constData(), n, bx.data(), by.data(), zone.data());
+
+        for (int i=0; i<n; ++i) {
+            int gz;
+            bool gnorth;
+            double gx, gy, gamma, k;
+            GeographicLib::UTMUPS::Forward(lat[i], lon[i], gz, gnorth, gx, gy, gamma, k);
+
+            assert(zone[i] == (gnorth ? gz+1 : -(gz+1)));
+            assert(std::fabs(bx[i] - gx) < 1e-4);
+            assert(std::fabs(by[i] - gy) < 1e-4);
+        }
+
+        // Every instruction set gives the same bits
+        if (isa == best) {
+            x = bx;
+            y = by;
+        } else {
+            assert(std::memcmp(x.constData(), bx.constData(), n*sizeof(double)) == 0);
+            assert(std::memcmp(y.constData(), by.constData(), n*sizeof(double)) == 0);
+        }
+    }
+    setGpxKernelIsa(best);
+
+    // Points and segments go through the same code
+    GpxPoint pt(lat[n-1], lon[n-1], 0.0, GpxPoint::NoTime);
+    assert(pt.x() == x[n-1] && pt.y() == y[n-1]);
+    qDebug() << "UTM projection tests passed";
+}
+
+void testDistanceModels() {
+    qDebug() << "Testing distance models";
+
+    GpxFile gpx("data/quandry.gpx");
+    double utm = gpx.length();
+    double utmSpeed = gpx.maxSpeed();
+
+    setGpxDistanceModel(GeodesicDistance);
+    double geodesic = gpx.length();
+
+    setGpxDistanceModel(SphericalDistance);
+    double spherical = gpx.length();
+
+    // Near the middle of a zone UTM is a hair short, and the sphere is
+    // within its documented error
+    assert(std::fabs(utm - geodesic) / geodesic < 0.001);
+    assert(std::fabs(spherical - geodesic) / geodesic < 0.005);
+
+    // Every instruction set gives the same spherical lengths
+    GpxKernelIsa best = gpxKernelIsa();
+    for (int isa=ScalarKernels; isa<best; ++isa) {
+        setGpxKernelIsa(GpxKernelIsa(isa));
+        GpxFile copy("data/quandry.gpx");
+        assert(copy.length() == spherical);
+    }
+    setGpxKernelIsa(best);
+
+    // One degree along the equator, and a step across the boundary
+    // between zones 13 and 14
+    GpxPoint a(0.0, 0.0, 0.0, GpxPoint::NoTime);
+    GpxPoint b(0.0, 1.0, 0.0, GpxPoint::NoTime);
+    GpxPoint west(39.0, -102.0001, 0.0, GpxPoint::NoTime);
+    GpxPoint east(39.0, -101.9999, 0.0, GpxPoint::NoTime);
+
+    assert(std::fabs(a.distanceTo(b) - 6371008.8 * M_PI / 180) < 1e-6);
+    assert(std::fabs(west.distanceTo(east) - 17.3) < 0.1);
+
+    setGpxDistanceModel(GeodesicDistance);
+    assert(std::fabs(a.distanceTo(b) - 111319.491) < 1e-3);
+    assert(std::fabs(west.distanceTo(east) - 17.32) < 0.01);
+
+    // Steps without two increasing times have no speed here either
+    GpxTrackSegment gaps;
+    gaps.addPoint(GpxPoint(39.0, -106.0, 0.0, Q_INT64_C(1259339818000)));
+    gaps.addPoint(GpxPoint(39.001, -106.0, 0.0, Q_INT64_C(1259339818000)));
+    gaps.addPoint(GpxPoint(39.002, -106.0, 0.0, GpxPoint::NoTime));
+    gaps.addPoint(GpxPoint(39.003, -106.0, 0.0, Q_INT64_C(1259339828000)));
+    gaps.addPoint(GpxPoint(39.004, -106.0, 0.0, Q_INT64_C(1259339838000)));
+    assert(std::fabs(gaps.maxSpeed() - 11.1) < 0.1);
+    setGpxDistanceModel(SphericalDistance);
+    assert(std::fabs(gaps.maxSpeed() - 11.1) < 0.1);
+
+    setGpxDistanceModel(UtmDistance);
+    assert(west.distanceTo(east) > 1000.0);
+    assert(gpx.length() == utm);
+    assert(gpx.maxSpeed() == utmSpeed);
+    qDebug() << "Distance model tests passed";
+}
+
+// Check every query against a plain scan
+void checkPyramid(const GpxMinMaxPyramid &pyramid, const QVector<double> &v) {
+    assert(pyramid.size() == v.size());
+    for (int trial=0; trial<2000; ++trial) {
+        int first = rand() % v.size();
+        int count = 1 + rand() % (v.size() - first);
+        if (trial < 20) {
+            first = 0;
+            count = v.size() - trial;
+        }
+
+        double lo = v[first], hi = v[first];
+        for (int i=first+1; i<first+count; ++i) {
+            if (v[i] < lo) lo = v[i];
+            if (v[i] > hi) hi = v[i];
+        }
+        double plo, phi;
+        pyramid.minMax(first, count, plo, phi);
+        assert(plo == lo && phi == hi);
+    }
+}
+
+void testPyramid() {
+    qDebug() << "Testing elevation pyramid";
+
+    srand(15);
+    QVector<double> v;
+    for (int i=0; i<5000; ++i) {
+        v.push_back(3000.0 + (rand() % 100000) / 100.0);
+    }
+
+    GpxMinMaxPyramid pyramid;
+    pyramid.update(v);
+    checkPyramid(pyramid, v);
+
+    // Growing the series extends it, a changed point rebuilds it
+    for (int i=0; i<1237; ++i) {
+        v.push_back(2000.0 + (rand() % 300000) / 100.0);
+    }
+    pyramid.update(v);
+    checkPyramid(pyramid, v);
+
+    v[17] = 10000.0;
+    pyramid.update(v);
+    checkPyramid(pyramid, v);
+
+    // A segment's pyramid agrees with its bounds
+    GpxFile gpx("data/quandry.gpx");
+    GpxMinMaxPyramid segPyramid;
+    segPyramid.update(gpx.at(0).elevationColumn());
+
+    double minLat, minLon, minEle, maxLat, maxLon, maxEle, lo, hi;
+    gpx[0].boundLatLon(minLat, minLon, minEle, maxLat, maxLon, maxEle);
+    segPyramid.minMax(0, segPyramid.size(), lo, hi);
+    assert(lo == minEle && hi == maxEle);
+    qDebug() << "Elevation pyramid tests passed";
+}
+
+// Records the reports it gets, and cancels the load after cancelAfter
+// of them if that's set
+class RecordingProgress : public GpxLoadProgress {
+public:
+    RecordingProgress(int cancel = -1) : GpxLoadProgress(4096), cancelAfter(cancel),
+                                         total(-1), points(0) { }
+
+    int cancelAfter;
+    QVector<qint64> done;
+    qint64 total;
+    int points;
+
+protected:
+    void progress(qint64 d, qint64 t, GpxFile &gpx) {
+        // Bytes and points only go forward
+        assert(done.isEmpty() || d > done.last());
+        assert(d <= t);
+        done.push_back(d);
+        total = t;
+
+        int n = 0;
+        for (int i=0; i<gpx.segmentCount(); ++i) {
+            n += gpx.at(i).pointCount();
+        }
+        assert(n >= points);
+        points = n;
+
+        // Queries while loading mustn't leave the file's caches behind
+        // the reader
+        assert(gpx.pointCount() == n);
+        gpx.length();
+
+        if (done.size() == cancelAfter) cancel();
+    }
+};
+
+void checkLoadProgress(QString fname, GpxFile::Reader reader) {
+    GpxFile plain;
+    bool loaded = plain.load(fname, true, reader);
+    assert(loaded);
+
+    RecordingProgress rec;
+    GpxFile gpx;
+    loaded = gpx.load(fname, true, reader, &rec);
+    assert(loaded);
+    compareFiles(plain, gpx);
+    assert(gpx.length() == plain.length());
+    assert(rec.done.size() > 2);
+    assert(rec.total == QFileInfo(fname).size());
+
+    // Loading again after a reset reports from the start
+    rec.done.clear();
+    rec.points = 0;
+    rec.reset();
+    loaded = gpx.load(fname, true, reader, &rec);
+    assert(loaded);
+    assert(rec.done.size() > 2);
+
+    RecordingProgress stop(2);
+    GpxFile partial;
+    loaded = partial.load(fname, true, reader, &stop);
+    assert(!loaded);
+    assert(partial.errorString() == "Cancelled");
+    assert(stop.isCancelled());
+    assert(stop.done.size() == 2);
+    assert(partial.pointCount() < plain.pointCount());
+}
+
+void testLoadProgress() {
+    qDebug() << "Testing load progress and cancellation";
+
+    checkLoadProgress("data/quandry.gpx", GpxFile::SaxReader);
+    checkLoadProgress("data/quandry.gpx", GpxFile::StreamReader);
+    checkLoadProgress("data/quandry.gpx", GpxFile::MappedReader);
+
+    GpxFile orig("data/quandry.gpx");
+    QString fname = QDir::temp().filePath("gpx_tools_progress.gpxb");
+
+    // Binary files report between segments, so give it plenty of them
+    GpxFile split;
+    for (int i=0; i<orig.pointCount(); i += 100) {
+        GpxTrackSegment seg;
+        for (int j=i; j<i+100 && j<orig.pointCount(); ++j) {
+            seg.addPoint(orig(j));
+        }
+        seg.setNumber(split.segmentCount()+1);
+        split.addTrack(seg);
+    }
+
+    GpxBinaryWriter::Layout layouts[] = { GpxBinaryWriter::PackedLayout,
+                                          GpxBinaryWriter::ColumnarLayout };
+    for (int l=0; l<2; ++l) {
+        {
+            QFile file(fname);
+            bool opened = file.open(QIODevice::WriteOnly);
+            assert(opened);
+            GpxBinaryWriter writer(&file, layouts[l]);
+            bool written = writer.write(split);
+            assert(written);
+        }
+        checkLoadProgress(fname, GpxFile::StreamReader);
+    }
+    QFile::remove(fname);
+
+    qDebug() << "Load progress tests passed";
+}
+
+// Checks simple holds an unchanged subsequence of orig's points,
+// including both ends, and returns the furthest any dropped point is
+// from the simplified track, measured in UTM
+double simplifiedError(GpxTrackSegment &orig, GpxTrackSegment &simple) {
+    QVector<int> kept;
+    int j = 0;
+    for (int i=0; i<simple.pointCount(); ++i) {
+        while (j < orig.pointCount() &&
+               !(orig.latitude(j) == simple.latitude(i) &&
+                 orig.longitude(j) == simple.longitude(i) &&
+                 orig.elevation(j) == simple.elevation(i) &&
+                 orig.timestamp(j) == simple.timestamp(i))) {
+            ++j;
+        }
+        assert(j < orig.pointCount());
+        kept.push_back(j++);
+    }
+    assert(kept.first() == 0);
+    assert(kept.last() == orig.pointCount()-1);
+
+    double worst = 0.0;
+    for (int k=1; k<kept.size(); ++k) {
+        int a = kept[k-1];
+        int b = kept[k];
+        double dx = orig.x(b) - orig.x(a);
+        double dy = orig.y(b) - orig.y(a);
+        double len2 = dx*dx + dy*dy;
+        for (int i=a+1; i<b; ++i) {
+            double px = orig.x(i) - orig.x(a);
+            double py = orig.y(i) - orig.y(a);
+            double t = len2 > 0.0 ? (px*dx + py*dy) / len2 : 0.0;
+            t = std::max(0.0, std::min(1.0, t));
+            double d = std::sqrt((px-t*dx)*(px-t*dx) + (py-t*dy)*(py-t*dy));
+            worst = std::max(worst, d);
+        }
+    }
+    return worst;
+}
+
+void testSimplify() {
+    qDebug() << "Testing track simplification";
+
+    GpxFile orig("data/quandry.gpx");
+    double tolerance = 5.0;
+
+    for (int a=0; a<2; ++a) {
+        for (int e=0; e<2; ++e) {
+            GpxSimplifier simplifier(tolerance, a == 0 ? GpxSimplifier::DouglasPeucker
+                                                       : GpxSimplifier::VisvalingamWhyatt);
+            simplifier.setPreserveElevation(e == 1);
+
+            GpxFile simple = orig;
+            int removed = simplifier.simplify(simple);
+            assert(removed > 0);
+            assert(simple.pointCount() == orig.pointCount() - removed);
+            qDebug() << "  algorithm" << a << "elevation" << e << "kept"
+                     << simple.pointCount() << "of" << orig.pointCount();
+
+            for (int i=0; i<orig.segmentCount(); ++i) {
+                double error = simplifiedError(orig[i], simple[i]);
+                if (a == 0) {
+                    assert(error <= tolerance);
+                }
+                if (e == 1) {
+                    double b1[6], b2[6];
+                    orig[i].boundLatLon(b1[0], b1[1], b1[2], b1[3], b1[4], b1[5]);
+                    simple[i].boundLatLon(b2[0], b2[1], b2[2], b2[3], b2[4], b2[5]);
+                    assert(b1[2] == b2[2] && b1[5] == b2[5]);
+                }
+            }
+
+            // Simplifying while loading gives about the same result
+            GpxSimplifyFilter filter(simplifier, 4096);
+            GpxFile streamed;
+            bool loaded = streamed.load("data/quandry.gpx", true, GpxFile::MappedReader, &filter);
+            assert(loaded);
+            assert(streamed.segmentCount() == orig.segmentCount());
+            assert(streamed.pointCount() < orig.pointCount());
+            assert(streamed.pointCount() < simple.pointCount() * 1.2 + 10);
+            for (int i=0; i<orig.segmentCount(); ++i) {
+                double error = simplifiedError(orig[i], streamed[i]);
+                if (a == 0) {
+                    assert(error <= tolerance);
+                }
+            }
+        }
+    }
+
+    // A straight line collapses to its ends, except where it changes
+    // UTM zone at 108W
+    GpxTrackSegment line;
+    for (int i=0; i<=200; ++i) {
+        double wiggle = (i%2) ? 1e-6 : -1e-6;
+        line.addPoint(GpxPoint(39.5 + wiggle, -108.01 + i*0.0001, 2000.0, qint64(i)*1000));
+    }
+    GpxTrackSegment straight = line;
+    GpxSimplifier simplifier(1.0);
+    simplifier.simplify(straight);
+    assert(straight.pointCount() == 4);
+    assert(straight.zone(1) != straight.zone(2));
+    assert(simplifiedError(line, straight) <= 1.0);
+
+    // Nothing to remove from two points
+    GpxTrackSegment pair;
+    pair.addPoint(line.point(0));
+    pair.addPoint(line.point(1));
+    int pairRemoved = simplifier.simplify(pair);
+    assert(pairRemoved == 0);
+
+    qDebug() << "Simplification tests passed";
+}
+
+// Great circle distance on the index's sphere, the slow way
+double sphereDistance(double lat1, double lon1, double lat2, double lon2) {
+    double d = M_PI/180;
+    double h = std::pow(std::sin((lat2-lat1)*d/2), 2) +
+        std::cos(lat1*d)*std::cos(lat2*d)*std::pow(std::sin((lon2-lon1)*d/2), 2);
+    return 2*6371008.8*std::asin(std::sqrt(std::min(h, 1.0)));
+}
+
+// Compare every kind of query against a scan over all points
+void checkSpatialIndex(GpxFile &gpx) {
+    const GpxSpatialIndex &index = gpx.spatialIndex();
+    assert(index.size() == gpx.pointCount());
+
+    double minLat, minLon, minEle, maxLat, maxLon, maxEle;
+    gpx.boundLatLon(minLat, minLon, minEle, maxLat, maxLon, maxEle);
+
+    srand(19);
+    for (int q=0; q<200; ++q) {
+        // Mostly around the track, some well away from it
+        double spread = q < 150 ? 1.2 : 40.0;
+        double lat = (minLat+maxLat)/2 + (maxLat-minLat+0.01)*spread*(rand()/double(RAND_MAX)-0.5);
+        double lon = (minLon+maxLon)/2 + (maxLon-minLon+0.01)*spread*(rand()/double(RAND_MAX)-0.5);
+        lat = std::max(-89.0, std::min(89.0, lat));
+        if (q % 50 == 0) {
+            // Exactly on a point
+            lat = gpx(q % gpx.pointCount()).latitude();
+            lon = gpx(q % gpx.pointCount()).longitude();
+        }
+
+        QVector<double> dist(gpx.pointCount());
+        double best = 1e300;
+        for (int i=0; i<gpx.pointCount(); ++i) {
+            dist[i] = sphereDistance(lat, lon, gpx(i).latitude(), gpx(i).longitude());
+            best = std::min(best, dist[i]);
+        }
+
+        double metres = -1.0;
+        int near = index.nearest(lat, lon, &metres);
+        assert(near >= 0 && near < gpx.pointCount());
+        assert(std::fabs(dist[near] - best) < 1e-6);
+        assert(std::fabs(metres - best) < 1e-6);
+
+        double radius = 50.0 + 20.0*q;
+        QVector<int> within = index.withinDistance(lat, lon, radius);
+        QVector<int> expected;
+        for (int i=0; i<gpx.pointCount(); ++i) {
+            // Skip points right on the edge, where rounding decides
+            if (std::fabs(dist[i] - radius) < 1e-6) continue;
+            if (dist[i] < radius) expected.push_back(i);
+        }
+        for (int i=0, j=0; i<expected.size(); ++i, ++j) {
+            while (j < within.size() && within[j] != expected[i]) {
+                assert(std::fabs(dist[within[j]] - radius) < 1e-6);
+                ++j;
+            }
+            assert(j < within.size());
+        }
+
+        double h = 0.002*(q%10+1);
+        QVector<int> box = index.inBox(lat-h, lon-h, lat+h, lon+h);
+        expected.clear();
+        for (int i=0; i<gpx.pointCount(); ++i) {
+            if (gpx(i).latitude() >= lat-h && gpx(i).latitude() <= lat+h &&
+                gpx(i).longitude() >= lon-h && gpx(i).longitude() <= lon+h) {
+                expected.push_back(i);
+            }
+        }
+        assert(box == expected);
+    }
+}
+
+void testSpatialIndex() {
+    qDebug() << "Testing spatial index";
+
+    GpxSpatialIndex empty;
+    assert(empty.nearest(0, 0) == -1);
+    assert(empty.inBox(-90, -180, 90, 180).isEmpty());
+
+    GpxFile gpx("data/quandry.gpx");
+    checkSpatialIndex(gpx);
+
+    // Changes to the file rebuild the index
+    GpxFile merged("data/test2.gpx");
+    checkSpatialIndex(merged);
+    QStringList names;
+    for (int i=0; i<merged.segmentCount(); ++i) {
+        names << merged[i].name();
+    }
+    merged.mergeTracksByName(names);
+    checkSpatialIndex(merged);
+
+    gpx.removeTrackByName(gpx[0].name());
+    checkSpatialIndex(gpx);
+
+    // Points on both sides of the antimeridian
+    GpxTrackSegment seg;
+    for (int i=0; i<100; ++i) {
+        seg.addPoint(GpxPoint(-16.5 + 0.001*i, i%2 ? 179.9995 - 0.0001*i : -179.9995 + 0.0001*i,
+                              0.0, qint64(i)*1000));
+    }
+    GpxFile dateLine(seg);
+    int near = dateLine.spatialIndex().nearest(-16.45, 180.0);
+    double best = 1e300;
+    for (int i=0; i<dateLine.pointCount(); ++i) {
+        best = std::min(best, sphereDistance(-16.45, 180.0, dateLine(i).latitude(), dateLine(i).longitude()));
+    }
+    assert(std::fabs(sphereDistance(-16.45, 180.0, dateLine(near).latitude(),
+                                     dateLine(near).longitude()) - best) < 1e-6);
+    assert(dateLine.spatialIndex().withinDistance(-16.45, 180.0, 1000.0).size() > 0);
+
+    qDebug() << "Spatial index tests passed";
+}
+
+// The resort closest to lat, lon by checking them all
+int scanResorts(const GpxResortDb &db, double lat, double lon, double &metres) {
+    int best = -1;
+    metres = 1e300;
+    for (int i=0; i<db.size(); ++i) {
+        double d = sphereDistance(lat, lon, db.resort(i).latitude, db.resort(i).longitude);
+        if (d < metres) {
+            metres = d;
+            best = i;
+        }
+    }
+    return best;
+}
+
+void testResortDb() {
+    qDebug() << "Testing resort database";
+
+    GpxResortDb empty;
+    assert(empty.nearest(0, 0) == -1);
+    bool loaded = empty.load("data/missing.xml");
+    assert(!loaded);
+    assert(!empty.errorString().isEmpty());
+
+    GpxResortDb db;
+    bool ok = db.load("../../../perl/north_america.xml");
+    assert(ok);
+    assert(db.size() == 560);
+
+    const GpxResort &first = db.resort(0);
+    assert(first.name == "Plattekill");
+    assert(first.latitude == 42.29004 && first.longitude == -74.653352);
+    assert(first.elevation == 3500 && first.vertical == 1100);
+    assert(first.runs == 35 && first.lifts == 3);
+    assert(first.snowfall == 190 && first.longestRun == 2);
+    assert(first.url == "http://www.plattekill.com");
+
+    // Empty values are unknown, and entities are decoded
+    bool foundMoose = false, foundCochrans = false;
+    for (int i=0; i<db.size(); ++i) {
+        if (db.resort(i).name == "Moose Mountain") {
+            foundMoose = true;
+            assert(db.resort(i).elevation == -1 && db.resort(i).runs == -1);
+            assert(db.resort(i).url.isEmpty());
+        }
+        foundCochrans = foundCochrans || db.resort(i).name == "Cochran's";
+    }
+    assert(foundMoose && foundCochrans);
+
+    // Same distance as checking every resort, anywhere in the world
+    srand(3);
+    for (int q=0; q<2000; ++q) {
+        double lat = q < 1000 ? 25.0 + 45.0*rand()/RAND_MAX : -90.0 + 180.0*rand()/RAND_MAX;
+        double lon = q < 1000 ? -150.0 + 100.0*rand()/RAND_MAX : -180.0 + 360.0*rand()/RAND_MAX;
+        double metres, expected;
+        int r = db.nearest(lat, lon, &metres);
+        scanResorts(db, lat, lon, expected);
+        assert(r >= 0 && r < db.size());
+        assert(std::fabs(metres - expected) < 1e-3);
+        assert(std::fabs(sphereDistance(lat, lon, db.resort(r).latitude, db.resort(r).longitude) - expected) < 1e-3);
+    }
+
+    // Each resort is nearest to itself
+    for (int i=0; i<db.size(); ++i) {
+        double metres;
+        int r = db.nearest(db.resort(i).latitude, db.resort(i).longitude, &metres);
+        assert(metres < 1e-3);
+        assert(db.resort(r).latitude == db.resort(i).latitude);
+    }
+
+    GpxFile gpx("data/quandry.gpx");
+    double metres;
+    int expected = scanResorts(db, gpx(0).latitude(), gpx(0).longitude(), metres);
+    int found = db.identify(gpx);
+    assert(found == expected);
+    qDebug() << "quandry.gpx was recorded at" << db.resort(found).name;
+    assert(db.identify(gpx, 10.0) == -1);
+    assert(empty.identify(gpx) == -1);
+
+    GpxFile nothing;
+    assert(db.identify(nothing) == -1);
+
+    qDebug() << "Resort database tests passed";
+}
+
+// A day of laps: a slow lift up 300m, a run down, and a wait at the
+// bottom, with a few metres of noise in the elevation.  The day is
+// split into two segments at the bottom of a run.
+GpxFile skiDay(int laps) {
+    GpxFile gpx;
+    GpxTrackSegment seg;
+    double lat = 39.48, ele = 2900.0;
+    qint64 t = Q_INT64_C(1259460000000);
+    int n = 0;
+    for (int lap=0; lap<laps; ++lap) {
+        for (int i=0; i<300; ++i, ++n) {
+            seg.addPoint(GpxPoint(lat, -106.07, ele + (n*7919 % 11) - 5, t));
+            lat += 2.2e-5;
+            ele += 1.0;
+            t += 2000;
+        }
+        for (int i=0; i<90; ++i, ++n) {
+            seg.addPoint(GpxPoint(lat, -106.07, ele + (n*7919 % 11) - 5, t));
+            lat -= 2.2e-5 * 300 / 90;
+            ele -= 300.0 / 90;
+            t += 2000;
+            if (i == 45) {
+                // A bad fix a long way off
+                seg.addPoint(GpxPoint(lat + 1.0, -106.07, ele, t));
+                t += 2000;
+            }
+        }
+        for (int i=0; i<30; ++i, ++n) {
+            seg.addPoint(GpxPoint(lat, -106.07, ele + (n*7919 % 11) - 5, t));
+            t += 2000;
+        }
+        if (lap == 1) {
+            gpx.addTrack(seg);
+            seg = GpxTrackSegment();
+        }
+    }
+    gpx.addTrack(seg);
+    return gpx;
+}
+
+void compareRuns(const GpxSkiAnalyzer &a, const GpxSkiAnalyzer &b) {
+    assert(a.runs().size() == b.runs().size());
+    for (int i=0; i<a.runs().size(); ++i) {
+        const GpxSkiRun &r = a.runs()[i], &s = b.runs()[i];
+        assert(r.start == s.start && r.end == s.end);
+        assert(r.vertical == s.vertical && r.liftVertical == s.liftVertical);
+        assert(std::fabs(r.distance - s.distance) < 1e-6);
+        assert(r.maxSpeed == s.maxSpeed);
+        assert(r.movingTime == s.movingTime && r.liftTime == s.liftTime);
+    }
+    assert(a.liftTime() == b.liftTime());
+}
+
+void testSkiAnalyzer() {
+    qDebug() << "Testing ski analyzer";
+
+    GpxFile day = skiDay(5);
+    assert(day.segmentCount() == 2);
+
+    for (int m=0; m<2; ++m) {
+        setGpxDistanceModel(m == 0 ? UtmDistance : SphericalDistance);
+
+        GpxSkiAnalyzer analyzer;
+        analyzer.analyze(day);
+        assert(analyzer.runs().size() == 5);
+        for (int i=0; i<5; ++i) {
+            const GpxSkiRun &run = analyzer.runs()[i];
+            assert(std::fabs(run.vertical - 300.0) < 12.0);
+            assert(run.duration() >= 180000 && run.duration() <= 210000);
+            assert(run.movingTime == run.duration());
+            assert(std::fabs(run.distance - 850.0) < 60.0);
+            assert(run.averageSpeed() > 4.0 && run.averageSpeed() < 7.0);
+            assert(run.maxSpeed >= run.averageSpeed() && run.maxSpeed < GpxSkiAnalyzer::MaxSpeed);
+            assert(run.topLatitude > 39.48);
+            assert(run.liftTime > 570000 && run.liftTime < 670000);
+            assert(std::fabs(run.liftVertical - 300.0) < 12.0);
+        }
+        assert(std::fabs(analyzer.verticalSkied() - 1500.0) < 60.0);
+        assert(analyzer.liftTime() > 5*570000);
+        assert(analyzer.skiTime() <= 5*210000);
+
+        // Dips smaller than the threshold don't split runs
+        GpxSkiAnalyzer coarse(250.0), fine(5.0);
+        coarse.analyze(day);
+        fine.analyze(day);
+        assert(coarse.runs().size() == 5);
+        assert(fine.runs().size() > 5);
+    }
+    setGpxDistanceModel(UtmDistance);
+
+    // The same runs while loading, with nothing left in the file
+    QString fname = QDir::temp().filePath("gpx_tools_ski.gpx");
+    {
+        QFile file(fname);
+        bool opened = file.open(QIODevice::WriteOnly);
+        assert(opened);
+        GpxWriter writer(&file);
+        bool written = writer.write(day);
+        assert(written);
+    }
+    GpxFile reread(fname);
+    GpxSkiAnalyzer expected;
+    expected.analyze(reread);
+    assert(expected.runs().size() == 5);
+
+    GpxFile::Reader readers[] = { GpxFile::StreamReader, GpxFile::MappedReader };
+    for (int r=0; r<2; ++r) {
+        GpxSkiAnalyzer streamed;
+        GpxSkiAnalysisFilter filter(streamed, 4096);
+        for (int pass=0; pass<2; ++pass) {
+            GpxFile gpx;
+            bool loaded = gpx.load(fname, true, readers[r], &filter);
+            assert(loaded);
+            assert(gpx.pointCount() == 0);
+            compareRuns(expected, streamed);
+        }
+    }
+    QFile::remove(fname);
+
+    GpxFile quandry("data/quandry.gpx");
+    GpxSkiAnalyzer analyzer;
+    analyzer.analyze(quandry);
+    qDebug() << "  quandry.gpx:" << analyzer.runs().size() << "runs," << analyzer.verticalSkied() << "m skied";
+
+    GpxSkiAnalyzer streamed;
+    GpxSkiAnalysisFilter filter(streamed, 4096);
+    GpxFile gpx;
+    bool loaded = gpx.load("data/quandry.gpx", true, GpxFile::MappedReader, &filter);
+    assert(loaded);
+    compareRuns(analyzer, streamed);
+
+    GpxSkiAnalyzer none;
+    GpxFile nothing;
+    none.analyze(nothing);
+    assert(none.runs().isEmpty() && none.liftTime() == 0);
+
+    qDebug() << "Ski analyzer tests passed";
+}
+
+// Pixels of a that differ from b by more than a little in any channel
+int imageDifference(const QImage &a, const QImage &b) {
+    assert(a.size() == b.size());
+    int differ = 0;
+    for (int y=0; y<a.height(); ++y) {
+        for (int x=0; x<a.width(); ++x) {
+            QRgb p = a.pixel(x, y), q = b.pixel(x, y);
+            if (std::abs(qRed(p) - qRed(q)) > 8 || std::abs(qGreen(p) - qGreen(q)) > 8 ||
+                std::abs(qBlue(p) - qBlue(q)) > 8 || std::abs(qAlpha(p) - qAlpha(q)) > 8) {
+                ++differ;
+            }
+        }
+    }
+    return differ;
+}
+
+int pixelsNotColored(const QImage &image, QRgb color) {
+    int count = 0;
+    for (int y=0; y<image.height(); ++y) {
+        for (int x=0; x<image.width(); ++x) {
+            if (image.pixel(x, y) != color) ++count;
+        }
+    }
+    return count;
+}
+
+void testRenderer() {
+    qDebug() << "Testing renderer";
+
+    assert(GpxRenderer::rampColor(0.0) == qRgb(0, 0, 255));
+    assert(GpxRenderer::rampColor(0.5) == qRgb(0, 255, 0));
+    assert(GpxRenderer::rampColor(1.0) == qRgb(255, 0, 0));
+    assert(GpxRenderer::rampColor(2.0) == qRgb(255, 0, 0));
+
+    GpxRenderer empty;
+    QImage blank = empty.render(100, 50);
+    assert(blank.width() == 100 && blank.height() == 50);
+    assert(pixelsNotColored(blank, QColor(Qt::white).rgba()) == 0);
+    assert(empty.render(0, 10).isNull());
+
+    GpxFile gpx("data/quandry.gpx");
+    GpxRenderer renderer;
+    renderer.addFile(gpx);
+    assert(renderer.pointCount() == gpx.pointCount());
+
+    // Tiles join up without seams
+    renderer.setTileSize(1024);
+    QImage whole = renderer.render(400, 300);
+    int drawn = pixelsNotColored(whole, QColor(Qt::white).rgba());
+    assert(drawn > 1000 && drawn < 400*300/2);
+    for (int i=0; i<10; ++i) {
+        assert(whole.pixel(i, i) == QColor(Qt::white).rgba());
+        assert(whole.pixel(399-i, 299-i) == QColor(Qt::white).rgba());
+    }
+    renderer.setTileSize(32);
+    QImage tiled = renderer.render(400, 300);
+    assert(imageDifference(whole, tiled) < 400*300/1000);
+
+    // A straight line east, 10 m/s over the ground while climbing 1000m
+    GpxTrackSegment line;
+    for (int i=0; i<=100; ++i) {
+        line.addPoint(GpxPoint(45.0, 7.0 + 0.000127*i, 10.0*i, qint64(i)*1000));
+    }
+    GpxRenderer speed;
+    speed.addSegment(line);
+    speed.setLineWidth(4);
+    speed.setRange(0.0, 5.0);
+    QImage fast = speed.render(200, 100);
+    QRgb red = GpxRenderer::rampColor(1.0);
+    assert(fast.pixel(100, 50) == red);
+    speed.setRange(100.0, 200.0);
+    assert(speed.render(200, 100).pixel(100, 50) == GpxRenderer::rampColor(0.0));
+
+    GpxRenderer height(GpxRenderer::ElevationColor);
+    height.addSegment(line);
+    height.setLineWidth(4);
+    QImage climb = height.render(200, 100);
+    assert(qBlue(climb.pixel(12, 50)) == 255 && qRed(climb.pixel(12, 50)) == 0);
+    assert(qRed(climb.pixel(187, 50)) == 255 && qBlue(climb.pixel(187, 50)) == 0);
+
+    // Changing what's coloured starts over
+    height.setColorBy(GpxRenderer::TimeColor);
+    assert(height.pointCount() == 0);
+
+    // A single point is still drawn
+    GpxTrackSegment one;
+    one.addPoint(GpxPoint(45.0, 7.0, 0.0, 0));
+    GpxRenderer dot;
+    dot.addSegment(one);
+    assert(pixelsNotColored(dot.render(50, 50), QColor(Qt::white).rgba()) > 0);
+
+    qDebug() << "Renderer tests passed";
+}
+
+// A segment's points projected the way MapWidget does
+void projectSegment(const GpxTrackSegment &seg, QVector<double> &x, QVector<double> &y) {
+    int n = seg.pointCount();
+    double cosLat = std::cos(seg.latitudes()[0] * 3.14159265358979323846 / 180);
+    x.resize(n);
+    y.resize(n);
+    for (int i=0; i<n; ++i) {
+        x[i] = seg.longitudes()[i] * cosLat;
+        y[i] = seg.latitudes()[i];
+    }
+}
+
+// Distance from point p to the line from a to b
+double lineDistance(const double *x, const double *y, int p, int a, int b) {
+    double dx = x[b]-x[a], dy = y[b]-y[a];
+    double len2 = dx*dx + dy*dy;
+    double t = len2 > 0.0 ? ((x[p]-x[a])*dx + (y[p]-y[a])*dy) / len2 : 0.0;
+    t = std::max(0.0, std::min(1.0, t));
+    return std::sqrt(std::pow(x[a] + t*dx - x[p], 2) + std::pow(y[a] + t*dy - y[p], 2));
+}
+
+void testQuadtree() {
+    qDebug() << "Testing quadtree";
+
+    QVector<int> points, runs;
+    GpxQuadtree empty;
+    empty.query(-1e9, -1e9, 1e9, 1e9, 0.0, points, runs);
+    assert(points.isEmpty() && runs.size() == 1 && runs[0] == 0);
+
+    GpxFile gpx("data/quandry.gpx");
+    QVector<double> x, y;
+    projectSegment(gpx.at(0), x, y);
+    int n = x.size();
+
+    GpxQuadtree tree;
+    tree.build(x.constData(), y.constData(), n);
+    assert(tree.size() == n);
+    assert(tree.levelCount() > 2);
+    double minX, minY, maxX, maxY;
+    tree.bounds(minX, minY, maxX, maxY);
+
+    // Everything at full detail is the whole track in one run
+    tree.query(minX, minY, maxX, maxY, 0.0, points, runs);
+    assert(runs.size() == 2 && points.size() == n);
+    for (int i=0; i<n; ++i) {
+        assert(points[i] == i);
+    }
+
+    // Part of it at full detail has every point in the box, as runs of
+    // consecutive points
+    double bx0 = minX + (maxX-minX)*0.4, bx1 = minX + (maxX-minX)*0.6;
+    double by0 = minY + (maxY-minY)*0.3, by1 = minY + (maxY-minY)*0.7;
+    tree.query(bx0, by0, bx1, by1, 0.0, points, runs);
+    assert(points.size() < n);
+    QVector<bool> found(n, false);
+    for (int r=0; r+1<runs.size(); ++r) {
+        assert(runs[r+1] > runs[r]);
+        for (int j=runs[r]; j<runs[r+1]; ++j) {
+            found[points[j]] = true;
+            if (j > runs[r]) assert(points[j] == points[j-1]+1);
+        }
+    }
+    for (int i=0; i<n; ++i) {
+        if (x[i] >= bx0 && x[i] <= bx1 && y[i] >= by0 && y[i] <= by1) assert(found[i]);
+    }
+
+    // Coarser, every dropped point is within the tolerance of what's left
+    double tolerance = (maxX-minX) / 1000;
+    tree.query(minX, minY, maxX, maxY, tolerance, points, runs);
+    assert(runs.size() == 2 && points.size() < n/4);
+    assert(points[0] == 0 && points.last() == n-1);
+    for (int j=1; j<points.size(); ++j) {
+        assert(points[j] > points[j-1]);
+        for (int i=points[j-1]+1; i<points[j]; ++i) {
+            assert(lineDistance(x.constData(), y.constData(), i, points[j-1], points[j]) <= tolerance);
+        }
+    }
+
+    // A line crossing the box with no points in it is still found
+    double lineX[2] = {0.0, 10.0}, lineY[2] = {0.0, 10.0};
+    GpxQuadtree line;
+    line.build(lineX, lineY, 2);
+    line.query(4.0, 4.0, 6.0, 6.0, 0.0, points, runs);
+    assert(points.size() == 2 && runs.size() == 2);
+    line.query(6.0, 0.0, 10.0, 4.0, 0.0, points, runs);
+    assert(points.size() == 2);
+
+    GpxQuadtree dot;
+    dot.build(lineX, lineY, 1);
+    dot.query(-1.0, -1.0, 1.0, 1.0, 0.0, points, runs);
+    assert(points.size() == 1 && points[0] == 0 && runs.size() == 2);
+    dot.query(1.0, 1.0, 2.0, 2.0, 0.0, points, runs);
+    assert(points.isEmpty());
+
+    qDebug() << "Quadtree tests passed";
+}
+
+// Write a GPX file with one track of n points wandering around Breckenridge
+void writeSyntheticGpx(QString fname, int n) {
+    QFile file(fname);
+    if (!file.open(QIODevice::WriteOnly)) return;
+    QTextStream out(&file);
+
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<gpx version=\"1.0\" creator=\"tests\">\n"
+        << "<trk><name>SYNTHETIC</name><trkseg>\n";
+
+    QDateTime start(QDate(2010, 1, 2), QTime(9, 0, 0), Qt::UTC);
+    for (int i=0; i<n; ++i) {
+        double t = i/1000.0;
+        out << QString("<trkpt lat=\"%1\" lon=\"%2\">\n"
+                       "  <ele>%3</ele>\n"
+                       "  <time>%4Z</time>\n"
+                       "</trkpt>\n")
+            .arg(39.48 + 0.01*std::sin(t), 0, 'f', 9)
+            .arg(-106.07 + 0.01*std::cos(1.3*t), 0, 'f', 9)
+            .arg(3000.0 + 400.0*std::sin(0.7*t), 0, 'f', 6)
+            .arg(start.addSecs(i).toString("yyyy-MM-ddThh:mm:ss"));
+    }
+    out << "</trkseg></trk>\n</gpx>\n";
+}
+
+// Time loading fname, and loading plus projecting every point
+void benchmarkLoad(QString fname, int iterations) {
+    QTime timer;
+    timer.start();
+    for (int i=0; i<iterations; ++i) {
+        GpxFile gpx(fname);
+    }
+    double loadSecs = qMax(timer.elapsed(), 1) / 1000.0;
+
+    timer.start();
+    for (int i=0; i<iterations; ++i) {
+        GpxFile gpx(fname);
+        gpx.length();
+    }
+    double lengthSecs = qMax(timer.elapsed(), 1) / 1000.0;
+
+    qDebug() << fname << ": load" << 1000*loadSecs/iterations << "ms,"
+             << "load and length()" << 1000*lengthSecs/iterations << "ms";
+}
+
+// Time the bounding box, length and max speed kernels on n points
+void benchmarkKernels(int n, int iterations) {
+    const char *names[] = { "Scalar", "SSE2", "AVX2" };
+
+    QVector<double> x(n), y(n), z(n);
+    QVector<qint64> t(n);
+    for (int i=0; i<n; ++i) {
+        x[i] = 400000.0 + 1000.0*std::sin(i/1000.0);
+        y[i] = 4360000.0 + 1000.0*std::cos(i/1300.0);
+        z[i] = 3000.0 + 400.0*std::sin(i/700.0);
+        t[i] = Q_INT64_C(1262422800000) + 1000*i;
+    }
+
+    // Each pass reads the three double arrays, plus times for maxSpeed
+    double mbytes = 3.0*n*sizeof(double) / (1024.0*1024.0);
+    GpxKernelIsa best = gpxKernelIsa();
+
+    for (int isa=ScalarKernels; isa<=best; ++isa) {
+        setGpxKernelIsa(GpxKernelIsa(isa));
+        QTime timer;
+        double lo, hi;
+        volatile double sink = 0.0;
+
+        timer.start();
+        for (int i=0; i<iterations; ++i) {
+            gpxMinMax(x.constData(), n, lo, hi);
+            gpxMinMax(y.constData(), n, lo, hi);
+            gpxMinMax(z.constData(), n, lo, hi);
+            sink += lo + hi;
+        }
+        double boundSecs = qMax(timer.elapsed(), 1) / 1000.0;
+
+        timer.start();
+        for (int i=0; i<iterations; ++i) {
+            sink += gpxPathLength(x.constData(), y.constData(), z.constData(), n);
+        }
+        double lengthSecs = qMax(timer.elapsed(), 1) / 1000.0;
+
+        timer.start();
+        for (int i=0; i<iterations; ++i) {
+            sink += gpxMaxSpeed(x.constData(), y.constData(), z.constData(), t.constData(), n);
+        }
+        double speedSecs = qMax(timer.elapsed(), 1) / 1000.0;
+
+        qDebug() << names[isa] << "kernels: bounds"
+                 << mbytes*iterations/boundSecs << "MB/s, length"
+                 << mbytes*iterations/lengthSecs << "MB/s, max speed"
+                 << (mbytes*4/3)*iterations/speedSecs << "MB/s";
+    }
+    setGpxKernelIsa(best);
+}
+
+// Time writing fname back out
+void benchmarkWrite(QString fname, int iterations) {
+    GpxFile gpx(fname);
+    QString out = QDir::temp().filePath("gpx_tools_written.gpx");
+
+    QTime timer;
+    timer.start();
+    for (int i=0; i<iterations; ++i) {
+        QFile file(out);
+        if (!file.open(QIODevice::WriteOnly)) return;
+        GpxWriter writer(&file);
+        writer.write(gpx);
+    }
+    double secs = qMax(timer.elapsed(), 1) / 1000.0;
+    double mbytes = QFileInfo(out).size() / (1024.0*1024.0);
+
+    qDebug() << fname << ": write" << (mbytes*iterations)/secs << "MB/s";
+    QFile::remove(out);
+}
+
+// Convert fname to both binary layouts and time loading them
+void benchmarkBinary(QString fname, int iterations) {
+    const char *names[] = { "Packed", "Columnar" };
+    GpxBinaryWriter::Layout layouts[] = { GpxBinaryWriter::PackedLayout,
+                                          GpxBinaryWriter::ColumnarLayout };
+    GpxFile gpx(fname);
+    QString out = QDir::temp().filePath("gpx_tools_bench.gpxb");
+
+    for (int l=0; l<2; ++l) {
+        {
+            QFile file(out);
+            if (!file.open(QIODevice::WriteOnly)) return;
+            GpxBinaryWriter writer(&file, layouts[l]);
+            writer.write(gpx);
+        }
+
+        QTime timer;
+        timer.start();
+        for (int i=0; i<iterations; ++i) {
+            GpxFile copy(out);
+        }
+        double secs = qMax(timer.elapsed(), 1) / 1000.0;
+
+        qDebug() << names[l] << "binary:" << QFileInfo(out).size() << "bytes vs"
+                 << QFileInfo(fname).size() << "for GPX, load"
+                 << 1000*secs/iterations << "ms";
+    }
+    QFile::remove(out);
+}
+
+// Time each reader on fname and report its throughput
+void benchmarkReaders(QString fname, int iterations) {
+    const char *names[] = { "SAX", "Stream", "Mapped" };
+    GpxFile::Reader readers[] = { GpxFile::SaxReader, GpxFile::StreamReader, GpxFile::MappedReader };
+
+    double mbytes = QFileInfo(fname).size() / (1024.0*1024.0);
+
+    for (int r=0; r<3; ++r) {
+        int pts = 0;
+        QTime timer;
+        timer.start();
+        for (int i=0; i<iterations; ++i) {
+            GpxFile gpx(fname, true, readers[r]);
+            pts += gpx.pointCount();
+        }
+        double secs = qMax(timer.elapsed(), 1) / 1000.0;
+        qDebug() << names[r] << "reader:"
+                 << (mbytes*iterations)/secs << "MB/s,"
+                 << pts/secs << "points/s";
+    }
+}
+
+// Load count copies of fname with 1, 2, 4 ... threads
+void benchmarkBatch(QString fname, int count) {
+    QStringList files;
+    for (int i=0; i<count; ++i) {
+        files << fname;
+    }
+
+    double base = 0.0;
+    for (int threads=1; threads<=QThread::idealThreadCount(); threads*=2) {
+        QTime timer;
+        timer.start();
+        GpxBatchLoader loader(files);
+        loader.setThreadCount(threads);
+        GpxBatchResult result;
+        while (loader.next(result)) { }
+        double secs = qMax(timer.elapsed(), 1) / 1000.0;
+        if (threads == 1) base = secs;
+
+        qDebug() << threads << "threads:" << count/secs << "files/s, speedup" << base/secs;
+    }
+}
+
+// Project n points one at a time with GeographicLib and in one batch
+void benchmarkProjection(int n, int iterations) {
+    QVector<double> lat(n), lon(n), x(n), y(n);
+    QVector<signed char> zone(n);
+    for (int i=0; i<n; ++i) {
+        lat[i] = 39.45 + 0.1 * std::sin(i * 0.001);
+        lon[i] = -106.05 + 0.1 * std::cos(i * 0.0013);
+    }
+
+    QTime timer;
+    timer.start();
+    for (int it=0; it<iterations; ++it) {
+        for (int i=0; i<n; ++i) {
+            int z;
+            bool north;
+            double gamma, k;
+            GeographicLib::UTMUPS::Forward(lat[i], lon[i], z, north, x[i], y[i], gamma, k);
+        }
+    }
+    double single = qMax(timer.elapsed(), 1) / 1000.0;
+
+    timer.start();
+    for (int it=0; it<iterations; ++it) {
+        gpxProjectUTM(lat.constData(), lon.constData(), n, x.data(), y.data(), zone.data());
+    }
+    double batch = qMax(timer.elapsed(), 1) / 1000.0;
+
+    qDebug() << "UTMUPS::Forward:" << n*iterations/single/1e6 << "Mpoints/s,"
+             << "gpxProjectUTM:" << n*iterations/batch/1e6 << "Mpoints/s";
+}
+
+// Time length() on fresh copies of fname with each distance model
+void benchmarkDistance(QString fname, int iterations) {
+    const char *names[] = { "UTM", "Spherical", "Geodesic" };
+    GpxDistanceModel models[] = { UtmDistance, SphericalDistance, GeodesicDistance };
+
+    for (int m=0; m<3; ++m) {
+        QList<GpxFile> copies;
+        for (int i=0; i<iterations; ++i) {
+            copies.push_back(GpxFile(fname));
+        }
+
+        setGpxDistanceModel(models[m]);
+        QTime timer;
+        timer.start();
+        double len = 0.0;
+        for (int i=0; i<iterations; ++i) {
+            len = copies[i].length();
+        }
+        double secs = qMax(timer.elapsed(), 1) / 1000.0;
+        qDebug() << names[m] << "length:" << copies[0].pointCount()*iterations/secs/1e6
+                 << "Mpoints/s," << len << "m";
+    }
+    setGpxDistanceModel(UtmDistance);
+}
+
+// Time simplifying fname with each algorithm, after projecting it
+void benchmarkSimplify(QString fname, int iterations) {
+    const char *names[] = { "Douglas-Peucker", "Visvalingam-Whyatt" };
+    GpxSimplifier::Algorithm algorithms[] = { GpxSimplifier::DouglasPeucker,
+                                              GpxSimplifier::VisvalingamWhyatt };
+
+    for (int a=0; a<2; ++a) {
+        QList<GpxFile> copies;
+        for (int i=0; i<iterations; ++i) {
+            copies.push_back(GpxFile(fname));
+            for (int s=0; s<copies[i].segmentCount(); ++s) {
+                copies[i][s].project();
+            }
+        }
+
+        GpxSimplifier simplifier(5.0, algorithms[a]);
+        QTime timer;
+        timer.start();
+        for (int i=0; i<iterations; ++i) {
+            simplifier.simplify(copies[i]);
+        }
+        double secs = qMax(timer.elapsed(), 1) / 1000.0;
+        GpxFile orig(fname);
+        qDebug() << names[a] << "simplify:" << orig.pointCount()*iterations/secs/1e6
+                 << "Mpoints/s, kept" << copies[0].pointCount() << "of" << orig.pointCount();
+    }
+}
+
+// Time building the spatial index over fname and querying it
+void benchmarkSpatialIndex(QString fname, int queries) {
+    GpxFile gpx(fname, true, GpxFile::MappedReader);
+    double minLat, minLon, minEle, maxLat, maxLon, maxEle;
+    gpx.boundLatLon(minLat, minLon, minEle, maxLat, maxLon, maxEle);
+
+    QTime timer;
+    timer.start();
+    const GpxSpatialIndex &index = gpx.spatialIndex();
+    double secs = qMax(timer.elapsed(), 1) / 1000.0;
+    qDebug() << "Spatial index build:" << gpx.pointCount()/secs/1e6 << "Mpoints/s";
+
+    srand(1);
+    QVector<double> lats(queries), lons(queries);
+    for (int i=0; i<queries; ++i) {
+        lats[i] = minLat + (maxLat-minLat)*rand()/double(RAND_MAX);
+        lons[i] = minLon + (maxLon-minLon)*rand()/double(RAND_MAX);
+    }
+
+    timer.start();
+    int sum = 0;
+    for (int i=0; i<queries; ++i) {
+        sum += index.nearest(lats[i], lons[i]);
+    }
+    secs = qMax(timer.elapsed(), 1) / 1000.0;
+    qDebug() << "Nearest point:" << queries/secs << "queries/s" << sum;
+
+    timer.start();
+    int found = 0;
+    for (int i=0; i<queries; ++i) {
+        found += index.withinDistance(lats[i], lons[i], 100.0).size();
+    }
+    secs = qMax(timer.elapsed(), 1) / 1000.0;
+    qDebug() << "Points within 100m:" << queries/secs << "queries/s," << found << "found";
+
+    // The scan it replaces
+    int scans = qMax(queries/1000, 1);
+    timer.start();
+    for (int q=0; q<scans; ++q) {
+        double best = 1e300;
+        for (int i=0; i<gpx.pointCount(); ++i) {
+            best = std::min(best, sphereDistance(lats[q], lons[q], gpx(i).latitude(), gpx(i).longitude()));
+        }
+        sum += int(best);
+    }
+    secs = qMax(timer.elapsed(), 1) / 1000.0;
+    qDebug() << "Linear scan:" << scans/secs << "queries/s" << sum;
+}
+
+// Time finding resorts with the tree against checking them all
+void benchmarkResortDb(int queries) {
+    GpxResortDb db;
+    db.load("../../../perl/north_america.xml");
+
+    srand(1);
+    QVector<double> lats(queries), lons(queries);
+    for (int i=0; i<queries; ++i) {
+        lats[i] = 25.0 + 45.0*rand()/RAND_MAX;
+        lons[i] = -150.0 + 100.0*rand()/RAND_MAX;
+    }
+
+    QTime timer;
+    timer.start();
+    int sum = 0;
+    for (int i=0; i<queries; ++i) {
+        sum += db.nearest(lats[i], lons[i]);
+    }
+    double secs = qMax(timer.elapsed(), 1) / 1000.0;
+    qDebug() << "Nearest resort:" << queries/secs << "queries/s" << sum;
+
+    timer.start();
+    for (int i=0; i<queries; ++i) {
+        double metres;
+        sum += scanResorts(db, lats[i], lons[i], metres);
+    }
+    secs = qMax(timer.elapsed(), 1) / 1000.0;
+    qDebug() << "Resort scan:" << queries/secs << "queries/s" << sum;
+}
+
+// Time drawing copies of fname into one image
+void benchmarkRenderer(QString fname, int copies) {
+    GpxFile gpx(fname, true, GpxFile::MappedReader);
+
+    QTime timer;
+    timer.start();
+    GpxRenderer renderer;
+    for (int i=0; i<copies; ++i) {
+        renderer.addFile(gpx);
+    }
+    double secs = qMax(timer.elapsed(), 1) / 1000.0;
+    qDebug() << "Renderer add:" << renderer.pointCount()/secs/1e6 << "Mpoints/s";
+
+    timer.start();
+    QImage image = renderer.render(2048, 2048);
+    secs = qMax(timer.elapsed(), 1) / 1000.0;
+    qDebug() << "Render 2048x2048:" << renderer.pointCount()/secs/1e6 << "Mpoints/s";
+}
+
+// Time building a quadtree over fname and querying windows at each zoom
+void benchmarkQuadtree(QString fname, int queries) {
+    GpxFile gpx(fname, true, GpxFile::MappedReader);
+    QVector<double> x, y;
+    projectSegment(gpx.at(0), x, y);
+
+    QTime timer;
+    timer.start();
+    GpxQuadtree tree;
+    tree.build(x.constData(), y.constData(), x.size());
+    double secs = qMax(timer.elapsed(), 1) / 1000.0;
+    qDebug() << "Quadtree build:" << x.size()/secs/1e6 << "Mpoints/s," << tree.levelCount() << "levels";
+
+    double minX, minY, maxX, maxY;
+    tree.bounds(minX, minY, maxX, maxY);
+    double extent = std::max(maxX-minX, maxY-minY);
+
+    // 256 pixel tiles, from the whole track in one tile down
+    srand(1);
+    QVector<int> points, runs;
+    for (int zoom=0; zoom<=12; zoom += 4) {
+        double size = std::ldexp(extent, -zoom);
+        timer.start();
+        qint64 total = 0;
+        for (int q=0; q<queries; ++q) {
+            int i = rand() % x.size();
+            tree.query(x[i]-size/2, y[i]-size/2, x[i]+size/2, y[i]+size/2, size/512, points, runs);
+            total += points.size();
+        }
+        secs = qMax(timer.elapsed(), 1) / 1000.0;
+        qDebug() << "Quadtree zoom" << zoom << ":" << queries/secs << "tiles/s,"
+                 << double(total)/queries << "points per tile";
+    }
+}
+
+// Time removing half and merging all of a file of count segments by name
+void benchmarkTrackNames(int count) {
+    QStringList odd, all;
+    for (int i=0; i<count; ++i) {
+        if (i%2) odd << QString("ACTIVE LOG #%1").arg(i);
+        all << QString("ACTIVE LOG #%1").arg(i);
+    }
+
+    GpxFile removing = activeLogs(count);
+    QTime timer;
+    timer.start();
+    removing.removeTracksByName(odd);
+    double secs = qMax(timer.elapsed(), 1) / 1000.0;
+    qDebug() << "Remove" << odd.size() << "of" << count << "tracks by name:" << secs << "s";
+
+    GpxFile merging = activeLogs(count);
+    timer.start();
+    merging.mergeTracksByName(all);
+    secs = qMax(timer.elapsed(), 1) / 1000.0;
+    qDebug() << "Merge" << count << "tracks by name:" << secs << "s";
+
+    timer.start();
+    int found = 0;
+    for (int i=0; i<count; ++i) {
+        found += removing.segmentIndex(all[i]) >= 0 ? 1 : 0;
+    }
+    secs = qMax(timer.elapsed(), 1) / 1000.0;
+    qDebug() << "Segment lookup by name:" << count/secs << "lookups/s," << found << "found";
+}
+
+int main(int argc, char **argv) {
+
+    // "tests bench [file]" measures reader throughput instead of testing
+    if (argc > 1 && QString(argv[1]) == "bench") {
+        if (argc > 2) {
+            benchmarkReaders(argv[2], 20);
+            benchmarkLoad(argv[2], 20);
+            benchmarkWrite(argv[2], 20);
+            benchmarkBinary(argv[2], 20);
+            benchmarkBatch(argv[2], 200);
+            benchmarkDistance(argv[2], 20);
+            benchmarkSimplify(argv[2], 20);
+            benchmarkSpatialIndex(argv[2], 10000);
+            benchmarkRenderer(argv[2], 10);
+            benchmarkQuadtree(argv[2], 10000);
+        } else {
+            QString synthetic = QDir::temp().filePath("gpx_tools_synthetic.gpx");
+            writeSyntheticGpx(synthetic, 500000);
+
+            benchmarkReaders("data/quandry.gpx", 20);
+            benchmarkLoad("data/quandry.gpx", 20);
+            benchmarkReaders(synthetic, 2);
+            benchmarkLoad(synthetic, 2);
+            benchmarkWrite(synthetic, 2);
+            benchmarkBinary(synthetic, 2);
+            benchmarkDistance(synthetic, 2);
+            benchmarkSimplify(synthetic, 2);
+            benchmarkSpatialIndex(synthetic, 10000);
+            benchmarkRenderer(synthetic, 10);
+            benchmarkQuadtree(synthetic, 10000);
+            benchmarkBatch("data/quandry.gpx", 2000);
+            QFile::remove(synthetic);
+        }
+        benchmarkKernels(1000000, 50);
+        benchmarkProjection(1000000, 5);
+        benchmarkResortDb(100000);
+        benchmarkTrackNames(20000);
+        return 0;
+    }
 
     GpxFile gpx("data/quandry.gpx");
 
@@ -118,6 +2241,51 @@ int main() {
     testFuncCallOp();
 
     testMerge();
+
+    testTrackNames();
+
+    testEditHistory();
+
+    testReaders();
+
+    testTimestamps();
+
+    testColumnarSegment();
+
+    testKernels();
+
+    testCachedStats();
+
+    testPointIndex();
+
+    testWriter();
+
+    testBinary();
+
+    testBatchLoader();
+
+    testParallelStats();
+
+    testProjection();
+
+    testDistanceModels();
+
+    testPyramid();
+
+    testLoadProgress();
+
+    testSimplify();
+
+    testSpatialIndex();
+
+    testResortDb();
+
+    testSkiAnalyzer();
+
+    testRenderer();
+
+    testQuadtree();
+
     qDebug() << "All tests passed.";
     return 0;
 }